@@ -5,23 +5,23 @@ import re
 import sys
 
 cc = "clang"
-cflags = "-Os -std=c99"
-ldflags = ""
+cflags = "-Os -std=c99 -pthread"
+ldflags = "-pthread"
 out = "out/release/"
 name = "drte"
 
 devcc = "clang"
-devcflags = "-O0 -g -std=c99 -Wall -Wextra -Wmissing-prototypes\
+devcflags = "-O0 -g -std=c99 -pthread -Wall -Wextra -Wmissing-prototypes\
  -fsanitize=address -fno-omit-frame-pointer"
-devldflags = "-fsanitize=address -fno-omit-frame-pointer"
+devldflags = "-pthread -fsanitize=address -fno-omit-frame-pointer"
 devout = "out/devel/"
 devbinname = "drte-dev"
 
 testcc = "clang"
-testcflags = "-O0 -g -std=c99 -Wall -Wextra -DDRTE_TEST\
+testcflags = "-O0 -g -std=c99 -pthread -Wall -Wextra -DDRTE_TEST\
  -Wno-implicit-function-declaration -fno-omit-frame-pointer\
  -fsanitize=address"
-testldflags = "-fno-omit-frame-pointer -fsanitize=address"
+testldflags = "-pthread -fno-omit-frame-pointer -fsanitize=address"
 testout = "out/devel/"
 
 source = "src/"
@@ -0,0 +1,409 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gapbuffer.h"
+#include "aho_corasick.h"
+#include "scan.h"
+#include "static.h"
+
+
+#define INITIAL_RANGES_SIZE 64
+
+// Automaton is a deterministic automaton. State 0 is the start state.
+typedef struct {
+	uint32_t (*next)[256]; // The transitions of every state.
+	uint32_t *length; // The length of the longest pattern, that ends in a state.
+	uint32_t *hits; // The number of patterns, that end in a state.
+	size_t states; // The number of states.
+	bool has_first; // True, if all patterns start with the byte first.
+	char first; // Bytes before it are skipped with scan_byte.
+} Automaton;
+
+struct AhoCorasick {
+	Automaton forward; // Finds the patterns, from left to right.
+	Automaton reverse; // Finds the reversed patterns, from right to left.
+	size_t longest; // The length of the longest pattern.
+	char *pattern; // If there is only one pattern, this is a copy of it.
+	size_t plen; // The length of pattern.
+};
+
+STATIC bool automaton_init(Automaton *a, size_t states);
+STATIC void automaton_free(Automaton *a);
+STATIC void automaton_add(Automaton *a, char *pattern, size_t len, bool reverse);
+STATIC bool automaton_compile(Automaton *a);
+STATIC char *automaton_scan(Automaton *a, size_t *state, char *s, size_t len, size_t *length);
+STATIC char *automaton_scan_reverse(Automaton *a, size_t *state, char *s, size_t len,
+                                    size_t *length);
+
+
+// Allocates room for at most states states. The start state has no transitions.
+STATIC bool
+automaton_init(Automaton *a, size_t states) {
+	a->next = calloc(states, sizeof(*a->next));
+	a->length = calloc(states, sizeof(*a->length));
+	a->hits = calloc(states, sizeof(*a->hits));
+	a->states = 1;
+	if (a->next == NULL || a->length == NULL || a->hits == NULL) {
+		automaton_free(a);
+		return false;
+	}
+	return true;
+}
+
+STATIC void
+automaton_free(Automaton *a) {
+	free(a->next);
+	free(a->length);
+	free(a->hits);
+	memset(a, 0, sizeof(*a));
+}
+
+// Adds a pattern to the trie. A transition to state 0 means, that there is none.
+STATIC void
+automaton_add(Automaton *a, char *pattern, size_t len, bool reverse) {
+	uint32_t state = 0;
+
+	for (size_t i = 0; i < len; i++) {
+		unsigned char c = reverse ? pattern[len - i - 1] : pattern[i];
+
+		if (a->next[state][c] == 0) {
+			a->next[state][c] = a->states;
+			a->states++;
+		}
+		state = a->next[state][c];
+	}
+	if (a->length[state] == 0) {
+		// Duplicate patterns are counted once.
+		a->length[state] = len;
+		a->hits[state] = 1;
+	}
+}
+
+// Turns the trie into an automaton: Missing transitions are replaced by the
+// transitions of the longest proper suffix, that is in the trie. The states are
+// visited in breadth-first order, so the suffix state is complete when it is used.
+STATIC bool
+automaton_compile(Automaton *a) {
+	uint32_t *queue = malloc(a->states * sizeof(*queue));
+	uint32_t *fail = malloc(a->states * sizeof(*fail));
+	size_t head = 0;
+	size_t tail = 0;
+	size_t firsts = 0;
+
+	if (queue == NULL || fail == NULL) {
+		free(queue);
+		free(fail);
+		return false;
+	}
+	for (size_t c = 0; c < 256; c++) {
+		uint32_t t = a->next[0][c];
+
+		if (t != 0) {
+			fail[t] = 0;
+			queue[tail++] = t;
+			a->first = c;
+			firsts++;
+		}
+	}
+	a->has_first = firsts == 1;
+
+	while (head < tail) {
+		uint32_t s = queue[head++];
+
+		if (a->length[s] == 0) {
+			a->length[s] = a->length[fail[s]];
+		}
+		a->hits[s] += a->hits[fail[s]];
+		for (size_t c = 0; c < 256; c++) {
+			uint32_t t = a->next[s][c];
+
+			if (t != 0) {
+				fail[t] = a->next[fail[s]][c];
+				queue[tail++] = t;
+			} else {
+				a->next[s][c] = a->next[fail[s]][c];
+			}
+		}
+	}
+	free(queue);
+	free(fail);
+	return true;
+}
+
+// Feeds s to the automaton, until a pattern ends.
+STATIC char *
+automaton_scan(Automaton *a, size_t *state, char *s, size_t len, size_t *length) {
+	uint32_t current = *state;
+	char *end = s + len;
+
+	while (s < end) {
+		if (current == 0 && a->has_first) {
+			s = scan_byte(s, end - s, a->first);
+			if (s == NULL) {
+				break;
+			}
+		}
+		current = a->next[current][(unsigned char)*s];
+		if (a->length[current] != 0) {
+			*state = current;
+			*length = a->length[current];
+			return s;
+		}
+		s++;
+	}
+	*state = current;
+	return NULL;
+}
+
+// Feeds s to the automaton, from the last byte to the first one, until a
+// pattern ends.
+STATIC char *
+automaton_scan_reverse(Automaton *a, size_t *state, char *s, size_t len, size_t *length) {
+	uint32_t current = *state;
+	char *p = s + len;
+
+	while (p > s) {
+		if (current == 0 && a->has_first) {
+			p = scan_byte_reverse(s, p - s, a->first);
+			if (p == NULL) {
+				break;
+			}
+			p++;
+		}
+		p--;
+		current = a->next[current][(unsigned char)*p];
+		if (a->length[current] != 0) {
+			*state = current;
+			*length = a->length[current];
+			return p;
+		}
+	}
+	*state = current;
+	return NULL;
+}
+
+AhoCorasick *
+aho_corasick_new(char **patterns, size_t *lengths, size_t n) {
+	AhoCorasick *ac = malloc(sizeof(*ac));
+	size_t states = 1;
+	size_t count = 0;
+
+	if (ac == NULL) {
+		return NULL;
+	}
+	memset(ac, 0, sizeof(*ac));
+	for (size_t i = 0; i < n; i++) {
+		if (lengths[i] > UINT32_MAX - states) {
+			free(ac);
+			return NULL;
+		}
+		states += lengths[i];
+		if (lengths[i] > ac->longest) {
+			ac->longest = lengths[i];
+		}
+		if (lengths[i] != 0) {
+			ac->pattern = patterns[i];
+			ac->plen = lengths[i];
+			count++;
+		}
+	}
+	if (count == 1) {
+		// A single pattern is searched with the faster gbf_search.
+		char *copy = malloc(ac->plen);
+		if (copy == NULL) {
+			free(ac);
+			return NULL;
+		}
+		memcpy(copy, ac->pattern, ac->plen);
+		ac->pattern = copy;
+	} else {
+		ac->pattern = NULL;
+	}
+
+	if (!automaton_init(&ac->forward, states) || !automaton_init(&ac->reverse, states)) {
+		aho_corasick_free(&ac);
+		return NULL;
+	}
+	for (size_t i = 0; i < n; i++) {
+		if (lengths[i] != 0) {
+			automaton_add(&ac->forward, patterns[i], lengths[i], false);
+			automaton_add(&ac->reverse, patterns[i], lengths[i], true);
+		}
+	}
+	if (!automaton_compile(&ac->forward) || !automaton_compile(&ac->reverse)) {
+		aho_corasick_free(&ac);
+		return NULL;
+	}
+	return ac;
+}
+
+void
+aho_corasick_free(AhoCorasick **ac) {
+	automaton_free(&(*ac)->forward);
+	automaton_free(&(*ac)->reverse);
+	free((*ac)->pattern);
+	free(*ac);
+	*ac = NULL;
+}
+
+size_t
+aho_corasick_longest(AhoCorasick *ac) {
+	return ac->longest;
+}
+
+char *
+aho_corasick_scan(AhoCorasick *ac, size_t *state, char *s, size_t len, size_t *length) {
+	return automaton_scan(&ac->forward, state, s, len, length);
+}
+
+size_t
+aho_corasick_count(AhoCorasick *ac, size_t *state, char *s, size_t len) {
+	Automaton *a = &ac->forward;
+	uint32_t current = *state;
+	size_t count = 0;
+	char *end = s + len;
+
+	while (s < end) {
+		if (current == 0 && a->has_first) {
+			s = scan_byte(s, end - s, a->first);
+			if (s == NULL) {
+				break;
+			}
+		}
+		current = a->next[current][(unsigned char)*s];
+		count += a->hits[current];
+		s++;
+	}
+	*state = current;
+	return count;
+}
+
+bool
+aho_corasick_search(AhoCorasick *ac, GapBuffer *gbuf, size_t start,
+                    size_t *offset, size_t *length) {
+	size_t state = 0;
+	size_t stop = SIZE_MAX;
+	bool has_match = false;
+	size_t len;
+	char *chunk;
+
+	if (ac->pattern != NULL) {
+		*length = ac->plen;
+		return gbf_search(gbuf, ac->pattern, ac->plen, start, offset);
+	} else if (ac->longest == 0) {
+		return false;
+	}
+
+	// The first match, that ends, is not always the leftmost one. A match,
+	// that starts earlier, ends before stop.
+	while (start < stop && (len = gbf_chunk(gbuf, start, &chunk)) > 0) {
+		size_t n = 0;
+
+		if (len > stop - start) {
+			len = stop - start;
+		}
+		char *found = aho_corasick_scan(ac, &state, chunk, len, &n);
+		if (found == NULL) {
+			start += len;
+			continue;
+		}
+		start += found - chunk + 1;
+		if (!has_match || start - n < *offset ||
+			(start - n == *offset && n > *length)) {
+			*offset = start - n;
+			*length = n;
+			stop = *offset + ac->longest - 1;
+			has_match = true;
+		}
+	}
+	return has_match;
+}
+
+bool
+aho_corasick_search_reverse(AhoCorasick *ac, GapBuffer *gbuf, size_t start,
+                            size_t *offset, size_t *length) {
+	size_t text_length = gbf_text_length(gbuf);
+	size_t state = 0;
+	size_t len;
+	char *chunk;
+
+	if (ac->pattern != NULL) {
+		*length = ac->plen;
+		return gbf_search_reverse(gbuf, ac->pattern, ac->plen, start, offset);
+	} else if (ac->longest == 0) {
+		return false;
+	}
+
+	// The reversed text is searched for the reversed patterns. The first match
+	// is the one, that starts last.
+	start = start < text_length ? start + 1 : text_length;
+	while ((len = gbf_chunk_reverse(gbuf, start, &chunk)) > 0) {
+		char *found = automaton_scan_reverse(&ac->reverse, &state, chunk, len, length);
+
+		if (found != NULL) {
+			*offset = start - len + (found - chunk);
+			return true;
+		}
+		start -= len;
+	}
+	return false;
+}
+
+size_t
+aho_corasick_ranges(AhoCorasick *ac, GapBuffer *gbuf, size_t start, size_t end,
+                    size_t **ranges, size_t *size) {
+	size_t offset = ac->longest > start ? 0 : start - ac->longest + 1;
+	size_t limit = end + ac->longest - 1;
+	size_t state = 0;
+	size_t count = 0;
+	size_t len;
+	char *chunk;
+
+	if (ac->longest == 0 || start >= end) {
+		return 0;
+	}
+	// Matches, that overlap [start, end), are found by starting earlier and
+	// ending later.
+	while (offset < limit && (len = gbf_chunk(gbuf, offset, &chunk)) > 0) {
+		size_t n = 0;
+
+		if (len > limit - offset) {
+			len = limit - offset;
+		}
+		char *found = aho_corasick_scan(ac, &state, chunk, len, &n);
+		if (found == NULL) {
+			offset += len;
+			continue;
+		}
+		offset += found - chunk + 1;
+		if (offset <= start || offset - n >= end) {
+			continue;
+		}
+
+		// The ends are increasing, but a long match can cover earlier ones.
+		size_t first = offset - n < start ? start : offset - n;
+		size_t last = offset > end ? end : offset;
+		while (count > 0 && first <= (*ranges)[2 * count - 1]) {
+			if ((*ranges)[2 * count - 2] < first) {
+				first = (*ranges)[2 * count - 2];
+			}
+			count--;
+		}
+		if (2 * count + 2 > *size) {
+			size_t new_size = *size == 0 ? INITIAL_RANGES_SIZE : *size * 2;
+			size_t *new_ranges = realloc(*ranges, new_size * sizeof(**ranges));
+
+			if (new_ranges == NULL) {
+				break;
+			}
+			*ranges = new_ranges;
+			*size = new_size;
+		}
+		(*ranges)[2 * count] = first;
+		(*ranges)[2 * count + 1] = last;
+		count++;
+	}
+	return count;
+}
@@ -0,0 +1,104 @@
+#ifndef DRTE_AHO_CORASICK_H
+#define DRTE_AHO_CORASICK_H
+
+/// \file
+/// aho_corasick.h implements an automaton, that finds several patterns at once.
+///
+/// Usage:
+/// \code
+/// #include <stdbool.h>
+/// #include <stdlib.h>
+///
+/// #include "gapbuffer.h"
+/// #include "aho_corasick.h"
+/// \endcode
+///
+/// The automaton is built once for a set of patterns. Afterwards every byte of
+/// the text is looked at exactly once, no matter how many patterns there are.
+/// The text can be fed in parts: The state of the automaton is kept by the
+/// caller and passed to the next call.
+///
+/// Matches are reported where they end. If several patterns end at the same
+/// position, the longest one is reported.
+
+/// An automaton for a set of patterns.
+typedef struct AhoCorasick AhoCorasick;
+
+/// aho_corasick_new builds an automaton for a set of patterns.
+/// Empty patterns are ignored.
+/// \param patterns The patterns. They may contain any bytes.
+/// \param lengths The lengths of the patterns.
+/// \param n The number of patterns.
+/// \return A new AhoCorasick or NULL, if out of memory.
+///         The AhoCorasick needs to be freed with aho_corasick_free.
+AhoCorasick *aho_corasick_new(char **patterns, size_t *lengths, size_t n);
+
+/// aho_corasick_free frees an AhoCorasick and sets ac to NULL.
+/// \param ac An AhoCorasick.
+void aho_corasick_free(AhoCorasick **ac);
+
+/// aho_corasick_longest returns the length of the longest pattern.
+/// \param ac An AhoCorasick.
+/// \return The length in bytes or 0, if there are no patterns.
+size_t aho_corasick_longest(AhoCorasick *ac);
+
+/// aho_corasick_scan finds the first position in s, where a pattern ends.
+/// \param ac An AhoCorasick.
+/// \param state The state of the automaton. Use 0 to start at the beginning of
+///        a text. It is updated to continue after the returned byte or after s.
+/// \param s The memory to search.
+/// \param len The length of s.
+/// \param length This will be set to the length of the longest pattern, that
+///        ends at the returned byte. The pattern may start before s.
+/// \return A pointer to the last byte of the match or NULL, if there is none.
+char *aho_corasick_scan(AhoCorasick *ac, size_t *state, char *s, size_t len, size_t *length);
+
+/// aho_corasick_count counts the matches in s. Overlapping matches and
+/// different patterns, that end at the same position, are all counted.
+/// \param ac An AhoCorasick.
+/// \param state The state of the automaton. Use 0 to start at the beginning of
+///        a text. It is updated to continue after s.
+/// \param s The memory to search.
+/// \param len The length of s.
+/// \return The number of matches, that end in s.
+size_t aho_corasick_count(AhoCorasick *ac, size_t *state, char *s, size_t len);
+
+/// aho_corasick_search finds the leftmost match in a GapBuffer.
+/// \param ac An AhoCorasick.
+/// \param gbuf The GapBuffer to search.
+/// \param start Where to start the search.
+/// \param offset This will be set to the start of the match, if any.
+/// \param length This will be set to the length of the match. If several
+///        patterns start at offset, this is the longest one.
+/// \return true if a match was found, false otherwise.
+bool aho_corasick_search(AhoCorasick *ac, GapBuffer *gbuf, size_t start,
+                         size_t *offset, size_t *length);
+
+/// aho_corasick_search_reverse finds the rightmost match in a GapBuffer,
+/// that starts and ends at or before start.
+/// \param ac An AhoCorasick.
+/// \param gbuf The GapBuffer to search.
+/// \param start Where to start the search.
+/// \param offset This will be set to the start of the match, if any.
+/// \param length This will be set to the length of the match.
+/// \return true if a match was found, false otherwise.
+bool aho_corasick_search_reverse(AhoCorasick *ac, GapBuffer *gbuf, size_t start,
+                                 size_t *offset, size_t *length);
+
+/// aho_corasick_ranges finds the parts of [start, end), that are covered by
+/// matches. Overlapping and adjacent matches are merged. Matches, that begin
+/// before start or end after end, are cut off.
+/// \param ac An AhoCorasick.
+/// \param gbuf The GapBuffer to search.
+/// \param start The first byte.
+/// \param end The position after the last byte.
+/// \param ranges An array, that is allocated with malloc or NULL. It is
+///        reallocated as needed, like the line in getline. The i-th range
+///        starts at (*ranges)[2 * i] and ends before (*ranges)[2 * i + 1].
+/// \param size The number of elements in *ranges. It is updated on reallocation.
+/// \return The number of ranges. If out of memory, only the first ranges are returned.
+size_t aho_corasick_ranges(AhoCorasick *ac, GapBuffer *gbuf, size_t start, size_t end,
+                           size_t **ranges, size_t *size);
+
+
+#endif
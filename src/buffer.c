@@ -1,12 +1,21 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
 #include <sys/stat.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "utf8.h"
 #include "gapbuffer.h"
+#include "aho_corasick.h"
+#include "loader.h"
+#include "pool.h"
+#include "journal.h"
+#include "undo.h"
 #include "display.h"
 #include "input.h"
 #include "funcs.h"
@@ -14,11 +23,50 @@
 #include "menus.h"
 #include "buffer.h"
 #include "editor.h"
+#include "save.h"
+#include "static.h"
+
+// Files of at least PIECE_TABLE_MIN_SIZE bytes are stored in a piece table.
+#define PIECE_TABLE_MIN_SIZE (32 * 1024 * 1024)
+// Files are read in steps of READ_STEP bytes.
+#define READ_STEP (4 * 1024 * 1024)
+// Files of at least ASYNC_MIN_SIZE bytes are read on a worker thread.
+#define ASYNC_MIN_SIZE (8 * 1024 * 1024)
+// Streams are read in steps of STREAM_STEP bytes.
+#define STREAM_STEP (1024 * 1024)
+// A stream with a limit is trimmed, when it exceeds the limit by
+// STREAM_SLACK_PERCENT percent, so the text is moved only now and then.
+#define STREAM_SLACK_PERCENT 25
+// Files named on the command line are read ahead on the pool of the editor,
+// until PRELOAD_MAX_BYTES were read, with up to PRELOAD_JOBS_PER_THREAD files
+// per thread at a time.
+#define PRELOAD_MAX_BYTES (256 * 1024 * 1024)
+#define PRELOAD_JOBS_PER_THREAD 2
 
+// A file, that is read ahead on a thread of the pool.
+typedef struct Preload {
+	Buffer *buf; // The buffer or NULL, if it was freed or loaded otherwise.
+	char *filename; // A copy of the filename, the buffer may be freed meanwhile.
+	GapBuffer *gbuf; // The text or NULL, if the file cannot be read.
+	size_t size; // The size of the file.
+	long long mtime; // The modification time of the file.
+	long mtime_nsec; // The nanoseconds of mtime.
+} Preload;
 
 static Buffer *make_isearch_buffer(Editor *e);
 static size_t key_to_id(KeyCode c);
 static void buffer_draw_func(Editor *e);
+static bool load_file(Editor *e, Buffer *buf, int fd, size_t size);
+static bool read_text(GapBuffer *gbuf, int fd, size_t size);
+static bool start_preload(Editor *e, Buffer *buf);
+static void preload_file(void *arg);
+static void finish_preload(Editor *e, Preload *p);
+static void discard_preload(void *arg);
+STATIC bool start_load(Buffer *buf, int fd, size_t size, bool reserve);
+static bool start_stream_step(Buffer *buf);
+static void trim_stream(Buffer *buf);
+static void open_history(Buffer *buf);
+static void release_buffer(Buffer *buf);
 
 
 static Buffer *
@@ -74,6 +122,7 @@ make_isearch_buffer(Editor *e) {
 	buffer_bind_key(buf, KEY_BACKSPACE, &uf_backspace);
 	buffer_bind_key(buf, KEY_DELETE, &uf_delete);
 	buffer_bind_key(buf, KEY_RESIZE, &uf_resize);
+	buffer_bind_key(buf, KEY_TIMEOUT, &uf_timeout);
 
 	return buf;
 }
@@ -98,6 +147,16 @@ buffer_call_userfunc(Editor *e, Buffer *buf, KeyCode c) {
 	} else {
 		editor_show_message(e, "Unrecognized input");
 	}
+	if (uf != NULL && buf->loader != NULL &&
+		(uf->type == USER_FUNC_INSERTION || uf->type == USER_FUNC_DELETION)) {
+		editor_show_message(e, "The file is still loading");
+		return NULL;
+	}
+	if (uf != NULL && buf->undo != NULL &&
+		uf->type != USER_FUNC_INSERTION && uf->type != USER_FUNC_DELETION) {
+		// Moving the cursor or saving ends merging typed characters.
+		undo_seal(buf->undo);
+	}
 	if (uf != NULL) {
 		uf->func(e);
 		buf->prev_func = uf;
@@ -107,6 +166,16 @@ buffer_call_userfunc(Editor *e, Buffer *buf, KeyCode c) {
 
 Buffer *
 buffer_new(Editor *e, char *filename) {
+	Buffer *buf = buffer_new_lazy(e, filename);
+
+	if (buf != NULL && !buffer_load(e, buf)) {
+		buffer_free(&buf);
+	}
+	return buf;
+}
+
+Buffer *
+buffer_new_lazy(Editor *e, char *filename) {
 	Buffer *buf = malloc(sizeof(*buf));
 	if (buf == NULL) {
 		editor_show_message(e, "Out of memory");
@@ -115,12 +184,7 @@ buffer_new(Editor *e, char *filename) {
 
 	memset(buf, 0, sizeof(*buf));
 	buf->filename = filename;
-
-	buf->gbuf = gbf_new();
-	if (buf->gbuf == NULL) {
-		editor_show_message(e, "Out of memory");
-		return NULL;
-	}
+	buf->file_mtime = -1;
 
 	buf->redraw = 1;
 	buf->draw = buffer_draw_func;
@@ -133,12 +197,11 @@ buffer_new(Editor *e, char *filename) {
 		buf->win = &e->window;
 		buf->statusbar_win = &e->statusbar_win;
 		buf->messagebar_win = &e->messagebar_win;
-	}
-
-	buf->isearch_buffer = make_isearch_buffer(e);
-	if (buf->isearch_buffer == NULL) {
-		editor_show_message(e, "Out of memory");
-		return NULL;
+		if (e->undo_limit > 0) {
+			// Without memory for it, the buffer has no undo.
+			buf->undo = undo_new(e->undo_limit);
+			buf->keep_history = e->keep_history && buf->undo != NULL && filename != NULL;
+		}
 	}
 
 	buf->next = buf;
@@ -149,7 +212,7 @@ buffer_new(Editor *e, char *filename) {
 	buffer_bind_key(buf, KEY_CTRL_SPACE, &uf_region_start_stop);
 	buffer_bind_key(buf, KEY_CTRL_A, &uf_bol);
 	buffer_bind_key(buf, KEY_CTRL_B, &uf_left);
-	buffer_bind_key(buf, KEY_CTRL_C, &uf_region_off);
+	buffer_bind_key(buf, KEY_CTRL_C, &uf_stop);
 	buffer_bind_key(buf, KEY_CTRL_D, &uf_delete);
 	buffer_bind_key(buf, KEY_CTRL_E, &uf_eol);
 	buffer_bind_key(buf, KEY_CTRL_F, &uf_right);
@@ -168,8 +231,11 @@ buffer_new(Editor *e, char *filename) {
 	buffer_bind_key(buf, KEY_CTRL_W, &uf_cut);
 	buffer_bind_key(buf, KEY_CTRL_Y, &uf_paste);
 	buffer_bind_key(buf, KEY_CTRL_Z, &uf_suspend);
+	buffer_bind_key(buf, KEY_CTRL_UNDERSCORE, &uf_undo);
 
 	buffer_bind_key(buf, KEY_ALT_V, &uf_page_up);
+	buffer_bind_key(buf, KEY_ALT_R, &uf_redo);
+	buffer_bind_key(buf, KEY_ALT_U, &uf_undo);
 	buffer_bind_key(buf, KEY_ALT_W, &uf_copy);
 
 	buffer_bind_key(buf, KEY_RIGHT, &uf_right);
@@ -189,57 +255,665 @@ buffer_new(Editor *e, char *filename) {
 	buffer_bind_key(buf, KEY_BACKSPACE, &uf_backspace);
 	buffer_bind_key(buf, KEY_DELETE, &uf_delete);
 	buffer_bind_key(buf, KEY_RESIZE, &uf_resize);
+	buffer_bind_key(buf, KEY_TIMEOUT, &uf_timeout);
+
+	return buf;
+}
 
+bool
+buffer_load(Editor *e, Buffer *buf) {
+	char *filename = buf->filename;
+
+	if (buf->gbuf != NULL) {
+		return true;
+	}
+	if (buf->preload != NULL) {
+		// The file is needed now, the result of the pool is discarded.
+		buf->preload->buf = NULL;
+		buf->preload = NULL;
+	}
+	buf->gbuf = gbf_new();
+	if (buf->gbuf == NULL) {
+		editor_show_message(e, "Out of memory");
+		return false;
+	}
+	buf->isearch_buffer = make_isearch_buffer(e);
+	if (buf->isearch_buffer == NULL) {
+		editor_show_message(e, "Out of memory");
+		return false;
+	}
 
 	if (filename != NULL) {
 		struct stat st;
 
 		if (stat(filename, &st) != 0) {
 			if (errno == ENOENT) {
-				return buf;
+				buffer_start_journal(e, buf, true);
+				return true;
 			} else {
 				char out[1024];
 				snprintf(out, 1023, "Cannot stat %s", filename);
 				editor_show_message(e, out);
-				return NULL;
+				return false;
+			}
+		}
+		buf->file_size = st.st_size;
+		buf->file_mtime = st.st_mtime;
+		buf->file_mtime_nsec = st.st_mtim.tv_nsec;
+		if (st.st_size != 0) {
+			int fd = open(filename, O_RDONLY);
+			if (fd == -1) {
+				char out[1024];
+				snprintf(out, 1023, "Cannot open %s", filename);
+				editor_show_message(e, out);
+				return false;
+			}
+			if (st.st_size >= PIECE_TABLE_MIN_SIZE) {
+				// Edits in a large gap buffer can move most of the text.
+				gbf_free(&buf->gbuf);
+				buf->gbuf = gbf_new_piece_table();
+				if (buf->gbuf == NULL) {
+					close(fd);
+					editor_show_message(e, "Out of memory");
+					return false;
+				}
+
+				// The file is mapped instead of read, its pages are loaded when they are drawn.
+				if (gbf_map_file(buf->gbuf, fd, st.st_size)) {
+					close(fd);
+					open_history(buf);
+					buffer_start_journal(e, buf, true);
+					return true;
+				}
+			}
+
+			if (st.st_size >= ASYNC_MIN_SIZE && start_load(buf, fd, st.st_size, true)) {
+				// The loader closes fd.
+				return true;
+			}
+
+			bool loaded = load_file(e, buf, fd, st.st_size);
+			close(fd);
+			if (!loaded) {
+				return false;
+			}
+			gbf_mark_saved(buf->gbuf);
+		}
+		open_history(buf);
+		buffer_start_journal(e, buf, true);
+	}
+
+	return true;
+}
+
+// Reads a file of size bytes into the buffer. The storage is reserved first and
+// the text is read into it directly, so the file is not copied.
+static bool
+load_file(Editor *e, Buffer *buf, int fd, size_t size) {
+	if (!gbf_reserve(buf->gbuf, size)) {
+		editor_show_message(e, "Out of memory");
+		return false;
+	}
+	if (!read_text(buf->gbuf, fd, size)) {
+		char out[1024];
+		snprintf(out, 1023, "Cannot read %s", buf->filename);
+		editor_show_message(e, out);
+		return false;
+	}
+	return true;
+}
+
+// Reads up to size bytes into reserved storage at the start of gbuf.
+static bool
+read_text(GapBuffer *gbuf, int fd, size_t size) {
+	size_t offset = 0;
+	size_t bytes;
+
+	while (offset < size) {
+		size_t len = size - offset < READ_STEP ? size - offset : READ_STEP;
+
+		if (!gbf_read(gbuf, fd, len, offset, &bytes)) {
+			return false;
+		}
+		if (bytes == 0) {
+			// The file got shorter, since it was stat'ed.
+			break;
+		}
+		offset += bytes;
+	}
+	return true;
+}
+
+// Starts reading size bytes on a worker thread. The storage is reserved at
+// the end of the text and the bytes become part of it in buffer_update_load.
+// If reserve is true, exactly size bytes are reserved, which fits a file of
+// known size. Otherwise the gap grows with the text, so the steps of a stream
+// do not move the text each time.
+STATIC bool
+start_load(Buffer *buf, int fd, size_t size, bool reserve) {
+	char *text;
+
+	if (reserve && !gbf_reserve(buf->gbuf, size)) {
+		return false;
+	}
+	text = gbf_write_begin(buf->gbuf, gbf_text_length(buf->gbuf), size);
+	if (text == NULL) {
+		return false;
+	}
+	buf->loader = loader_new(fd, text, size);
+	if (buf->loader == NULL) {
+		return false;
+	}
+	buf->loaded = 0;
+	buf->load_size = size;
+	return true;
+}
+
+void
+buffer_update_load(Editor *e, Buffer *buf) {
+	LoaderState state;
+	size_t bytes;
+
+	if (buf->loader == NULL) {
+		return;
+	}
+	state = loader_poll(buf->loader, &bytes);
+	if (bytes > buf->loaded) {
+		size_t end = gbf_text_length(buf->gbuf);
+		bool at_end = buf->position.offset == end;
+
+		if (!gbf_write_commit(buf->gbuf, end, bytes - buf->loaded)) {
+			// Without memory for the bytes, the load fails like on a read
+			// error.
+			state = LOADER_FAILED;
+		} else {
+			buf->loaded = bytes;
+			buf->redraw = true;
+			if (buf->stream && at_end && buf->win != NULL) {
+				// Like in follow mode, the cursor stays at the end.
+				move_to_offset(buf, gbf_text_length(buf->gbuf));
 			}
-		} else if (st.st_size != 0) {
-			char *text = malloc(st.st_size + 1);
-			if (text == NULL) {
+		}
+	}
+	if (state != LOADER_RUNNING) {
+		loader_free(&buf->loader);
+		buf->redraw = true;
+		if (buf->stream) {
+			trim_stream(buf);
+			if (state == LOADER_DONE && bytes == buf->load_size) {
+				// The step was filled, the stream goes on.
+				if (start_stream_step(buf)) {
+					return;
+				}
 				editor_show_message(e, "Out of memory");
-				return NULL;
+			} else if (state == LOADER_FAILED) {
+				editor_show_message(e, "Cannot read the input");
 			}
+			buffer_stop_stream(buf);
+		} else if (state == LOADER_DONE) {
+			gbf_mark_saved(buf->gbuf);
+			open_history(buf);
+			buffer_start_journal(e, buf, true);
+		} else {
+			char out[1024];
 
-			FILE *file = fopen(filename, "r");
-			long read = fread(text, st.st_size, 1, file);
-			if (read != 1) {
-				char out[1024];
-				snprintf(out, 1023, "Cannot read %s", filename);
-				editor_show_message(e, out);
-				return NULL;
+			// Saving the partial text would cut the file off. So it is dropped
+			// without a history, and the buffer is closed.
+			gbf_clear(buf->gbuf);
+			if (buf->undo != NULL) {
+				undo_clear(buf->undo);
+			}
+			buf->keep_history = false;
+			buf->has_changed = false;
+			buf->load_failed = true;
+			snprintf(out, 1023, "Cannot read %s", buf->filename);
+			editor_show_message(e, out);
+		}
+	}
+}
+
+void
+buffer_update_preload(Editor *e) {
+	Preload *p;
+	Buffer *b;
+
+	if (e->pool == NULL) {
+		return;
+	}
+	while ((p = pool_take(e->pool)) != NULL) {
+		finish_preload(e, p);
+	}
+
+	// The current buffer is loaded by buffer_load right away.
+	for (b = e->current_buffer->next; b != e->current_buffer; b = b->next) {
+		if (e->preloaded >= PRELOAD_MAX_BYTES ||
+			pool_pending(e->pool) >= pool_threads(e->pool) * PRELOAD_JOBS_PER_THREAD) {
+			break;
+		}
+		if (b->gbuf == NULL && b->preload == NULL && !b->preload_failed && b->filename != NULL) {
+			if (!start_preload(e, b)) {
+				break;
 			}
-			text[st.st_size] = '\0';
-			gbf_insert(buf->gbuf, text, 0);
-			free(text);
 		}
 	}
+}
+
+static bool
+start_preload(Editor *e, Buffer *buf) {
+	Preload *p = malloc(sizeof(*p));
+
+	if (p == NULL) {
+		return false;
+	}
+	memset(p, 0, sizeof(*p));
+	p->buf = buf;
+	p->filename = strdup(buf->filename);
+	if (p->filename == NULL || !pool_add(e->pool, preload_file, p)) {
+		free(p->filename);
+		free(p);
+		return false;
+	}
+	buf->preload = p;
+	return true;
+}
+
+// Reads a file like buffer_load and counts its lines. This runs on a thread of
+// the pool and uses only the Preload.
+static void
+preload_file(void *arg) {
+	Preload *p = arg;
+	struct stat st;
+	int fd = open(p->filename, O_RDONLY);
+
+	if (fd == -1) {
+		return;
+	}
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return;
+	}
+	p->size = st.st_size;
+	p->mtime = st.st_mtime;
+	p->mtime_nsec = st.st_mtim.tv_nsec;
+	if (st.st_size >= PIECE_TABLE_MIN_SIZE) {
+		p->gbuf = gbf_new_piece_table();
+		if (p->gbuf != NULL && !gbf_map_file(p->gbuf, fd, st.st_size) &&
+			(!gbf_reserve(p->gbuf, st.st_size) || !read_text(p->gbuf, fd, st.st_size))) {
+			gbf_free(&p->gbuf);
+		}
+	} else {
+		p->gbuf = gbf_new();
+		if (p->gbuf != NULL &&
+			(!gbf_reserve(p->gbuf, st.st_size) || !read_text(p->gbuf, fd, st.st_size))) {
+			gbf_free(&p->gbuf);
+		}
+	}
+	close(fd);
 
+	if (p->gbuf != NULL) {
+		// The whole line index is built here, not when the buffer is shown.
+		gbf_line_at(p->gbuf, gbf_text_length(p->gbuf));
+	}
+}
+
+// Gives the text read by the pool to its buffer, if the buffer still needs it.
+// A file, that could not be read, is read again by buffer_load, which reports
+// the error, when the buffer is shown.
+static void
+finish_preload(Editor *e, Preload *p) {
+	Buffer *buf = p->buf;
+
+	if (buf == NULL) {
+		discard_preload(p);
+		return;
+	}
+	buf->preload = NULL;
+	if (p->gbuf == NULL) {
+		buf->preload_failed = true;
+		discard_preload(p);
+		return;
+	}
+	buf->isearch_buffer = make_isearch_buffer(e);
+	if (buf->isearch_buffer == NULL) {
+		buf->preload_failed = true;
+		discard_preload(p);
+		return;
+	}
+	e->preloaded += p->size;
+	buf->gbuf = p->gbuf;
+	buf->file_size = p->size;
+	buf->file_mtime = p->mtime;
+	buf->file_mtime_nsec = p->mtime_nsec;
+	gbf_mark_saved(buf->gbuf);
+	open_history(buf);
+	buffer_start_journal(e, buf, true);
+	p->gbuf = NULL;
+	discard_preload(p);
+}
+
+static void
+discard_preload(void *arg) {
+	Preload *p = arg;
+
+	if (p->buf != NULL) {
+		p->buf->preload = NULL;
+	}
+	gbf_free(&p->gbuf);
+	free(p->filename);
+	free(p);
+}
+
+void
+buffer_stop_preloads(Editor *e) {
+	if (e->pool != NULL) {
+		pool_free(&e->pool, discard_preload);
+	}
+}
+
+Buffer *
+buffer_new_stream(Editor *e, int fd, size_t limit) {
+	Buffer *buf = buffer_new(e, NULL);
+
+	if (buf == NULL) {
+		close(fd);
+		return NULL;
+	}
+	buf->stream = true;
+	buf->stream_fd = fd;
+	buf->stream_limit = limit;
+	if (!start_stream_step(buf)) {
+		editor_show_message(e, "Cannot read the input");
+		buffer_free(&buf);
+		return NULL;
+	}
 	return buf;
 }
 
+// Starts reading the next STREAM_STEP bytes of the stream. Each step has its
+// own descriptor, since the loader closes it.
+static bool
+start_stream_step(Buffer *buf) {
+	int fd = dup(buf->stream_fd);
+
+	if (fd == -1) {
+		return false;
+	}
+	if (!start_load(buf, fd, STREAM_STEP, false)) {
+		close(fd);
+		return false;
+	}
+	return true;
+}
+
+// Drops the oldest lines of a stream, that exceeds its limit. The cursor keeps
+// its place in the remaining text.
+static void
+trim_stream(Buffer *buf) {
+	size_t length = gbf_text_length(buf->gbuf);
+	size_t limit = buf->stream_limit;
+	size_t excess;
+	size_t found;
+
+	if (limit == 0 || length <= limit + limit / 100 * STREAM_SLACK_PERCENT) {
+		return;
+	}
+	excess = length - limit;
+	if (gbf_next_newline(buf->gbuf, excess, &found)) {
+		excess = found + 1;
+	}
+	gbf_delete(buf->gbuf, 0, excess);
+	if (buf->undo != NULL) {
+		undo_clear(buf->undo);
+	}
+
+	buf->first_visible_char = buf->first_visible_char > excess ? buf->first_visible_char - excess : 0;
+	buf->position.offset = buf->position.offset > excess ? buf->position.offset - excess : 0;
+	buf->region_type = REGION_OFF;
+	if (buf->win != NULL) {
+		move_to_offset(buf, buf->position.offset);
+	}
+	buf->redraw = true;
+}
+
 void
-buffer_free(Buffer **buf) {
-	if ((*buf)->next == *buf) {
-		// Only one element.
-		gbf_free(&(*buf)->gbuf);
-		if ((*buf)->filename != NULL) {
-			free((*buf)->filename);
+buffer_stop_stream(Buffer *buf) {
+	size_t bytes;
+
+	if (!buf->stream) {
+		return;
+	}
+	if (buf->loader != NULL) {
+		// The bytes, that were read so far, are kept.
+		loader_poll(buf->loader, &bytes);
+		if (bytes > buf->loaded) {
+			gbf_write_commit(buf->gbuf, gbf_text_length(buf->gbuf), bytes - buf->loaded);
 		}
-		if ((*buf)->isearch_buffer != NULL) {
-			buffer_free(&(*buf)->isearch_buffer);
+		loader_free(&buf->loader);
+	}
+	close(buf->stream_fd);
+	buf->stream = false;
+	// The input is not an edit.
+	gbf_mark_saved(buf->gbuf);
+	buf->redraw = true;
+}
+
+void
+buffer_update_save(Editor *e, Buffer *buf) {
+	if (buf->save == NULL || !save_is_done(buf->save)) {
+		return;
+	}
+	if (save_finish(&buf->save, buf)) {
+		editor_show_message(e, "Wrote file.");
+		if (buf->journal == NULL) {
+			// The buffer has a new file (see save_as).
+			buffer_start_journal(e, buf, false);
 		}
+		if (buf->follow) {
+			// The file may have been replaced by a new one.
+			buffer_stop_follow(buf);
+			buffer_start_follow(buf);
+		}
+	} else {
+		editor_show_message(e, "Cannot save.");
+	}
+	buf->redraw = true;
+}
+
+void
+buffer_start_journal(Editor *e, Buffer *buf, bool recover) {
+	size_t replayed = 0;
+	char out[1024];
 
-		free(*buf);
+	if (e == NULL || e->journal_interval == 0 || buf->filename == NULL) {
+		return;
+	}
+	buf->journal = journal_open(buf->filename, buf->file_size, buf->file_mtime, buf->gbuf,
+	                            recover ? &replayed : NULL);
+	if (buf->journal == NULL) {
+		snprintf(out, 1023, "Cannot write the journal of %s", buf->filename);
+		editor_show_message(e, out);
+		return;
+	}
+	gbf_set_journal(buf->gbuf, buf->journal);
+	if (replayed > 0 && buf->undo != NULL) {
+		// The undo history belongs to the file, not to the recovered text.
+		undo_clear(buf->undo);
+	}
+	if (replayed > 0) {
+		// The text changed under the cursor, so it goes back to the start.
+		buf->has_changed = true;
+		buf->position.offset = 0;
+		buf->position.line = 1;
+		buf->position.column = 1;
+		buf->cursor.line = 0;
+		buf->cursor.column = 0;
+		buf->first_visible_char = 0;
+		buf->region_type = REGION_OFF;
+		buf->redraw = true;
+		snprintf(out, 1023, "Recovered %zu edits of %s", replayed, buf->filename);
+		editor_show_message(e, out);
+	}
+}
+
+// Maps the undo history, that was kept for the file of the buffer.
+static void
+open_history(Buffer *buf) {
+	if (buf->keep_history) {
+		undo_open_history(buf->undo, buf->filename, buf->file_size, buf->file_mtime);
+	}
+}
+
+void
+buffer_flush_journal(Editor *e, Buffer *buf) {
+	if (buf->journal == NULL || journal_flush(buf->journal)) {
+		return;
+	}
+	gbf_set_journal(buf->gbuf, NULL);
+	journal_free(&buf->journal, true);
+
+	char out[1024];
+	snprintf(out, 1023, "Cannot write the journal of %s", buf->filename);
+	editor_show_message(e, out);
+}
+
+bool
+buffer_start_follow(Buffer *buf) {
+	struct stat st;
+	int fd = open(buf->filename, O_RDONLY);
+
+	if (fd == -1) {
+		return false;
+	}
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < buf->file_size) {
+		close(fd);
+		return false;
+	}
+	buf->follow = true;
+	buf->follow_fd = fd;
+	return true;
+}
+
+void
+buffer_stop_follow(Buffer *buf) {
+	if (buf->follow) {
+		close(buf->follow_fd);
+		buf->follow = false;
+	}
+}
+
+void
+buffer_update_follow(Editor *e, Buffer *buf) {
+	struct stat st;
+	size_t end = gbf_text_length(buf->gbuf);
+	size_t first = 0;
+	bool changed;
+	bool at_end;
+	size_t size;
+	size_t bytes = 0;
+	char *text;
+
+	// A save changes the file, the bytes after file_size are not appended ones.
+	if (!buf->follow || buf->loader != NULL || buf->save != NULL ||
+		fstat(buf->follow_fd, &st) != 0 || (size_t)st.st_size == buf->file_size) {
+		return;
+	}
+	if ((size_t)st.st_size < buf->file_size) {
+		char out[1024];
+		buffer_stop_follow(buf);
+		snprintf(out, 1023, "%s got shorter, stopped following it", buf->filename);
+		editor_show_message(e, out);
+		return;
+	}
+	size = st.st_size - buf->file_size;
+	text = gbf_write_begin(buf->gbuf, end, size);
+	if (text == NULL) {
+		buffer_stop_follow(buf);
+		editor_show_message(e, "Out of memory");
+		return;
+	}
+	while (bytes < size) {
+		ssize_t n = pread(buf->follow_fd, text + bytes, size - bytes, buf->file_size + bytes);
+
+		if (n == -1 && errno == EINTR) {
+			continue;
+		} else if (n <= 0) {
+			break;
+		}
+		bytes += n;
+	}
+
+	// The new bytes are part of the file, not edits: An unchanged text stays
+	// unchanged and they are not recorded in the journal. The journal applies
+	// to the grown file then.
+	changed = gbf_first_change(buf->gbuf, &first);
+	at_end = buf->position.offset == end;
+	gbf_set_journal(buf->gbuf, NULL);
+	if (!gbf_write_commit(buf->gbuf, end, bytes)) {
+		gbf_set_journal(buf->gbuf, buf->journal);
+		buffer_stop_follow(buf);
+		editor_show_message(e, "Out of memory");
+		return;
+	}
+	gbf_set_journal(buf->gbuf, buf->journal);
+	buf->file_size += bytes;
+	buf->file_mtime = st.st_mtime;
+	buf->file_mtime_nsec = st.st_mtim.tv_nsec;
+	if (!changed) {
+		gbf_mark_saved(buf->gbuf);
+		if (buf->journal != NULL) {
+			journal_mark(buf->journal);
+			journal_rebase(buf->journal, buf->file_size, buf->file_mtime);
+		}
+	} else if (buf->journal != NULL) {
+		// The edits are before the appended bytes, so they are replayed on
+		// the grown file.
+		journal_grow(buf->journal, buf->file_size, buf->file_mtime);
+	}
+	if (at_end && buf->win != NULL) {
+		move_to_offset(buf, end + bytes);
+	}
+	buf->redraw = true;
+}
+
+// Stops the work of buf in the background, writes its history and frees it.
+// buf must be unlinked from the other buffers.
+static void
+release_buffer(Buffer *buf) {
+	if (buf->preload != NULL) {
+		buf->preload->buf = NULL;
+	}
+	if (buf->loader != NULL) {
+		loader_free(&buf->loader);
+	}
+	buffer_stop_stream(buf);
+	if (buf->save != NULL) {
+		save_finish(&buf->save, buf);
+	}
+	if (buf->journal != NULL) {
+		journal_free(&buf->journal, true);
+	}
+	if (buf->keep_history) {
+		undo_write_history(buf->undo, buf->filename, buf->file_size, buf->file_mtime);
+	}
+	if (buf->undo != NULL) {
+		undo_free(&buf->undo);
+	}
+	buffer_stop_follow(buf);
+	gbf_free(&buf->gbuf);
+	if (buf->filename != NULL) {
+		free(buf->filename);
+	}
+	if (buf->isearch_buffer != NULL) {
+		buffer_free(&buf->isearch_buffer);
+	}
+	free(buf);
+}
+
+void
+buffer_free(Buffer **buf) {
+	if ((*buf)->next == *buf) {
+		// Only one element.
+		release_buffer(*buf);
 		*buf = NULL;
 	} else {
 		// More than one element.
@@ -248,15 +922,7 @@ buffer_free(Buffer **buf) {
 
 		b->next = b->next->next;
 		b->next->prev = b;
-
-		gbf_free(&current->gbuf);
-		if (current->filename != NULL) {
-			free(current->filename);
-		}
-		if (current->isearch_buffer != NULL) {
-			buffer_free(&current->isearch_buffer);
-		}
-		free(current);
+		release_buffer(current);
 
 		*buf = b;
 	}
@@ -288,12 +954,19 @@ buffer_draw_func(Editor *e) {
 	size_t pcol = 0;
 	int last_whitespace = 0;
 	static size_t first_column = 0;
+	char *chunk = NULL;
+	size_t chunk_start = current;
+	size_t chunk_length = 0;
+	size_t *ranges = NULL;
+	size_t nranges = 0;
+	size_t range = 0;
 
 	e->current_buffer->draw_statusbar(e);
 	if (e->shows_message) {
 		e->shows_message = false;
 	} else if (ib->isearch_is_active) {
 		char *text = gbf_text(ib->gbuf);
+		char hits[32];
 
 		display_clear_line(*b->messagebar_win, 0);
 		if (!ib->isearch_has_match) {
@@ -305,6 +978,12 @@ buffer_draw_func(Editor *e) {
 		if (ib->isearch_direction == ISEARCH_DIRECTION_BACKWARD) {
 			pcol = display_show_string(e->messagebar_win, 0, pcol, "Reverse ");
 		}
+		if (ib->isearch_patterns != NULL) {
+			// The count is incomplete, while isearch is still counting.
+			snprintf(hits, sizeof(hits), "[%zu%s] ", ib->isearch_hits,
+			         ib->isearch_counted < end ? "+" : "");
+			pcol = display_show_string(e->messagebar_win, 0, pcol, hits);
+		}
 		pcol = display_show_string(e->messagebar_win, 0, pcol, "ISearch: ");
 		pcol = display_show_string(e->messagebar_win, 0, pcol, text);
 		free(text);
@@ -320,16 +999,41 @@ buffer_draw_func(Editor *e) {
 		b->redraw = true;
 	}
 	if (e->current_buffer->redraw) {
-
+		// The terminal moves the lines, that stay visible.
+		display_scroll_window(*b->win, b->scrolled);
 		display_clear_window(*b->win);
 
+		if (ib->isearch_is_active && ib->isearch_patterns != NULL) {
+			// Only the visible lines are searched for matches.
+			size_t visible_end = end;
+			size_t newline;
+
+			if (gbf_nth_newline(b->gbuf, current, lines, &newline)) {
+				visible_end = newline + 1;
+			}
+			nranges = aho_corasick_ranges(ib->isearch_patterns, b->gbuf, current, visible_end,
+			                              &ib->isearch_ranges, &ib->isearch_ranges_size);
+			ranges = ib->isearch_ranges;
+		}
+
 		while ((current < end) && (line < lines)) {
-			char current_char = gbf_at(b->gbuf, current);
+			if (current - chunk_start >= chunk_length) {
+				chunk_start = current;
+				chunk_length = gbf_chunk(b->gbuf, current, &chunk);
+			}
+			char current_char = chunk[current - chunk_start];
 			char cp[5] = {0};
 
 			if (b->region_type != REGION_OFF && current >= b->region_start && current < b->region_end) {
 				display_set_color(INVERSE);
 			}
+			while (range < nranges && ranges[2 * range + 1] <= current) {
+				range++;
+			}
+			if (range < nranges && current >= ranges[2 * range]) {
+				display_set_color(FOREGROUND_BLACK);
+				display_set_color(BACKGROUND_YELLOW);
+			}
 			if (ib->isearch_has_match && current >= ib->isearch_match_start &&
 				current < ib->isearch_match_end) {
 				display_set_color(FOREGROUND_BLACK);
@@ -349,16 +1053,20 @@ buffer_draw_func(Editor *e) {
 						display_show_cp(*b->win, line, column + i, " ");
 					}
 				} else {
-					for (size_t i = 0; i < utf8_byte_size(current_char); i++) {
-						cp[i] = gbf_at(b->gbuf, current + i);
+					size_t size = utf8_byte_size(current_char);
+					if (current - chunk_start + size <= chunk_length) {
+						memcpy(cp, chunk + (current - chunk_start), size);
+					} else {
+						// The code point spans two chunks.
+						gbf_text_n(b->gbuf, current, size, cp);
 					}
 					display_show_cp(*b->win, line, column - first_column, cp);
 				}
 			}
 			if (current_char == '\n' || current == end - 1) {
 				if (last_whitespace != -1) {
-					if ((current == end - 1) && (gbf_at(b->gbuf, end - 1) != '\n')) {
-						column += utf8_draw_width(gbf_at(b->gbuf, end - 1));
+					if ((current == end - 1) && (current_char != '\n')) {
+						column += utf8_draw_width(current_char);
 					}
 					display_move_cursor(*b->win, line, last_whitespace);
 					display_set_color(BACKGROUND_RED);
@@ -380,10 +1088,14 @@ buffer_draw_func(Editor *e) {
 			if (ib->isearch_has_match && current ==  ib->isearch_match_end) {
 				display_set_color(OFF);
 			}
+			if (range < nranges && current == ranges[2 * range + 1]) {
+				display_set_color(OFF);
+			}
 
 		}
 		b->redraw = 0;
 	}
+	b->scrolled = 0;
 	if (ib->isearch_is_active) {
 		display_move_cursor(*b->messagebar_win,
 							ib->cursor.line,
@@ -32,6 +32,9 @@ typedef enum {
 typedef struct Buffer {
 	char *filename; ///< The filename or NULL, if unnamed
 	bool has_changed; ///< True, if the text has changed.
+	size_t file_size; ///< The size of the file, when it was last read or written.
+	long long file_mtime; ///< The modification time of the file then or -1, if unknown.
+	long file_mtime_nsec; ///< The nanoseconds of file_mtime.
 	bool redraw; ///< True, if the display has changed.
 
 	bool ok; ///< This is used by menus.
@@ -66,6 +69,12 @@ typedef struct Buffer {
 	size_t isearch_match_start; ///< The beginning of the match.
 	size_t isearch_match_end; ///< The end of the match.
 	struct Buffer *isearch_buffer; ///< The Buffer userd by isearch.
+	struct AhoCorasick *isearch_patterns; ///< The patterns, separated by '|' in the text.
+	size_t *isearch_ranges; ///< The visible matches, as start and end offsets.
+	size_t isearch_ranges_size; ///< The number of elements in isearch_ranges.
+	size_t isearch_hits; ///< The number of matches, that were counted so far.
+	size_t isearch_counted; ///< The matches before this offset are counted.
+	size_t isearch_count_state; ///< The state of the automaton at isearch_counted.
 
 	UserFunc *funcs[KEY_N_SPECIAL_KEYS]; ///< The keybindings.
 	GapBuffer *gbuf; ///< The GapBuffer.
@@ -73,12 +82,29 @@ typedef struct Buffer {
 	DisplayFunc draw; ///< This function draws the buffer.
 	DisplayFunc draw_statusbar; ///< This function draws the statusbar.
 	size_t first_visible_char; ///< The start of the first visible line.
+	long scrolled; ///< The lines, that the window scrolled down since it was drawn.
 
 	MenuItemList *menu_items;  ///< Used by various menus to store the menu items.
 	bool show_hidden_files; ///< True, if the file chooser shows hidden files.
 
 	bool timeout; ///< True, if something timed out.
 
+	struct Loader *loader; ///< Reads the file in the background, while it is loading.
+	size_t loaded; ///< The number of bytes, that were loaded so far.
+	size_t load_size; ///< The size of the file, that is loading.
+	struct Save *save; ///< Writes the file in the background, while it is saving.
+	bool stream; ///< True, while the text is read from a stream (see buffer_new_stream).
+	int stream_fd; ///< The stream.
+	size_t stream_limit; ///< The most bytes of the stream, that are kept, or 0 for all.
+	struct Journal *journal; ///< Records the edits for crash recovery or NULL.
+	struct Undo *undo; ///< Records the edits for undo and redo or NULL.
+	bool keep_history; ///< True, if the undo history is kept in a file (see undo.h).
+	bool follow; ///< True, if text appended to the file is added to the buffer.
+	int follow_fd; ///< The file, that is followed.
+	struct Preload *preload; ///< The file, while it is read ahead on the pool of the editor.
+	bool preload_failed; ///< True, if the file could not be read ahead.
+	bool load_failed; ///< True, if the file could not be read in the background.
+
 	struct Buffer *next; ///< The next buffer.
 	struct Buffer *prev; ///< The previous buffer.
 } Buffer;
@@ -89,6 +115,51 @@ typedef struct Buffer {
 /// \return A new Buffer or NULL on error.
 Buffer *buffer_new(struct Editor *e, char *filename);
 
+/// buffer_new_lazy creates a new buffer, that only holds the filename. It has
+/// no text (gbuf is NULL), until buffer_load reads the file. This is used for
+/// files, that may never be shown.
+/// \param e The editor structure.
+/// \param filename The file.
+/// \return A new Buffer or NULL, if out of memory.
+Buffer *buffer_new_lazy(struct Editor *e, char *filename);
+
+/// buffer_load reads the file of a buffer created by buffer_new_lazy. Nothing
+/// is done, if the buffer has its text already.
+/// \param e The editor structure.
+/// \param buf The buffer.
+/// \return true on success, false if the file cannot be read or if out of
+///         memory. Then the buffer should be freed.
+bool buffer_load(struct Editor *e, Buffer *buf);
+
+/// buffer_update_preload reads the files of buffers created by buffer_new_lazy
+/// ahead on the pool of the editor, several at once. Their text is read and
+/// its lines are counted on the threads. Each call hands the files, that were
+/// read since the last call, to their buffers and queues more, until the
+/// editor has read a few hundred megabytes ahead. Nothing is done, if the
+/// editor has no pool.
+/// \param e The editor structure.
+void buffer_update_preload(struct Editor *e);
+
+/// buffer_stop_preloads waits for the files, that are being read ahead, frees
+/// the pool of the editor and the text, that was not handed to a buffer.
+/// \param e The editor structure.
+void buffer_stop_preloads(struct Editor *e);
+
+/// buffer_new_stream creates a new unnamed buffer, that reads a stream, for
+/// example a pipe, in the background. The text is shown, while it grows, and
+/// is read-only, until the stream ends or buffer_stop_stream is called.
+/// \param e The editor structure.
+/// \param fd The stream. The buffer closes it.
+/// \param limit If not 0, only about the last limit bytes are kept: When the
+///        text exceeds the limit by a quarter, the oldest lines are dropped.
+/// \return A new Buffer or NULL on error.
+Buffer *buffer_new_stream(struct Editor *e, int fd, size_t limit);
+
+/// buffer_stop_stream stops reading the stream of the buffer and keeps the
+/// text, that was read.
+/// \param buf The buffer.
+void buffer_stop_stream(Buffer *buf);
+
 /// buffer_bind_key binds c to the function f, in buf.
 /// \param buf The buffer.
 /// \param c The key.
@@ -102,7 +173,56 @@ void buffer_bind_key(Buffer *buf, KeyCode c, UserFunc *f);
 /// \return The called function. This can be NULL.
 UserFunc *buffer_call_userfunc(struct Editor *e, Buffer *buf, KeyCode c);
 
+/// buffer_update_load adds the bytes, that were loaded in the background since
+/// the last call, to the text. When the file is loaded, the loader is freed.
+/// If the file cannot be read, the text is dropped and load_failed is set. The
+/// buffer has to be closed then.
+/// \param e The editor structure.
+/// \param buf The buffer.
+void buffer_update_load(struct Editor *e, Buffer *buf);
+
+/// buffer_update_save checks, if a save in the background has finished, and
+/// shows the result.
+/// \param e The editor structure.
+/// \param buf The buffer.
+void buffer_update_save(struct Editor *e, Buffer *buf);
+
+/// buffer_start_journal starts recording the edits of the buffer in a journal
+/// (see journal.h), if the editor keeps journals and the buffer has a file.
+/// \param e The editor structure.
+/// \param buf The buffer.
+/// \param recover If true, the edits in an existing journal are applied.
+void buffer_start_journal(struct Editor *e, Buffer *buf, bool recover);
+
+/// buffer_flush_journal writes the pending edits to the journal. If that
+/// fails, a message is shown and the journal is dropped.
+/// \param e The editor structure.
+/// \param buf The buffer.
+void buffer_flush_journal(struct Editor *e, Buffer *buf);
+
+/// buffer_start_follow starts following the file of the buffer: Text, that
+/// is appended to the file, is added to the end of the buffer by
+/// buffer_update_follow.
+/// \param buf A buffer with a file, that is not loading.
+/// \return true on success, false if the file cannot be opened or if it is
+///         shorter than when it was read.
+bool buffer_start_follow(Buffer *buf);
+
+/// buffer_stop_follow stops following the file of the buffer.
+/// \param buf The buffer.
+void buffer_stop_follow(Buffer *buf);
+
+/// buffer_update_follow adds the bytes, that were appended to the followed file
+/// since the last call, to the end of the text. Only the new bytes are read.
+/// If the cursor is at the end of the text, it moves to the new end. If the
+/// file got shorter, following stops.
+/// \param e The editor structure.
+/// \param buf The buffer.
+void buffer_update_follow(struct Editor *e, Buffer *buf);
+
 /// buffer_free frees a buffer and sets the given pointer to NULL.
+/// It waits for loads and saves in the background to finish. The journal is
+/// removed.
 /// \param buf The buffer to free.
 void buffer_free(Buffer **buf);
 
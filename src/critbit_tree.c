@@ -162,8 +162,8 @@ critbit_free(CritbitTree **t) {
 static void
 add_tree(CritbitTree *t, GapBuffer *gbuf) {
 	if (t->is_leaf) {
-		gbf_insert(gbuf, t->leaf.key, gbf_text_length(gbuf));
-		gbf_insert(gbuf, "\n", gbf_text_length(gbuf));
+		gbf_insert_n(gbuf, t->leaf.key, strlen(t->leaf.key), gbf_text_length(gbuf));
+		gbf_insert_n(gbuf, "\n", 1, gbf_text_length(gbuf));
 	} else {
 		add_tree(t->inode.children[0], gbuf);
 		add_tree(t->inode.children[1], gbuf);
@@ -195,8 +195,8 @@ critbit_keys_with_prefix(CritbitTree *t, char *prefix) {
 	}
 	if (t->is_leaf) {
 		if (strncmp(t->leaf.key, prefix, plen) == 0) {
-			gbf_insert(gbuf, t->leaf.key, gbf_text_length(gbuf));
-			gbf_insert(gbuf, "\n", gbf_text_length(gbuf));
+			gbf_insert_n(gbuf, t->leaf.key, strlen(t->leaf.key), gbf_text_length(gbuf));
+			gbf_insert_n(gbuf, "\n", 1, gbf_text_length(gbuf));
 		}
 	} else {
 		add_tree(t, gbuf);
@@ -1,6 +1,8 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <termios.h>
@@ -8,11 +10,306 @@
 
 #include "display.h"
 #include "utf8.h"
+#include "static.h"
+
+// Terminals, that support synchronized updates, show a frame at once.
+#define BEGIN_FRAME "\x1B[?2026h"
+#define END_FRAME "\x1B[?2026l"
+// The initial size of the frame buffer.
+#define INITIAL_FRAME_SIZE 16384
+// The rest of a line is erased, instead of drawn, if at least this many of its
+// cells changed to blanks.
+#define ERASE_MIN_CELLS 4
+// Unchanged cells are drawn again, instead of moving the cursor over them, if
+// there are at most this many.
+#define REDRAW_MAX_CELLS 4
+
+// The attributes set by display_set_color.
+typedef struct {
+	bool inverse;
+	int foreground;
+	int background;
+} Attributes;
+
+// A cell of the display.
+typedef struct {
+	char cp[5]; // The code point.
+	Attributes attributes;
+} Cell;
 
 struct termios old_config;
 struct termios config;
 int terminal;
 
+// The output is collected in the frame and written by display_refresh.
+static char *frame;
+static size_t frame_len;
+static size_t frame_size;
+// The position of the terminal's cursor after the frame (counted from 1), or 0
+// if it is unknown.
+static size_t cursor_line;
+static size_t cursor_column;
+// The attributes after display_set_color(OFF).
+static const Attributes default_attributes = {false, DEFAULT_FOREGROUND, DEFAULT_BACKGROUND};
+// The attributes of the next text and the ones, that the terminal uses.
+static Attributes attributes = {false, DEFAULT_FOREGROUND, DEFAULT_BACKGROUND};
+static Attributes terminal_attributes;
+static bool terminal_attributes_known;
+// The drawing functions change the back grid. display_refresh sends the cells,
+// that differ from the front grid, which holds what the terminal shows. Without
+// grids, everything is sent right away.
+static Cell *front;
+static Cell *back;
+static size_t grid_lines;
+static size_t grid_columns;
+// True, if the terminal does not show the front grid.
+static bool front_invalid;
+// The position of the cursor after the frame (counted from 1).
+static size_t target_line;
+static size_t target_column;
+
+STATIC void frame_append(char *s, size_t len);
+STATIC void frame_append_string(char *s);
+STATIC void frame_move_to(size_t line, size_t column);
+STATIC void frame_apply_attributes(Attributes a);
+STATIC void write_frame(void);
+STATIC bool attributes_equal(Attributes a, Attributes b);
+STATIC bool cell_equal(Cell *a, Cell *b);
+STATIC bool cell_is_blank(Cell *c, Attributes a);
+STATIC void clear_cells(Cell *c, size_t n, Attributes a);
+STATIC void scroll_cells(Cell *grid, size_t first, size_t lines, long n, Attributes a);
+STATIC void draw_cell(Cell *f, Cell *b);
+STATIC void draw_line(size_t line);
+STATIC void resize_grids(size_t lines, size_t columns);
+
+
+// Appends len bytes to the frame, which starts with BEGIN_FRAME. If the frame
+// cannot grow, it is written early.
+STATIC void
+frame_append(char *s, size_t len) {
+	size_t begin = frame_len == 0 ? strlen(BEGIN_FRAME) : 0;
+
+	if (frame_len + begin + len > frame_size) {
+		size_t size = frame_size == 0 ? INITIAL_FRAME_SIZE : frame_size;
+		char *f;
+
+		while (size < frame_len + begin + len) {
+			size *= 2;
+		}
+		f = realloc(frame, size);
+		if (f == NULL) {
+			write_frame();
+			if (write(STDOUT_FILENO, s, len) == -1) {
+				// TODO: handle error
+			}
+			return;
+		}
+		frame = f;
+		frame_size = size;
+	}
+	if (begin > 0) {
+		memcpy(frame, BEGIN_FRAME, begin);
+		frame_len = begin;
+	}
+	memcpy(frame + frame_len, s, len);
+	frame_len += len;
+}
+
+STATIC void
+frame_append_string(char *s) {
+	frame_append(s, strlen(s));
+}
+
+// Moves the terminal's cursor, unless it is there already.
+STATIC void
+frame_move_to(size_t line, size_t column) {
+	char out[64];
+
+	if (line == cursor_line && column == cursor_column) {
+		return;
+	}
+	frame_append(out, snprintf(out, sizeof(out), "\x1B[%zu;%zuH", line, column));
+	cursor_line = line;
+	cursor_column = column;
+}
+
+// Sends the attributes a, if the terminal does not use them already. All of
+// them are sent in one sequence.
+STATIC void
+frame_apply_attributes(Attributes a) {
+	char out[64];
+	size_t len = 0;
+
+	if (terminal_attributes_known && attributes_equal(terminal_attributes, a)) {
+		return;
+	}
+	len += snprintf(out + len, sizeof(out) - len, "\x1B[0");
+	if (a.inverse) {
+		len += snprintf(out + len, sizeof(out) - len, ";%d", INVERSE);
+	}
+	if (a.foreground != DEFAULT_FOREGROUND) {
+		len += snprintf(out + len, sizeof(out) - len, ";%d", a.foreground);
+	}
+	if (a.background != DEFAULT_BACKGROUND) {
+		len += snprintf(out + len, sizeof(out) - len, ";%d", a.background);
+	}
+	len += snprintf(out + len, sizeof(out) - len, "m");
+	frame_append(out, len);
+	terminal_attributes = a;
+	terminal_attributes_known = true;
+}
+
+// Writes the frame with a single write, unless it is interrupted.
+STATIC void
+write_frame(void) {
+	size_t done = 0;
+
+	while (done < frame_len) {
+		ssize_t n = write(STDOUT_FILENO, frame + done, frame_len - done);
+
+		if (n == -1 && errno == EINTR) {
+			continue;
+		} else if (n <= 0) {
+			// TODO: handle error
+			break;
+		}
+		done += n;
+	}
+	frame_len = 0;
+}
+
+STATIC bool
+attributes_equal(Attributes a, Attributes b) {
+	return a.inverse == b.inverse && a.foreground == b.foreground &&
+		a.background == b.background;
+}
+
+STATIC bool
+cell_equal(Cell *a, Cell *b) {
+	return strcmp(a->cp, b->cp) == 0 &&
+		attributes_equal(a->attributes, b->attributes);
+}
+
+// Checks, if c is a blank with the attributes a. Erased cells look like that.
+STATIC bool
+cell_is_blank(Cell *c, Attributes a) {
+	return strcmp(c->cp, " ") == 0 && attributes_equal(c->attributes, a);
+}
+
+// Sets n cells to blanks with the attributes a.
+STATIC void
+clear_cells(Cell *c, size_t n, Attributes a) {
+	for (size_t i = 0; i < n; i++) {
+		strcpy(c[i].cp, " ");
+		c[i].attributes = a;
+	}
+}
+
+// Moves the given lines of a grid up by n lines (or down, if n is negative).
+// The lines, that are exposed, are set to blanks with the attributes a.
+STATIC void
+scroll_cells(Cell *grid, size_t first, size_t lines, long n, Attributes a) {
+	Cell *start = grid + first * grid_columns;
+	size_t k = n < 0 ? -n : n;
+	size_t kept = (lines - k) * grid_columns;
+
+	if (n > 0) {
+		memmove(start, start + k * grid_columns, kept * sizeof(*grid));
+		clear_cells(start + kept, k * grid_columns, a);
+	} else {
+		memmove(start + k * grid_columns, start, kept * sizeof(*grid));
+		clear_cells(start, k * grid_columns, a);
+	}
+}
+
+// Sends the back cell b at the terminal's cursor and copies it to the front
+// cell f.
+STATIC void
+draw_cell(Cell *f, Cell *b) {
+	frame_apply_attributes(b->attributes);
+	frame_append_string(b->cp);
+	cursor_column++;
+	*f = *b;
+}
+
+// Sends the cells of a line, that changed.
+STATIC void
+draw_line(size_t line) {
+	Cell *f = front + line * grid_columns;
+	Cell *b = back + line * grid_columns;
+	Attributes last = b[grid_columns - 1].attributes;
+	size_t blank = grid_columns;
+
+	// From blank on, the line is erased. Erased cells get the background, but
+	// are not inverted.
+	while (!last.inverse && blank > 0 && cell_is_blank(&b[blank - 1], last)) {
+		blank--;
+	}
+	for (size_t c = 0; c < grid_columns; c++) {
+		size_t changed = 0;
+		size_t gap;
+
+		if (cell_equal(&f[c], &b[c])) {
+			continue;
+		}
+		if (c >= blank) {
+			for (size_t i = c; i < grid_columns; i++) {
+				changed += !cell_equal(&f[i], &b[i]);
+			}
+		}
+		if (changed >= ERASE_MIN_CELLS) {
+			frame_move_to(line + 1, c + 1);
+			frame_apply_attributes(last);
+			frame_append_string("\x1B[K");
+			memcpy(&f[c], &b[c], (grid_columns - c) * sizeof(*f));
+			return;
+		}
+		// A few unchanged cells, that follow the last drawn cell, are drawn
+		// again, if that is shorter than moving the cursor.
+		gap = c + 1 - cursor_column;
+		if (cursor_line == line + 1 && cursor_column <= c && gap <= REDRAW_MAX_CELLS) {
+			for (size_t i = cursor_column - 1; i < c; i++) {
+				if (strlen(b[i].cp) != 1 || !terminal_attributes_known ||
+					!attributes_equal(b[i].attributes, terminal_attributes)) {
+					break;
+				}
+				draw_cell(&f[i], &b[i]);
+			}
+		}
+		frame_move_to(line + 1, c + 1);
+		draw_cell(&f[c], &b[c]);
+	}
+}
+
+// Replaces the grids with blank grids of the given size. The terminal is
+// cleared with the next refresh.
+STATIC void
+resize_grids(size_t lines, size_t columns) {
+	free(front);
+	free(back);
+	front = NULL;
+	back = NULL;
+	grid_lines = 0;
+	grid_columns = 0;
+	if (lines == 0 || columns == 0) {
+		return;
+	}
+	front = malloc(lines * columns * sizeof(*front));
+	back = malloc(lines * columns * sizeof(*back));
+	if (front == NULL || back == NULL) {
+		// Everything is sent right away.
+		free(front);
+		free(back);
+		front = NULL;
+		back = NULL;
+		return;
+	}
+	grid_lines = lines;
+	grid_columns = columns;
+	clear_cells(back, lines * columns, default_attributes);
+	front_invalid = true;
+}
+
 
 void
 display_init(void) {
@@ -58,6 +355,12 @@ display_init(void) {
 	// Set the new attributes (TCSANOW: apply changes immediately).
 	tcsetattr(terminal, TCSANOW, &config);
 	display_to_alt_screen();
+
+	// The terminal may have been used by another program (see SIGCONT).
+	cursor_line = 0;
+	cursor_column = 0;
+	terminal_attributes_known = false;
+	front_invalid = true;
 }
 
 void
@@ -65,17 +368,30 @@ display_close(void) {
 	// Restore the termminal to it's previous state. TCSAFLUSH causes
 	// leftover input to be discarded.
 	tcsetattr(terminal, TCSAFLUSH, &old_config);
+	// The last changes are sent to the alternate screen. Without the grids,
+	// only leaving it is sent to the primary screen, not the cursor position.
+	display_refresh();
+	resize_grids(0, 0);
+	target_line = 0;
+	target_column = 0;
 	display_from_alt_screen();
+	display_refresh();
 }
 
 void
 display_to_alt_screen(void) {
-	printf("\x1B[?1049h");
+	frame_append_string("\x1B[?1049h");
+	cursor_line = 0;
+	cursor_column = 0;
 }
 
 void
 display_from_alt_screen(void) {
-	printf("\x1B[?1049l");
+	attributes = default_attributes;
+	frame_apply_attributes(attributes);
+	frame_append_string("\x1B[?1049l");
+	cursor_line = 0;
+	cursor_column = 0;
 }
 
 void
@@ -94,23 +410,39 @@ display_clear_timeout(void) {
 
 void
 display_show_cursor(void) {
-	printf("\x1B[?25h");
+	frame_append_string("\x1B[?25h");
 }
 
 void
 display_hide_cursor(void) {
-	printf("\x1B[?25l");
+	frame_append_string("\x1B[?25l");
 }
 
 void
 display_clear(void) {
-	printf("\x1B[2J");
+	// Erased cells get the current background.
+	if (back != NULL) {
+		clear_cells(back, grid_lines * grid_columns, attributes);
+		return;
+	}
+	frame_apply_attributes(attributes);
+	frame_append_string("\x1B[2J");
 }
 
 void
 display_clear_line(Window w, size_t line) {
+	size_t l = w.position.line + line;
+
 	display_move_cursor(w, line, 0);
-	printf("\x1B[2K");
+	if (back != NULL) {
+		// Like the terminal, the whole line is cleared.
+		if (l >= 1 && l <= grid_lines) {
+			clear_cells(back + (l - 1) * grid_columns, grid_columns, attributes);
+		}
+		return;
+	}
+	frame_apply_attributes(attributes);
+	frame_append_string("\x1B[2K");
 }
 
 void
@@ -125,7 +457,30 @@ display_show_cp(Window w, size_t line, size_t column, char *cp) {
 	size_t l = w.position.line + line;
 	size_t c = w.position.column + column;
 
-	printf("\x1B[%zu;%zuH%s", l, c, cp);
+	if (back != NULL) {
+		// Control characters are not shown.
+		if ((unsigned char)cp[0] >= ' ' && cp[0] != '\x7F' && strlen(cp) < sizeof(back->cp) &&
+			l >= 1 && l <= grid_lines && c >= 1 && c <= grid_columns) {
+			Cell *cell = back + (l - 1) * grid_columns + (c - 1);
+
+			strcpy(cell->cp, cp);
+			cell->attributes = attributes;
+			target_line = l;
+			target_column = c + 1;
+		}
+		return;
+	}
+	// Text, that follows the previous text, needs no cursor movement.
+	frame_move_to(l, c);
+	frame_apply_attributes(attributes);
+	frame_append_string(cp);
+	if ((unsigned char)cp[0] >= ' ' && cp[0] != '\x7F') {
+		cursor_column += utf8_draw_width(cp[0]);
+	} else {
+		// A control character may move the cursor anywhere.
+		cursor_line = 0;
+		cursor_column = 0;
+	}
 }
 
 size_t
@@ -148,7 +503,39 @@ void
 display_move_cursor(Window w, size_t line, size_t column) {
 	size_t l = w.position.line + line;
 	size_t c = w.position.column + column;
-	printf("\x1B[%zu;%zuH", l, c);
+
+	if (back != NULL) {
+		target_line = l;
+		target_column = c;
+		return;
+	}
+	frame_move_to(l, c);
+}
+
+void
+display_scroll_window(Window w, long lines) {
+	size_t top = w.position.line;
+	size_t bottom = w.position.line + w.size.lines - 1;
+	size_t n = lines < 0 ? -lines : lines;
+	char out[64];
+
+	if (back == NULL || lines == 0 || n >= w.size.lines || top < 1 ||
+		bottom > grid_lines) {
+		return;
+	}
+	scroll_cells(back, top - 1, w.size.lines, lines, attributes);
+	// The terminal scrolls whole lines.
+	if (front_invalid || w.position.column != 1 || w.size.columns != grid_columns) {
+		return;
+	}
+	// The lines, that scroll in, get the current background.
+	frame_apply_attributes(default_attributes);
+	frame_append(out, snprintf(out, sizeof(out), "\x1B[%zu;%zur\x1B[%zu%c\x1B[r",
+	                           top, bottom, n, lines > 0 ? 'S' : 'T'));
+	scroll_cells(front, top - 1, w.size.lines, lines, default_attributes);
+	// Setting the scroll region moves the cursor home.
+	cursor_line = 0;
+	cursor_column = 0;
 }
 
 void
@@ -170,14 +557,46 @@ display_set_size(Display *d) {
 	ioctl(1, TIOCGWINSZ, &ws);
 	d->lines = ws.ws_row;
 	d->columns = ws.ws_col;
+	if (d->lines != grid_lines || d->columns != grid_columns || back == NULL) {
+		resize_grids(d->lines, d->columns);
+	}
 }
 
 void
 display_refresh(void) {
-	fflush(stdout);
+	if (back != NULL) {
+		if (front_invalid) {
+			frame_apply_attributes(default_attributes);
+			frame_append_string("\x1B[2J");
+			clear_cells(front, grid_lines * grid_columns, default_attributes);
+			front_invalid = false;
+		}
+		for (size_t l = 0; l < grid_lines; l++) {
+			draw_line(l);
+		}
+		if (target_line >= 1 && target_column >= 1) {
+			frame_move_to(target_line, target_column);
+		}
+	}
+	if (frame_len == 0) {
+		return;
+	}
+	frame_append_string(END_FRAME);
+	write_frame();
 }
 
 void
 display_set_color(Color c) {
-	printf("\x1B[%dm", c);
+	// The attributes are sent with the next text, so a run of text with the
+	// same attributes gets one sequence.
+	if (c == OFF) {
+		attributes = default_attributes;
+	} else if (c == INVERSE) {
+		attributes.inverse = true;
+	} else if ((c >= FOREGROUND_BLACK && c <= DEFAULT_FOREGROUND) ||
+	           (c >= FOREGROUND_BRIGHT_BLACK && c <= FOREGROUND_BRIGHT_WHITE)) {
+		attributes.foreground = c;
+	} else {
+		attributes.background = c;
+	}
 }
@@ -4,6 +4,11 @@
 /// \file
 /// display.h contains various display function,
 /// such as init, close, drawing, colors, ...
+///
+/// The drawing functions draw into a grid of cells, each holding a code point
+/// and its colors. display_refresh compares it to a second grid, which holds
+/// what the terminal shows, and sends only the cells, that changed. So a window
+/// can be cleared and drawn again, but typing a character sends a few bytes.
 
 /// Display defines the size of the display in lines and columns.
 typedef struct {
@@ -141,6 +146,14 @@ size_t display_show_string(Window w, size_t line, size_t column, char *text);
 /// \param column The column.
 void display_move_cursor(Window w, size_t line, size_t column);
 
+/// display_scroll_window moves the contents of a window up or down. The
+/// terminal scrolls the lines itself, so only the lines, that are exposed, have
+/// to be sent. They are cleared.
+/// \param w A window.
+/// \param lines The number of lines to move the contents up, or down, if it is
+///        negative.
+void display_scroll_window(Window w, long lines);
+
 /// display_move_window moves a window.
 /// \param w The window to move.
 /// \param line The line to move the window to.
@@ -153,16 +166,20 @@ void display_move_window(Window *w, size_t line, size_t column);
 /// \param columns The new number of columns.
 void display_resize_window(Window *w, size_t lines, size_t columns);
 
-/// display_set_size computes and sets the display size.
+/// display_set_size computes and sets the display size. If it changed, the
+/// display is cleared and drawn anew with the next refresh.
 /// \param d The display.
 void display_set_size(Display *d);
 
 /// display_refresh updates the display. The other drawing functions change
-/// the internal state. This function actually makes the changes visible.
+/// the internal state. This function actually makes the changes visible: The
+/// changed cells are written with a single write and wrapped in a synchronized
+/// update, so the terminal never shows half of a frame.
 void display_refresh(void);
 
 
-/// display_set_color sets the current foreground/background color.
+/// display_set_color sets the current foreground/background color. It is sent
+/// to the terminal with the next text, together with the other attributes.
 /// \param c The color to activate.
 void display_set_color(Color c);
 
@@ -12,8 +12,16 @@
 #include "buffer.h"
 #include "editor.h"
 #include "utf8.h"
+#include "journal.h"
+#include "pool.h"
 
 
+// How long the input is waited for in deciseconds, while a journal has pending
+// edits, so they are written in time, even if no key is pressed.
+#define JOURNAL_TIMEOUT 10
+// How often followed files are checked for new text in deciseconds.
+#define FOLLOW_TIMEOUT 5
+
 void
 editor_show_message(Editor *e, char *message) {
 	display_clear_window(e->messagebar_win);
@@ -24,15 +32,26 @@ editor_show_message(Editor *e, char *message) {
 void
 editor_draw_statusbar(Editor *e) {
 	char text[1024];
+	char busy[32] = "";
 	Buffer *buf = e->current_buffer;
 
+	if (buf->stream) {
+		snprintf(busy, 31, "Reading");
+	} else if (buf->loader != NULL) {
+		snprintf(busy, 31, "Loading:(%zu%%)", buf->loaded * 100 / buf->load_size);
+	} else if (buf->save != NULL) {
+		snprintf(busy, 31, "Saving");
+	} else if (buf->follow) {
+		snprintf(busy, 31, "Following");
+	}
 	display_set_color(BACKGROUND_BLACK);
-	snprintf(text, 1023, "Pos:(%zu:%zu)Cur:(%zu|%zu)Off:(T:%zu|O:%zu)(%x):%s%s:",
+	snprintf(text, 1023, "Pos:(%zu:%zu)Cur:(%zu|%zu)Off:(T:%zu|O:%zu)(%x):%s%s:%s",
 			 buf->position.line, buf->position.column,
 			 buf->cursor.line, buf->cursor.column,
 			 buf->first_visible_char, buf->position.offset,
 			 gbf_at(buf->gbuf, buf->position.offset),
-			 buf->filename ? buf->filename : "Unnamed", buf->has_changed ? "*" : " ");
+			 buf->filename ? buf->filename : "Unnamed", buf->has_changed ? "*" : " ",
+			 busy);
 
 	size_t col = display_show_string(e->statusbar_win, 0, 0, text);
 	while (col < e->display.columns) {
@@ -47,6 +66,79 @@ void
 editor_loop_once(Editor *e) {
 	KeyCode c;
 	char input[32] = {0};
+	bool busy = false;
+	bool pending = false;
+	bool following = false;
+	size_t wait = 0;
+	Buffer *l;
+
+	// Files named on the command line are read ahead on the pool or, when they
+	// are shown first, right away. A file, that cannot be read, is closed.
+	buffer_update_preload(e);
+	while (!buffer_load(e, e->current_buffer)) {
+		buffer_free(&e->current_buffer);
+		if (e->current_buffer == NULL) {
+			buffer_append(&e->current_buffer, buffer_new(e, NULL));
+			if (e->current_buffer == NULL) {
+				quit(e);
+			}
+		}
+	}
+	l = e->current_buffer;
+
+	// Files, that are loading in the background, are shown as they grow.
+	// The input is read with a timeout, until all loads and saves are done
+	// and all journals are written. Followed files are checked in between.
+	do {
+		if (l->loader != NULL) {
+			buffer_update_load(e, l);
+			busy = busy || l->loader != NULL;
+		}
+		if (l->save != NULL) {
+			buffer_update_save(e, l);
+			busy = busy || l->save != NULL;
+		}
+		if (l->follow) {
+			buffer_update_follow(e, l);
+			following = following || l->follow;
+		}
+		if (l->journal != NULL && journal_flush_due(l->journal, e->journal_interval)) {
+			buffer_flush_journal(e, l);
+		}
+		pending = pending || (l->journal != NULL && journal_is_pending(l->journal));
+		l = l->next;
+	} while (l != e->current_buffer);
+	// A file, that could not be read completely, is closed like one, that
+	// cannot be read at all.
+	for (l = e->current_buffer; l != NULL; ) {
+		if (!l->load_failed) {
+			l = l->next == e->current_buffer ? NULL : l->next;
+			continue;
+		}
+		if (l == e->current_buffer) {
+			buffer_free(&e->current_buffer);
+		} else {
+			buffer_free(&l);
+		}
+		if (e->current_buffer == NULL) {
+			buffer_append(&e->current_buffer, buffer_new(e, NULL));
+			if (e->current_buffer == NULL) {
+				quit(e);
+			}
+		}
+		e->current_buffer->redraw = true;
+		l = e->current_buffer;
+	}
+	if (busy || (e->pool != NULL && pool_pending(e->pool) > 0)) {
+		wait = 1;
+	} else if (following) {
+		wait = FOLLOW_TIMEOUT;
+	} else if (pending) {
+		wait = JOURNAL_TIMEOUT;
+	}
+	if (wait > 0) {
+		display_set_timeout(wait);
+	}
 
 	if (e->current_buffer->draw != NULL) {
 		e->current_buffer->draw(e);
@@ -54,13 +146,16 @@ editor_loop_once(Editor *e) {
 
 	c = input_get(input);
 	e->string_arg = input;
+	if (wait > 0 && c != KEY_TIMEOUT) {
+		display_clear_timeout();
+	}
 
 	UserFunc *uf = buffer_call_userfunc(e, e->current_buffer, c);
 
 	Buffer *b = e->current_buffer;
 
 	if (e->macro_info.recording_macro && b->prev_func->func != macro_start_stop) {
-		if (uf != NULL) {
+		if (uf != NULL && uf != &uf_timeout) {
 			macro_append(e, uf, e->string_arg);
 		}
 	}
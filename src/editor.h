@@ -35,6 +35,11 @@ typedef struct Editor {
 	size_t copy_bytes_written; ///< The number of bytes written to copy_buffer.
 
 	bool shows_message; ///< This is true, if the editor shows a message.
+	unsigned journal_interval; ///< Seconds between journal writes, 0 if there are no journals.
+	size_t undo_limit; ///< The most bytes of undo history per buffer, 0 if there is no undo.
+	bool keep_history; ///< True, if the undo history of files is kept after they are closed.
+	struct Pool *pool; ///< Reads files ahead (see buffer_update_preload) or NULL.
+	size_t preloaded; ///< The number of bytes, that were read ahead.
 
 	Buffer *current_buffer; ///< The current buffer. This is a circular doubly-linked list.
 } Editor;
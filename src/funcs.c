@@ -1,11 +1,15 @@
-#define _POSIX_SOURCE 200809L
+#define _XOPEN_SOURCE 700
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <signal.h>
 #include <stdbool.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
 
 #include "display.h"
 #include "funcs.h"
@@ -18,13 +22,22 @@
 #include "menus.h"
 #include "utf8.h"
 #include "search.h"
+#include "aho_corasick.h"
+#include "save.h"
+#include "journal.h"
+#include "undo.h"
 
 #define INITIAL_COPY_BUFFER_SIZE 4096
+// isearch counts the matches in steps of COUNT_STEP bytes, while there is no input.
+#define COUNT_STEP (4 * 1024 * 1024)
 
 static int scroll_up(Buffer *buf);
 static int scroll_down(Buffer *buf);
-static void move_to_offset(Editor *e, size_t offset);
+static size_t text_width(GapBuffer *gbuf, size_t start, size_t end);
+static AhoCorasick *make_patterns(char *s, size_t len);
+static void count_matches(Buffer *ib, GapBuffer *gbuf);
 static size_t region_size(Buffer *b);
+static void start_save(Editor *e);
 
 
 UserFunc uf_insert = {
@@ -37,7 +50,15 @@ UserFunc uf_insert = {
 void
 insert(Editor *e) {
 	Buffer *b = e->current_buffer;
-	gbf_insert(b->gbuf, e->string_arg, b->position.offset);
+	size_t len = strlen(e->string_arg);
+
+	if (!gbf_insert_n(b->gbuf, e->string_arg, len, b->position.offset)) {
+		editor_show_message(e, "Out of memory");
+		return;
+	}
+	if (b->undo != NULL) {
+		undo_insert(b->undo, b->position.offset, e->string_arg, len);
+	}
 	right(e);
 	b->has_changed = true;
 	b->redraw = true;
@@ -83,7 +104,18 @@ delete(Editor *e) {
 		return;
 	}
 	size_t bytes = utf8_byte_size(gbf_at(b->gbuf, b->position.offset));
-	gbf_delete(b->gbuf, b->position.offset, bytes);
+	if (b->undo != NULL) {
+		undo_delete(b->undo, b->gbuf, b->position.offset, bytes);
+	}
+	if (!gbf_delete(b->gbuf, b->position.offset, bytes)) {
+		// The bytes were recorded, before they were deleted, so the history
+		// does not match the text anymore.
+		if (b->undo != NULL) {
+			undo_clear(b->undo);
+		}
+		editor_show_message(e, "Out of memory");
+		return;
+	}
 	b->has_changed = true;
 	b->redraw = true;
 }
@@ -224,21 +256,14 @@ toggle_show_hidden_files(Editor *e) {
 // Scrolls up by one line. Returns 1 on success, 0 on failure.
 static int
 scroll_up(Buffer *b) {
-	int newlines = 0;
+	size_t line;
 
 	if (b->first_visible_char == 0) {
 		return false;
 	}
-	do {
-		b->first_visible_char--;
-		if (gbf_at(b->gbuf, b->first_visible_char) == '\n') {
-			newlines++;
-		}
-	} while ((newlines != 2) && (b->first_visible_char != 0));
-
-	if (b->first_visible_char != 0) {
-		b->first_visible_char++;
-	}
+	line = gbf_line_at(b->gbuf, b->first_visible_char);
+	gbf_line_start(b->gbuf, line > 1 ? line - 1 : 1, &b->first_visible_char);
+	b->scrolled--;
 	b->redraw = true;
 	return true;
 }
@@ -246,30 +271,62 @@ scroll_up(Buffer *b) {
 // Scrolls down by one line. Returns 1 on success, 0 on failure.
 static int
 scroll_down(Buffer *b) {
-	size_t start = b->first_visible_char;
+	size_t line = gbf_line_at(b->gbuf, b->first_visible_char);
 
-	while (gbf_at(b->gbuf, b->first_visible_char) != '\n') {
-		if (b->first_visible_char == gbf_text_length(b->gbuf)) {
-			b->first_visible_char = start;
-			return false;
-		}
-		b->first_visible_char += utf8_byte_size(gbf_at(b->gbuf, b->first_visible_char));
+	if (!gbf_line_start(b->gbuf, line + 1, &b->first_visible_char)) {
+		return false;
 	}
-	b->first_visible_char += utf8_byte_size(gbf_at(b->gbuf, b->first_visible_char));
+	b->scrolled++;
 	b->redraw = true;
-
 	return true;
 }
 
-static void
-move_to_offset(Editor *e, size_t offset) {
-	Buffer *b = e->current_buffer;
-	while (b->position.offset > offset) {
-		left(e);
+// Returns the draw width of the text from start to end.
+static size_t
+text_width(GapBuffer *gbuf, size_t start, size_t end) {
+	size_t width = 0;
+	size_t len;
+	char *chunk;
+
+	for (; start < end && (len = gbf_chunk(gbuf, start, &chunk)) > 0; start += len) {
+		if (len > end - start) {
+			len = end - start;
+		}
+		for (size_t i = 0; i < len; i++) {
+			if (utf8_is_valid_first_byte(chunk[i])) {
+				width += utf8_draw_width(chunk[i]);
+			}
+		}
 	}
-	while (b->position.offset < offset) {
-		right(e);
+	return width;
+}
+
+// Moves the cursor of b to offset. The window scrolls like it does for left and
+// right: A line above the window becomes the first visible line, a line below
+// it the last one.
+void
+move_to_offset(Buffer *b, size_t offset) {
+	size_t line = gbf_line_at(b->gbuf, offset);
+	size_t first = gbf_line_at(b->gbuf, b->first_visible_char);
+	size_t lines = b->win->size.lines;
+	size_t start = 0;
+
+	gbf_line_start(b->gbuf, line, &start);
+	if (line < first) {
+		b->first_visible_char = start;
+		b->cursor.line = 0;
+		b->redraw = true;
+	} else if (line - first >= lines) {
+		gbf_line_start(b->gbuf, line - lines + 1, &b->first_visible_char);
+		b->cursor.line = lines - 1;
+		b->redraw = true;
+	} else {
+		b->cursor.line = line - first;
 	}
+	b->position.offset = offset;
+	b->position.line = line;
+	b->position.column = text_width(b->gbuf, start, offset) + 1;
+	b->cursor.column = b->position.column - 1;
 }
 
 UserFunc uf_left = {
@@ -298,15 +355,10 @@ left(Editor *e) {
 			b->position.offset--;
 		} while (!utf8_is_valid_first_byte(b->position.offset));
 
-		size_t s = b->position.offset;
-		size_t col = 0;
+		size_t start = 0;
+		gbf_line_start(b->gbuf, gbf_line_at(b->gbuf, b->position.offset), &start);
+		size_t col = text_width(b->gbuf, start, b->position.offset);
 
-		while ((s != 0) && (gbf_at(b->gbuf, s - 1) != '\n')) {
-			do {
-				s--;
-			} while (!utf8_is_valid_first_byte(s));
-			col += utf8_draw_width(gbf_at(b->gbuf, s));
-		}
 		b->cursor.column = col;
 		b->position.column = col + 1;
 	} else {
@@ -361,15 +413,37 @@ void
 up(Editor *e) {
 	Buffer *b = e->current_buffer;
 	UserFunc *prev = e->current_buffer->prev_func;
+	size_t start = 0;
+	size_t nl;
+	char c;
 
 	if (prev != NULL && (prev->func != up) && (prev->func != down)) {
 		b->target_column = b->position.column;
 	}
 
 	bol(e);
-	do {
-		left(e);
-	} while (b->position.column > b->target_column);
+	if (b->position.offset == 0) {
+		return;
+	}
+
+	// Move the cursor to the beginning of the previous line.
+	if (gbf_prev_newline(b->gbuf, b->position.offset - 1, &nl)) {
+		start = nl + 1;
+	}
+	if (b->cursor.line == 0) {
+		scroll_up(b);
+	} else {
+		b->cursor.line--;
+	}
+	b->position.offset = start;
+	b->position.line--;
+
+	// Move the cursor to the last position, that is not after the target column.
+	while ((c = gbf_at(b->gbuf, b->position.offset)) != '\n' &&
+		   (b->position.offset != gbf_text_length(b->gbuf)) &&
+		   (b->position.column + utf8_draw_width(c) <= b->target_column)) {
+		right(e);
+	}
 }
 
 UserFunc uf_down = {
@@ -383,15 +457,21 @@ void
 down(Editor *e) {
 	Buffer *b = e->current_buffer;
 	UserFunc *prev = e->current_buffer->prev_func;
+	size_t nl;
 
 	if (prev != NULL && (prev->func != up) && (prev->func != down)) {
 		b->target_column = b->position.column;
 	}
 
+	if (!gbf_next_newline(b->gbuf, b->position.offset, &nl)) {
+		// This is the last line.
+		eol(e);
+		return;
+	}
+
 	// Move the cursor to the beginning of the next line.
-	do {
-		right(e);
-	} while ((b->position.column > 1) && (b->position.offset != gbf_text_length(b->gbuf)));
+	b->position.offset = nl;
+	right(e);
 
 	// Move the cursor to the target column.
 	while ((gbf_at(b->gbuf, b->position.offset) != '\n') &&
@@ -411,9 +491,18 @@ UserFunc uf_bol = {
 void
 bol(Editor *e) {
 	Buffer *b = e->current_buffer;
-	while (b->position.column > 1) {
-		left(e);
+	size_t nl;
+
+	if (b->position.column == 1) {
+		return;
+	}
+	if (gbf_prev_newline(b->gbuf, b->position.offset, &nl)) {
+		b->position.offset = nl + 1;
+	} else {
+		b->position.offset = 0;
 	}
+	b->position.column = 1;
+	b->cursor.column = 0;
 }
 
 UserFunc uf_eol = {
@@ -426,10 +515,14 @@ UserFunc uf_eol = {
 void
 eol(Editor *e) {
 	Buffer *b = e->current_buffer;
-	while ((gbf_at(b->gbuf, b->position.offset) != '\n') &&
-		   (b->position.offset < gbf_text_length(b->gbuf))) {
-		right(e);
-	}
+	size_t end = gbf_text_length(b->gbuf);
+	size_t width;
+
+	gbf_next_newline(b->gbuf, b->position.offset, &end);
+	width = text_width(b->gbuf, b->position.offset, end);
+	b->position.offset = end;
+	b->position.column += width;
+	b->cursor.column += width;
 }
 
 UserFunc uf_page_up = {
@@ -443,18 +536,16 @@ void
 page_up(Editor *e) {
 	Buffer *b = e->current_buffer;
 	size_t lines = b->win->size.lines;
-	size_t l = b->cursor.line;
+	size_t first = gbf_line_at(b->gbuf, b->first_visible_char);
 
-	for (size_t i = 0; i < lines - 1; i++) {
-		if (!scroll_up(b)) {
-			break;
-		}
-	}
+	first = first > lines - 1 ? first - (lines - 1) : 1;
+	gbf_line_start(b->gbuf, first, &b->first_visible_char);
 	b->position.offset = b->first_visible_char;
-	b->position.line -= l - 1;
+	b->position.line = first;
 	b->position.column = 1;
 	b->cursor.line = 0;
 	b->cursor.column = 0;
+	b->redraw = true;
 }
 
 UserFunc uf_page_down = {
@@ -467,21 +558,73 @@ UserFunc uf_page_down = {
 void
 page_down(Editor *e) {
 	Buffer *b = e->current_buffer;
-	size_t start = b->first_visible_char;
 	size_t lines = b->win->size.lines;
-	size_t l = b->cursor.line;
+	size_t first = gbf_line_at(b->gbuf, b->first_visible_char) + lines - 1;
+	size_t start;
 
-	for (size_t i = 0; i < lines - 1; i++) {
-		if (!scroll_down(b)) {
-			b->first_visible_char = start;
-			return;
-		}
+	if (!gbf_line_start(b->gbuf, first, &start)) {
+		return;
 	}
-	b->position.offset = b->first_visible_char;
-	b->position.line += lines - l - 1;
+	b->first_visible_char = start;
+	b->position.offset = start;
+	b->position.line = first;
 	b->position.column = 1;
 	b->cursor.line = 0;
 	b->cursor.column = 0;
+	b->redraw = true;
+}
+
+// Splits s at '|' and builds an automaton for the parts. "\|" is a literal '|'.
+static AhoCorasick *
+make_patterns(char *s, size_t len) {
+	char *text = malloc(len);
+	char **patterns = malloc((len + 1) * sizeof(*patterns));
+	size_t *lengths = malloc((len + 1) * sizeof(*lengths));
+	AhoCorasick *ac = NULL;
+
+	if (text != NULL && patterns != NULL && lengths != NULL) {
+		size_t n = 1;
+		size_t j = 0;
+
+		patterns[0] = text;
+		lengths[0] = 0;
+		for (size_t i = 0; i < len; i++) {
+			if (s[i] == '|') {
+				patterns[n] = text + j;
+				lengths[n] = 0;
+				n++;
+			} else {
+				if (s[i] == '\\' && i + 1 < len && s[i + 1] == '|') {
+					i++;
+				}
+				text[j++] = s[i];
+				lengths[n - 1]++;
+			}
+		}
+		ac = aho_corasick_new(patterns, lengths, n);
+	}
+	free(text);
+	free(patterns);
+	free(lengths);
+	return ac;
+}
+
+// Counts the matches in the next COUNT_STEP bytes of the text.
+static void
+count_matches(Buffer *ib, GapBuffer *gbuf) {
+	size_t end = ib->isearch_counted + COUNT_STEP;
+	size_t len;
+	char *chunk;
+
+	while (ib->isearch_counted < end &&
+		   (len = gbf_chunk(gbuf, ib->isearch_counted, &chunk)) > 0) {
+		if (len > end - ib->isearch_counted) {
+			len = end - ib->isearch_counted;
+		}
+		ib->isearch_hits += aho_corasick_count(ib->isearch_patterns,
+		                                       &ib->isearch_count_state, chunk, len);
+		ib->isearch_counted += len;
+	}
 }
 
 UserFunc uf_isearch = {
@@ -501,40 +644,83 @@ isearch(Editor *e) {
 	ib->isearch_has_match = true;
 	ib->isearch_direction = ISEARCH_DIRECTION_FORWARD;
 	ib->isearch_start = tb->position.offset;
+	// The pattern of the last search is kept.
+	ib->has_changed = true;
 	e->size_t_arg = gbf_text_length(tb->gbuf);
 
 	while (!ib->cancel) {
+		bool counting = ib->isearch_patterns != NULL &&
+			ib->isearch_counted < gbf_text_length(tb->gbuf);
+
 		e->current_buffer = tb;
 		e->current_buffer->draw(e);
 		e->current_buffer = ib;
 
+		if (counting) {
+			// Return immediately, if there is no input.
+			display_set_timeout(0);
+		}
 		editor_loop_once(e);
+		if (counting) {
+			display_clear_timeout();
+		}
+		if (ib->timeout) {
+			ib->timeout = false;
+			count_matches(ib, tb->gbuf);
+			continue;
+		}
 
 		size_t len = gbf_text_length(ib->gbuf);
 
-		if (len != 0) {
-			char *s = gbf_text(ib->gbuf);
+		if (ib->has_changed) {
+			// The automaton is built once for every pattern set.
+			if (ib->isearch_patterns != NULL) {
+				aho_corasick_free(&ib->isearch_patterns);
+			}
+			if (len != 0) {
+				char *s = gbf_text(ib->gbuf);
+
+				ib->isearch_patterns = make_patterns(s, len);
+				free(s);
+				if (ib->isearch_patterns == NULL) {
+					editor_show_message(e, "Out of memory");
+				}
+			}
+			ib->isearch_hits = 0;
+			ib->isearch_counted = 0;
+			ib->isearch_count_state = 0;
+			ib->has_changed = false;
+		}
+		if (ib->isearch_patterns != NULL) {
 			size_t off = 0;
+			size_t n = 0;
 
 			if (ib->isearch_direction == ISEARCH_DIRECTION_FORWARD) {
-				ib->isearch_has_match = gbf_search(tb->gbuf, s, len, ib->isearch_start, &off);
+				ib->isearch_has_match = aho_corasick_search(ib->isearch_patterns, tb->gbuf,
+				                                            ib->isearch_start, &off, &n);
 			} else if (ib->isearch_direction == ISEARCH_DIRECTION_BACKWARD) {
-				ib->isearch_has_match = gbf_search_reverse(tb->gbuf, s, len, ib->isearch_start, &off);
+				ib->isearch_has_match = aho_corasick_search_reverse(ib->isearch_patterns, tb->gbuf,
+				                                                    ib->isearch_start, &off, &n);
 			}
 			if (ib->isearch_has_match) {
 				ib->isearch_match_start = off;
-				ib->isearch_match_end = off + len;
+				ib->isearch_match_end = off + n;
 			}
 			e->current_buffer = tb;
 			e->current_buffer->redraw = true;
 			if (ib->isearch_has_match) {
-				move_to_offset(e, off);
+				move_to_offset(e->current_buffer, off);
 			}
 			e->current_buffer = ib;
-			free(s);
 		}
 	}
 
+	if (ib->isearch_patterns != NULL) {
+		aho_corasick_free(&ib->isearch_patterns);
+	}
+	free(ib->isearch_ranges);
+	ib->isearch_ranges = NULL;
+	ib->isearch_ranges_size = 0;
 	ib->isearch_is_active = false;
 	ib->isearch_has_match = false;
 	ib->isearch_has_wrapped = false;
@@ -648,6 +834,38 @@ region_off(Editor *e) {
 	editor_show_message(e, "Cleared region.");
 }
 
+UserFunc uf_stop = {
+	.type = USER_FUNC_MANAGEMENT,
+	.name = "stop",
+	.description = "Stop loading the file or reading the input or clear the current region.",
+	.func = stop
+};
+
+void
+stop(Editor *e) {
+	Buffer *b = e->current_buffer;
+
+	if (b->stream) {
+		buffer_stop_stream(b);
+		editor_show_message(e, "Stopped reading.");
+		return;
+	} else if (b->loader == NULL) {
+		region_off(e);
+		return;
+	}
+	// The partly loaded text is thrown away with the buffer.
+	buffer_free(&e->current_buffer);
+	if (e->current_buffer == NULL) {
+		// Like on startup, an empty buffer replaces the last one.
+		buffer_append(&e->current_buffer, buffer_new(e, NULL));
+		if (e->current_buffer == NULL) {
+			quit(e);
+		}
+	}
+	e->current_buffer->redraw = true;
+	editor_show_message(e, "Stopped loading.");
+}
+
 static size_t
 region_size(Buffer *b) {
 	return b->region_end - b->region_start;
@@ -690,11 +908,7 @@ copy(Editor *e) {
 		}
 		e->copy_buffer_size = len + 1;
 	}
-	e->copy_bytes_written = 0;
-	for (size_t i = 0; i < len; i++) {
-		e->copy_buffer[i] = gbf_at(b->gbuf, b->region_start + i);
-		e->copy_bytes_written++;
-	}
+	e->copy_bytes_written = gbf_text_n(b->gbuf, b->region_start, len, e->copy_buffer);
 	e->copy_buffer[e->copy_bytes_written] = '\0';
 	editor_show_message(e, "Copied text.");
 }
@@ -721,10 +935,20 @@ cut(Editor *e) {
 		return;
 	}
 
-	move_to_offset(e, b->region_start);
-	for (size_t i = 0; i < region_size(b); i++) {
-		delete(e);
+	move_to_offset(b, b->region_start);
+	if (b->undo != NULL) {
+		undo_delete(b->undo, b->gbuf, b->region_start, region_size(b));
+	}
+	if (!gbf_delete(b->gbuf, b->region_start, region_size(b))) {
+		// Like in delete, the history does not match the text anymore.
+		if (b->undo != NULL) {
+			undo_clear(b->undo);
+		}
+		editor_show_message(e, "Cut failed (Out of memory)");
+		return;
 	}
+	b->has_changed = true;
+	b->redraw = true;
 	region_off(e);
 	editor_show_message(e, "Cut text.");
 }
@@ -738,17 +962,71 @@ UserFunc uf_paste = {
 
 void
 paste(Editor *e) {
+	Buffer *b = e->current_buffer;
+	size_t offset = b->position.offset;
+
 	if (e->copy_bytes_written == 0) {
 		editor_show_message(e, "No text to paste.");
 		return;
 	}
-	size_t i = 0;
-	while (i < e->copy_bytes_written) {
-		size_t s = utf8_byte_size(e->copy_buffer[i]);
-		strncpy(e->string_arg, e->copy_buffer + i, s);
-		insert(e);
-		i += s;
+	if (!gbf_reserve(b->gbuf, e->copy_bytes_written)) {
+		editor_show_message(e, "Paste failed (Out of memory)");
+		return;
+	}
+	if (!gbf_insert_n(b->gbuf, e->copy_buffer, e->copy_bytes_written, offset)) {
+		editor_show_message(e, "Paste failed (Out of memory)");
+		return;
+	}
+	if (b->undo != NULL) {
+		undo_insert(b->undo, offset, e->copy_buffer, e->copy_bytes_written);
+	}
+	move_to_offset(b, offset + e->copy_bytes_written);
+	b->has_changed = true;
+	b->redraw = true;
+}
+
+UserFunc uf_undo = {
+	.type = USER_FUNC_DELETION,
+	.name = "undo",
+	.description = "Undo the last edit.",
+	.func = undo
+};
+
+void
+undo(Editor *e) {
+	Buffer *b = e->current_buffer;
+	size_t offset;
+
+	if (b->undo == NULL || !undo_undo(b->undo, b->gbuf, &offset)) {
+		editor_show_message(e, "Nothing to undo.");
+		return;
+	}
+	b->region_type = REGION_OFF;
+	move_to_offset(b, offset);
+	b->has_changed = true;
+	b->redraw = true;
+}
+
+UserFunc uf_redo = {
+	.type = USER_FUNC_INSERTION,
+	.name = "redo",
+	.description = "Redo the last undone edit.",
+	.func = redo
+};
+
+void
+redo(Editor *e) {
+	Buffer *b = e->current_buffer;
+	size_t offset;
+
+	if (b->undo == NULL || !undo_redo(b->undo, b->gbuf, &offset)) {
+		editor_show_message(e, "Nothing to redo.");
+		return;
 	}
+	b->region_type = REGION_OFF;
+	move_to_offset(b, offset);
+	b->has_changed = true;
+	b->redraw = true;
 }
 
 UserFunc uf_macro_start_stop = {
@@ -816,6 +1094,15 @@ macro_play(Editor *e) {
 		macro_start_stop(e);
 	}
 	for (MacroElement *me = e->macro_info.first; me != NULL; me = me->next) {
+		// The macro may have switched to a buffer, that is not loaded yet.
+		if (!buffer_load(e, e->current_buffer)) {
+			return;
+		}
+		if (e->current_buffer->loader != NULL && (me->uf->type == USER_FUNC_INSERTION ||
+			me->uf->type == USER_FUNC_DELETION)) {
+			editor_show_message(e, "The file is still loading");
+			return;
+		}
 		if (me->text != NULL) {
 			e->string_arg = chunk_list_get_item(me->text);
 		}
@@ -934,13 +1221,14 @@ prefix_draw_func(Editor *e) {
 		display_clear_window(*b->win);
 		display_show_string(*b->win, 0, 0, "Ctrl+B Switch Buffer");
 		display_show_string(*b->win, 1, 0, "Ctrl+C Cancel");
-		display_show_string(*b->win, 2, 0, "Ctrl+K Close Buffer");
-		display_show_string(*b->win, 3, 0, "Ctrl+N Previous Buffer");
-		display_show_string(*b->win, 4, 0, "Ctrl+O Open File");
-		display_show_string(*b->win, 5, 0, "Ctrl+P Next Buffer");
-		display_show_string(*b->win, 6, 0, "Ctrl+Q Quit");
-		display_show_string(*b->win, 7, 0, "Ctrl+S Save");
-		display_show_string(*b->win, 8, 0, "Ctrl+W Save As");
+		display_show_string(*b->win, 2, 0, "Ctrl+F Follow File");
+		display_show_string(*b->win, 3, 0, "Ctrl+K Close Buffer");
+		display_show_string(*b->win, 4, 0, "Ctrl+N Previous Buffer");
+		display_show_string(*b->win, 5, 0, "Ctrl+O Open File");
+		display_show_string(*b->win, 6, 0, "Ctrl+P Next Buffer");
+		display_show_string(*b->win, 7, 0, "Ctrl+Q Quit");
+		display_show_string(*b->win, 8, 0, "Ctrl+S Save");
+		display_show_string(*b->win, 9, 0, "Ctrl+W Save As");
 	} else {
 		display_show_string(*b->messagebar_win, 0, 0, "Prefix");
 		display_move_cursor(*b->win, b->position.line - 1, b->position.column - 1);
@@ -974,6 +1262,7 @@ make_prefix_buffer(Editor *e) {
 
 	buffer_bind_key(buf, KEY_CTRL_B, &uf_switch_buffer);
 	buffer_bind_key(buf, KEY_CTRL_C, &uf_cancel);
+	buffer_bind_key(buf, KEY_CTRL_F, &uf_follow);
 	buffer_bind_key(buf, KEY_CTRL_K, &uf_close_buffer);
 	buffer_bind_key(buf, KEY_CTRL_N, &uf_previous_buffer);
 	buffer_bind_key(buf, KEY_CTRL_O, &uf_openfile);
@@ -1079,6 +1368,21 @@ switch_buffer(Editor *e) {
 	}
 }
 
+// Starts saving the current buffer in the background.
+static void
+start_save(Editor *e) {
+	Buffer *b = e->current_buffer;
+
+	b->save = save_start(b);
+	if (b->save == NULL) {
+		editor_show_message(e, "Cannot save.");
+		return;
+	}
+	b->has_changed = false;
+	b->redraw = true;
+	editor_show_message(e, "Saving...");
+}
+
 UserFunc uf_save = {
 	.type = USER_FUNC_MANAGEMENT,
 	.name = "save",
@@ -1090,18 +1394,31 @@ void
 save(Editor *e) {
 	Buffer *b = e->current_buffer;
 
+	if (b->loader != NULL) {
+		editor_show_message(e, "The file is still loading");
+		return;
+	} else if (b->save != NULL) {
+		editor_show_message(e, "The file is still being saved");
+		return;
+	}
+
 	if (b->filename == NULL) {
 		save_as(e);
 		return;
 	}
 	size_t length = gbf_text_length(b->gbuf);
-	FILE *fd;
 
 	if (gbf_at(b->gbuf, length - 1) != '\n') {
 		MenuResult force = menu_yes_no(e, "Force newline? (yes/no)");
 
 		if (force == MENU_YES) {
-			gbf_insert(b->gbuf, "\n", length);
+			if (!gbf_insert_n(b->gbuf, "\n", 1, length)) {
+				editor_show_message(e, "Out of memory");
+				return;
+			}
+			if (b->undo != NULL) {
+				undo_insert(b->undo, length, "\n", 1);
+			}
 			length++;
 		} else {
 			editor_show_message(e, "Cancel");
@@ -1109,20 +1426,7 @@ save(Editor *e) {
 		}
 	}
 
-	if((fd = fopen(b->filename, "w")) == NULL ) {
-		editor_show_message(e, "Cannot save.");
-		return;
-	}
-
-	char *text = gbf_text(b->gbuf);
-	if (fwrite(text, 1, length, fd) != length) {
-		editor_show_message(e, "Cannot save.");
-	} else {
-		b->has_changed = false;
-		editor_show_message(e, "Wrote file.");
-	}
-	fclose(fd);
-	free(text);
+	start_save(e);
 }
 
 UserFunc uf_save_as = {
@@ -1135,6 +1439,14 @@ UserFunc uf_save_as = {
 void
 save_as(Editor *e) {
 	Buffer *b = e->current_buffer;
+
+	if (b->loader != NULL) {
+		editor_show_message(e, "The file is still loading");
+		return;
+	} else if (b->save != NULL) {
+		editor_show_message(e, "The file is still being saved");
+		return;
+	}
 	char *file = menu_choose_file(e);
 
 	if (file == NULL) {
@@ -1153,12 +1465,18 @@ save_as(Editor *e) {
 	}
 
 	size_t length = gbf_text_length(b->gbuf);
-	FILE *fd;
 
 	if (gbf_at(b->gbuf, length - 1) != '\n') {
 		MenuResult force = menu_yes_no(e, "Force newline? ");
 		if (force == MENU_YES) {
-			gbf_insert(b->gbuf, "\n", length);
+			if (!gbf_insert_n(b->gbuf, "\n", 1, length)) {
+				editor_show_message(e, "Out of memory");
+				free(file);
+				return;
+			}
+			if (b->undo != NULL) {
+				undo_insert(b->undo, length, "\n", 1);
+			}
 			length++;
 		} else if (force == MENU_CANCEL){
 			editor_show_message(e, "Cancel");
@@ -1166,26 +1484,20 @@ save_as(Editor *e) {
 			return;
 		}
 	}
+	buffer_stop_follow(b);
+	if (b->journal != NULL) {
+		// The journal belongs to the old file. The new file gets one, when it is written.
+		gbf_set_journal(b->gbuf, NULL);
+		journal_free(&b->journal, true);
+	}
 	if (b->filename != NULL) {
 		free(b->filename);
 	}
 	b->filename = file;
+	// The file under the new name is written completely.
+	b->file_mtime = -1;
 
-	if((fd = fopen(b->filename, "w")) == NULL ) {
-		editor_show_message(e, "Cannot save.");
-		free(file);
-		return;
-	}
-
-	char *text = gbf_text(b->gbuf);
-	if (fwrite(text, 1, length, fd) != length) {
-		editor_show_message(e, "Cannot save.");
-	} else {
-		b->has_changed = false;
-		editor_show_message(e, "Wrote file.");
-	}
-	fclose(fd);
-	free(text);
+	start_save(e);
 }
 
 UserFunc uf_close_buffer = {
@@ -1198,7 +1510,13 @@ UserFunc uf_close_buffer = {
 void
 close_buffer(Editor *e) {
 	MenuResult r = false;
-	if (e->current_buffer->has_changed) {
+	Buffer *b = e->current_buffer;
+
+	// Edits during a save, or a failed save, leave the buffer changed.
+	if (b->save != NULL && !save_finish(&b->save, b)) {
+		editor_show_message(e, "Cannot save.");
+	}
+	if (b->has_changed) {
 		r = menu_yes_no(e, "Buffer has changed. Save? (yes/no)");
 		if (r == MENU_YES) {
 			save(e);
@@ -1208,6 +1526,12 @@ close_buffer(Editor *e) {
 			return;
 		}
 	}
+	// The buffer is closed, when it is written.
+	if (b->save != NULL && !save_finish(&b->save, b)) {
+		editor_show_message(e, "Cannot save.");
+		b->cancel = true;
+		return;
+	}
 	buffer_free(&e->current_buffer);
 	if (e->current_buffer == NULL) {
 		quit(e);
@@ -1230,5 +1554,37 @@ quit(Editor *e) {
 			return;
 		}
 	}
+	buffer_stop_preloads(e);
 	exit(0);
 }
+
+UserFunc uf_follow = {
+	.type = USER_FUNC_MANAGEMENT,
+	.name = "follow",
+	.description = "Follow the file: Show text, that is appended to it.",
+	.func = follow
+};
+
+void
+follow(Editor *e) {
+	Buffer *b = e->current_buffer;
+
+	if (b->follow) {
+		buffer_stop_follow(b);
+		editor_show_message(e, "Stopped following.");
+		return;
+	} else if (b->filename == NULL) {
+		editor_show_message(e, "The buffer has no file");
+		return;
+	} else if (b->loader != NULL) {
+		editor_show_message(e, "The file is still loading");
+		return;
+	} else if (b->file_mtime == -1 || !buffer_start_follow(b)) {
+		editor_show_message(e, "Cannot follow the file");
+		return;
+	}
+	// Like tail -f, this starts at the end.
+	move_to_offset(b, gbf_text_length(b->gbuf));
+	b->redraw = true;
+	editor_show_message(e, "Following the file.");
+}
@@ -3,6 +3,7 @@
 
 
 struct Editor;
+struct Buffer;
 
 typedef enum {
 	USER_FUNC_MOVEMENT,
@@ -41,9 +42,12 @@ void isearch_next(struct Editor *e);
 void isearch_previous(struct Editor *e);
 void region_start_stop(struct Editor *e);
 void region_off(struct Editor *e);
+void stop(struct Editor *e);
 void copy(struct Editor *e);
 void cut(struct Editor *e);
 void paste(struct Editor *e);
+void undo(struct Editor *e);
+void redo(struct Editor *e);
 void macro_start_stop(struct Editor *e);
 void macro_append(struct Editor *e, UserFunc *uf, char *arg);
 void macro_play(struct Editor *e);
@@ -61,6 +65,8 @@ void save(struct Editor *e);
 void save_as(struct Editor *e);
 void close_buffer(struct Editor *e);
 void quit(struct Editor *e);
+void follow(struct Editor *e);
+void move_to_offset(struct Buffer *b, size_t offset);
 
 
 extern UserFunc uf_insert;
@@ -85,9 +91,12 @@ extern UserFunc uf_isearch_next;
 extern UserFunc uf_isearch_previous;
 extern UserFunc uf_region_start_stop;
 extern UserFunc uf_region_off;
+extern UserFunc uf_stop;
 extern UserFunc uf_copy;
 extern UserFunc uf_cut;
 extern UserFunc uf_paste;
+extern UserFunc uf_undo;
+extern UserFunc uf_redo;
 extern UserFunc uf_macro_start_stop;
 extern UserFunc uf_macro_play;
 extern UserFunc uf_next_buffer;
@@ -104,6 +113,7 @@ extern UserFunc uf_save;
 extern UserFunc uf_save_as;
 extern UserFunc uf_close_buffer;
 extern UserFunc uf_quit;
+extern UserFunc uf_follow;
 
 
 #endif
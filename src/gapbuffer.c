@@ -1,9 +1,16 @@
+#include <errno.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
+#include <unistd.h>
 
 #include "gapbuffer.h"
+#include "journal.h"
+#include "line_index.h"
+#include "piece_table.h"
+#include "scan.h"
 #include "static.h"
 
 
@@ -12,6 +19,10 @@ struct GapBuffer {
 	char *gap; // A pointer to the first byte in the gap.
 	char *second; // A pointer to the first byte after the gap.
 	char *end; // A pointer to the last byte in the gap buffer. This is always '\0'.
+	LineIndex *lines; // An index of the lines in a prefix of the text or NULL.
+	PieceTable *pieces; // The text, if it is stored in a piece table, or NULL.
+	size_t changed; // The first changed byte since gbf_mark_saved or SIZE_MAX.
+	Journal *journal; // The journal, that records the edits, or NULL.
 };
 
 STATIC size_t gap_length(GapBuffer *gbuf);
@@ -19,11 +30,26 @@ STATIC size_t first_part_length(GapBuffer *gbuf);
 STATIC size_t second_part_length(GapBuffer *gbuf);
 STATIC size_t max_offset(GapBuffer *gbuf);
 STATIC void move_gap(GapBuffer *gbuf, size_t offset);
-STATIC void expand_gap(GapBuffer *gbuf);
+STATIC bool resize_gap(GapBuffer *gbuf, size_t glen);
+STATIC bool expand_gap(GapBuffer *gbuf, size_t bytes);
+STATIC void shrink_gap(GapBuffer *gbuf);
+STATIC bool index_lines(GapBuffer *gbuf, size_t offset, size_t line);
+STATIC size_t count_line_at(GapBuffer *gbuf, size_t offset);
+STATIC bool find_line_start(GapBuffer *gbuf, size_t line, size_t *offset);
+STATIC bool matches_at(GapBuffer *gbuf, size_t offset, char *pattern, size_t plen);
 
 STATIC size_t INITIAL_SIZE = 8;
-STATIC size_t GAP_INCREMENT = 6;
 STATIC size_t MIN_GAP_SIZE = 5;
+// When the gap is expanded, it grows by GROWTH_PERCENT percent of the text length.
+// This makes a sequence of inserts amortized O(1).
+STATIC size_t GROWTH_PERCENT = 50;
+// The gap is shrunk, when it is more than SHRINK_FACTOR times larger than the text
+// and the buffer is larger than MIN_SHRINK_SIZE.
+STATIC size_t SHRINK_FACTOR = 4;
+STATIC size_t MIN_SHRINK_SIZE = 4096;
+// The line index is built lazily. It is extended by at most INDEX_STEP bytes at
+// a time, until it covers the requested offset or line.
+STATIC size_t INDEX_STEP = 1 << 20;
 
 // Returns the length of the gap.
 STATIC size_t
@@ -48,6 +74,9 @@ second_part_length(GapBuffer *gbuf) {
 // Returns the maximum valid offset in gbuf.
 STATIC size_t
 max_offset(GapBuffer *gbuf) {
+	if (gbuf->pieces != NULL) {
+		return piece_table_length(gbuf->pieces);
+	}
 	return second_part_length(gbuf) + first_part_length(gbuf);
 }
 
@@ -67,39 +96,187 @@ gbf_new(void) {
 	gbuf->second = gbuf->first + INITIAL_SIZE;
 	gbuf->end = gbuf->first + INITIAL_SIZE;
 	*(gbuf->end) = '\0';
+	gbuf->lines = NULL;
+	gbuf->pieces = NULL;
+	gbuf->changed = SIZE_MAX;
+	gbuf->journal = NULL;
+
+	return gbuf;
+}
 
+GapBuffer *
+gbf_new_piece_table(void) {
+	GapBuffer *gbuf;
+
+	gbuf = malloc(sizeof(*gbuf));
+	if (gbuf == NULL) {
+		return NULL;
+	}
+	memset(gbuf, 0, sizeof(*gbuf));
+	gbuf->changed = SIZE_MAX;
+	gbuf->pieces = piece_table_new();
+	if (gbuf->pieces == NULL) {
+		free(gbuf);
+		return NULL;
+	}
 	return gbuf;
 }
 
+bool
+gbf_map_file(GapBuffer *gbuf, int fd, size_t size) {
+	if (gbuf->pieces == NULL) {
+		return false;
+	}
+	return piece_table_map_file(gbuf->pieces, fd, size);
+}
+
+bool
+gbf_is_mapped(GapBuffer *gbuf) {
+	return gbuf->pieces != NULL && piece_table_is_mapped(gbuf->pieces);
+}
+
+GapBuffer *
+gbf_snapshot(GapBuffer *gbuf) {
+	GapBuffer *copy;
+	size_t len;
+	char *chunk;
+
+	if (gbuf->pieces != NULL) {
+		copy = malloc(sizeof(*copy));
+		if (copy == NULL) {
+			return NULL;
+		}
+		memset(copy, 0, sizeof(*copy));
+		copy->changed = SIZE_MAX;
+		copy->pieces = piece_table_snapshot(gbuf->pieces);
+		if (copy->pieces == NULL) {
+			free(copy);
+			return NULL;
+		}
+		return copy;
+	}
+
+	copy = gbf_new();
+	if (copy == NULL || !gbf_reserve(copy, max_offset(gbuf))) {
+		gbf_free(&copy);
+		return NULL;
+	}
+	for (size_t off = 0; (len = gbf_chunk(gbuf, off, &chunk)) > 0; off += len) {
+		gbf_insert_n(copy, chunk, len, off);
+	}
+	return copy;
+}
+
 void
 gbf_free(GapBuffer **gbuf) {
 	if (*gbuf == NULL) {
 		return;
 	}
 	free((*gbuf)->first);
+	line_index_free(&(*gbuf)->lines);
+	piece_table_free(&(*gbuf)->pieces);
 	free(*gbuf);
 	*gbuf = NULL;
 }
 
 char *
 gbf_text(GapBuffer *gbuf) {
-	size_t flen = first_part_length(gbuf);
-	size_t slen = second_part_length(gbuf);
-	char *str = malloc(flen + slen + 1);
+	size_t len = max_offset(gbuf);
+	char *str = malloc(len + 1);
 
 	if (str == NULL) {
 		return NULL;
 	}
-	if (flen == 0) {
-		str[0] = '\0';
-	} else {
-		strncpy(str, gbuf->first, flen);
-		str[flen] = '\0';
+	gbf_text_n(gbuf, 0, len, str);
+	str[len] = '\0';
+
+	return str;
+}
+
+size_t
+gbf_text_n(GapBuffer *gbuf, size_t offset, size_t n, char *buffer) {
+	size_t flen;
+	size_t len = max_offset(gbuf);
+	size_t copied = 0;
+
+	if (offset >= len) {
+		return 0;
 	}
-	if (slen > 0) {
-		strcat(str, gbuf->second);
+	if (n > len - offset) {
+		n = len - offset;
 	}
-	return str;
+	if (gbuf->pieces != NULL) {
+		char *chunk;
+		size_t clen;
+
+		while (copied < n) {
+			clen = piece_table_chunk(gbuf->pieces, offset + copied, &chunk);
+			if (clen > n - copied) {
+				clen = n - copied;
+			}
+			memcpy(buffer + copied, chunk, clen);
+			copied += clen;
+		}
+		return n;
+	}
+	flen = first_part_length(gbuf);
+	if (offset < flen) {
+		copied = flen - offset;
+		if (copied > n) {
+			copied = n;
+		}
+		memcpy(buffer, gbuf->first + offset, copied);
+		offset += copied;
+	}
+	if (copied < n) {
+		memcpy(buffer + copied, gbuf->second + (offset - flen), n - copied);
+	}
+	return n;
+}
+
+size_t
+gbf_chunk(GapBuffer *gbuf, size_t offset, char **chunk) {
+	size_t flen;
+	size_t len = max_offset(gbuf);
+
+	if (offset >= len) {
+		*chunk = NULL;
+		return 0;
+	}
+	if (gbuf->pieces != NULL) {
+		return piece_table_chunk(gbuf->pieces, offset, chunk);
+	}
+	flen = first_part_length(gbuf);
+	if (offset < flen) {
+		*chunk = gbuf->first + offset;
+		return flen - offset;
+	}
+	*chunk = gbuf->second + (offset - flen);
+	return len - offset;
+}
+
+size_t
+gbf_chunk_reverse(GapBuffer *gbuf, size_t offset, char **chunk) {
+	size_t flen;
+	size_t len = max_offset(gbuf);
+
+	if (offset > len) {
+		offset = len;
+	}
+	if (offset == 0) {
+		*chunk = NULL;
+		return 0;
+	}
+	if (gbuf->pieces != NULL) {
+		return piece_table_chunk_reverse(gbuf->pieces, offset, chunk);
+	}
+	flen = first_part_length(gbuf);
+	if (offset <= flen) {
+		*chunk = gbuf->first;
+		return offset;
+	}
+	*chunk = gbuf->second;
+	return offset - flen;
 }
 
 // Moves gap to position off.
@@ -130,68 +307,275 @@ move_gap(GapBuffer *gbuf, size_t offset) {
 	}
 }
 
-// Expands the gap.
-STATIC void
-expand_gap(GapBuffer *gbuf) {
+// Resizes the gap to glen bytes. The text is not changed.
+// Returns false, if memory allocation fails.
+STATIC bool
+resize_gap(GapBuffer *gbuf, size_t glen) {
 	size_t flen = first_part_length(gbuf);
 	size_t slen = second_part_length(gbuf);
-	size_t glen = gap_length(gbuf);
-	size_t new_size = (gbuf->end - gbuf->first) + GAP_INCREMENT + 1;
-	void *new = realloc(gbuf->first, new_size);
+	size_t old_glen = gap_length(gbuf);
+	size_t new_size = flen + glen + slen + 1;
+	char *new;
 
+	if (glen < old_glen) {
+		// Move the second part down, before the memory is released.
+		memmove(gbuf->gap + glen, gbuf->second, slen + 1);
+	}
+	new = realloc(gbuf->first, new_size);
 	if (new == NULL) {
-		// TOOO: handle error
-		exit(-1);
-	} else {
-		gbuf->first = new;
-		gbuf->gap = gbuf->first + flen;
-		gbuf->second = gbuf->gap + glen + GAP_INCREMENT;
-		gbuf->end = gbuf->second + slen;
-		if (slen != 0) {
-			memmove(gbuf->second, gbuf->gap + glen, slen);
+		if (glen < old_glen) {
+			// The old block is still valid, only the gap got smaller.
+			gbuf->second = gbuf->gap + glen;
+			gbuf->end = gbuf->second + slen;
 		}
-		*(gbuf->end) = '\0';
+		return false;
 	}
+	gbuf->first = new;
+	gbuf->gap = gbuf->first + flen;
+	if (glen > old_glen) {
+		memmove(gbuf->gap + glen, gbuf->gap + old_glen, slen + 1);
+	}
+	gbuf->second = gbuf->gap + glen;
+	gbuf->end = gbuf->second + slen;
+	*(gbuf->end) = '\0';
+
+	return true;
 }
 
-void
+// Expands the gap, so at least bytes bytes can be inserted.
+// Returns false, if memory allocation fails.
+STATIC bool
+expand_gap(GapBuffer *gbuf, size_t bytes) {
+	size_t needed = max_offset(gbuf) + bytes;
+	size_t glen = bytes + MIN_GAP_SIZE + 1 + needed * GROWTH_PERCENT / 100;
+
+	return resize_gap(gbuf, glen);
+}
+
+// Shrinks the gap, if it is much larger than the text.
+STATIC void
+shrink_gap(GapBuffer *gbuf) {
+	size_t len = max_offset(gbuf);
+	size_t glen = gap_length(gbuf);
+
+	if (len + glen < MIN_SHRINK_SIZE || glen / SHRINK_FACTOR <= len) {
+		return;
+	}
+	// A failed shrink leaves a valid buffer, so the result can be ignored.
+	resize_gap(gbuf, MIN_GAP_SIZE + 1 + len * GROWTH_PERCENT / 100);
+}
+
+bool
+gbf_reserve(GapBuffer *gbuf, size_t bytes) {
+	if (gbuf->pieces != NULL) {
+		return piece_table_reserve(gbuf->pieces, bytes);
+	}
+	if (gap_length(gbuf) > MIN_GAP_SIZE + bytes) {
+		return true;
+	}
+	return resize_gap(gbuf, bytes + MIN_GAP_SIZE + 1);
+}
+
+bool
 gbf_insert(GapBuffer *gbuf, char *s, size_t offset) {
-	size_t len = strlen(s);
+	return gbf_insert_n(gbuf, s, strlen(s), offset);
+}
+
+bool
+gbf_insert_n(GapBuffer *gbuf, char *s, size_t len, size_t offset) {
+	if (offset > max_offset(gbuf)) {
+		offset = max_offset(gbuf);
+	}
+	if (gbuf->pieces != NULL) {
+		if (!piece_table_insert(gbuf->pieces, s, len, offset)) {
+			return false;
+		}
+	} else {
+		move_gap(gbuf, offset);
+		if (gap_length(gbuf) <= MIN_GAP_SIZE + len && !expand_gap(gbuf, len)) {
+			return false;
+		}
+		memcpy(gbuf->gap, s, len);
+		gbuf->gap += len;
+	}
+	if (len > 0 && offset < gbuf->changed) {
+		gbuf->changed = offset;
+	}
+	if (gbuf->journal != NULL) {
+		journal_insert(gbuf->journal, offset, s, len);
+	}
+
+	// Text after the indexed prefix is indexed, when it is needed.
+	if (gbuf->lines != NULL && offset < line_index_length(gbuf->lines)) {
+		if (!line_index_insert(gbuf->lines, offset, s, len)) {
+			line_index_free(&gbuf->lines);
+		}
+	}
+	return true;
+}
+
+bool
+gbf_read(GapBuffer *gbuf, int fd, size_t len, size_t offset, size_t *bytes) {
+	char *text = NULL;
 
+	*bytes = 0;
 	if (offset > max_offset(gbuf)) {
 		offset = max_offset(gbuf);
 	}
+	if (gbuf->pieces != NULL) {
+		if (!piece_table_read(gbuf->pieces, fd, len, offset, bytes, &text)) {
+			return false;
+		}
+	} else {
+		ssize_t n;
+
+		move_gap(gbuf, offset);
+		if (gap_length(gbuf) <= MIN_GAP_SIZE + len &&
+			!resize_gap(gbuf, len + MIN_GAP_SIZE + 1)) {
+			errno = ENOMEM;
+			return false;
+		}
+		do {
+			n = read(fd, gbuf->gap, len);
+		} while (n == -1 && errno == EINTR);
+		if (n == -1) {
+			return false;
+		}
+		text = gbuf->gap;
+		gbuf->gap += n;
+		*bytes = n;
+	}
+
+	if (*bytes > 0 && offset < gbuf->changed) {
+		gbuf->changed = offset;
+	}
+	if (gbuf->journal != NULL) {
+		journal_insert(gbuf->journal, offset, text, *bytes);
+	}
+	if (*bytes > 0 && gbuf->lines != NULL && offset < line_index_length(gbuf->lines)) {
+		if (!line_index_insert(gbuf->lines, offset, text, *bytes)) {
+			line_index_free(&gbuf->lines);
+		}
+	}
+	return true;
+}
+
+char *
+gbf_write_begin(GapBuffer *gbuf, size_t offset, size_t len) {
+	if (gbuf->pieces != NULL) {
+		return piece_table_write_begin(gbuf->pieces, len);
+	}
 	move_gap(gbuf, offset);
-	while (gap_length(gbuf) <= MIN_GAP_SIZE + len) {
-		expand_gap(gbuf);
+	// Repeated calls, for example while reading a stream, are amortized O(1).
+	if (gap_length(gbuf) <= MIN_GAP_SIZE + len &&
+		!resize_gap(gbuf, len + MIN_GAP_SIZE + 1 + (max_offset(gbuf) + len) * GROWTH_PERCENT / 100)) {
+		return NULL;
+	}
+	return gbuf->gap;
+}
+
+bool
+gbf_write_commit(GapBuffer *gbuf, size_t offset, size_t len) {
+	char *text;
+
+	if (len == 0) {
+		return true;
+	}
+	if (gbuf->pieces != NULL) {
+		text = piece_table_write_commit(gbuf->pieces, offset, len);
+		if (text == NULL) {
+			return false;
+		}
+	} else {
+		// gbf_write_begin moved the gap to offset.
+		text = gbuf->gap;
+		gbuf->gap += len;
+	}
+	if (offset < gbuf->changed) {
+		gbuf->changed = offset;
 	}
-	while (*s) {
-		*(gbuf->gap++) = *s++;
+	if (gbuf->journal != NULL) {
+		journal_insert(gbuf->journal, offset, text, len);
 	}
+
+	if (gbuf->lines != NULL && offset < line_index_length(gbuf->lines)) {
+		if (!line_index_insert(gbuf->lines, offset, text, len)) {
+			line_index_free(&gbuf->lines);
+		}
+	}
+	return true;
 }
 
-void
+bool
 gbf_delete(GapBuffer *gbuf, size_t offset, size_t bytes) {
 	size_t len;
 
 	if (offset > max_offset(gbuf)) {
-		return;
-	}
-	move_gap(gbuf, offset);
-	if (gbuf->second == gbuf->end) {
-		return;
+		return true;
 	}
-	len = second_part_length(gbuf);
+	len = max_offset(gbuf) - offset;
 	if (len < bytes) {
 		bytes = len;
 	}
-	gbuf->second += bytes;
+	if (bytes == 0) {
+		return true;
+	}
+	if (gbuf->pieces != NULL) {
+		if (!piece_table_delete(gbuf->pieces, offset, bytes)) {
+			return false;
+		}
+	} else {
+		move_gap(gbuf, offset);
+		gbuf->second += bytes;
+		shrink_gap(gbuf);
+	}
+	if (offset < gbuf->changed) {
+		gbuf->changed = offset;
+	}
+	if (gbuf->journal != NULL) {
+		journal_delete(gbuf->journal, offset, bytes);
+	}
+
+	if (gbuf->lines != NULL && offset < line_index_length(gbuf->lines)) {
+		len = line_index_length(gbuf->lines) - offset;
+		line_index_delete(gbuf->lines, offset, bytes < len ? bytes : len);
+	}
+	return true;
 }
 
 void
 gbf_clear(GapBuffer *gbuf) {
-	gbuf->gap = gbuf->first;
-	gbuf->second = gbuf->end;
+	if (gbuf->journal != NULL) {
+		journal_delete(gbuf->journal, 0, max_offset(gbuf));
+	}
+	if (gbuf->pieces != NULL) {
+		piece_table_clear(gbuf->pieces);
+	} else {
+		gbuf->gap = gbuf->first;
+		gbuf->second = gbuf->end;
+		shrink_gap(gbuf);
+	}
+	line_index_free(&gbuf->lines);
+	gbuf->changed = 0;
+}
+
+bool
+gbf_first_change(GapBuffer *gbuf, size_t *offset) {
+	if (gbuf->changed == SIZE_MAX) {
+		return false;
+	}
+	*offset = gbuf->changed;
+	return true;
+}
+
+void
+gbf_mark_saved(GapBuffer *gbuf) {
+	gbuf->changed = SIZE_MAX;
+}
+
+void
+gbf_set_journal(GapBuffer *gbuf, Journal *j) {
+	gbuf->journal = j;
 }
 
 char
@@ -199,6 +583,10 @@ gbf_at(GapBuffer *gbuf, size_t offset) {
 	if (offset > max_offset(gbuf)) {
 		return '\0';
 	}
+	if (gbuf->pieces != NULL) {
+		char *chunk;
+		return piece_table_chunk(gbuf->pieces, offset, &chunk) > 0 ? *chunk : '\0';
+	}
 	if (gbuf->first + offset < gbuf->gap) {
 		return *(gbuf->first + offset);
 	} else {
@@ -208,24 +596,80 @@ gbf_at(GapBuffer *gbuf, size_t offset) {
 
 void
 gbf_get_line(GapBuffer *gbuf, size_t offset, char *buffer) {
-	size_t i = 0;
-	size_t start = offset;
+	size_t start = 0;
+	size_t end = max_offset(gbuf);
 
-	if (start != 0) {
-		do {
-			start--;
-		} while (start > 0 && gbf_at(gbuf, start) != '\n');
-	}
-	if (gbf_at(gbuf, start) == '\n') {
+	if (gbf_prev_newline(gbuf, offset, &start)) {
 		start++;
 	}
+	gbf_next_newline(gbuf, start, &end);
+	buffer[gbf_text_n(gbuf, start, end - start, buffer)] = '\0';
+}
 
-	while (gbf_at(gbuf, start) != '\n' && gbf_at(gbuf, start) != '\0') {
-		buffer[i] = gbf_at(gbuf, start);
-		start++;
-		buffer++;
+bool
+gbf_next_newline(GapBuffer *gbuf, size_t offset, size_t *found) {
+	size_t len;
+	char *chunk;
+	char *nl;
+
+	for (; (len = gbf_chunk(gbuf, offset, &chunk)) > 0; offset += len) {
+		if ((nl = scan_byte(chunk, len, '\n')) != NULL) {
+			*found = offset + (nl - chunk);
+			return true;
+		}
 	}
-	buffer[i] = '\0';
+	return false;
+}
+
+bool
+gbf_prev_newline(GapBuffer *gbuf, size_t offset, size_t *found) {
+	size_t len;
+	char *chunk;
+	char *nl;
+
+	if (offset > max_offset(gbuf)) {
+		offset = max_offset(gbuf);
+	}
+	for (; (len = gbf_chunk_reverse(gbuf, offset, &chunk)) > 0; offset -= len) {
+		if ((nl = scan_byte_reverse(chunk, len, '\n')) != NULL) {
+			*found = offset - len + (nl - chunk);
+			return true;
+		}
+	}
+	return false;
+}
+
+size_t
+gbf_count_newlines(GapBuffer *gbuf, size_t start, size_t end) {
+	size_t count = 0;
+	size_t len;
+	char *chunk;
+
+	for (; start < end && (len = gbf_chunk(gbuf, start, &chunk)) > 0; start += len) {
+		if (len > end - start) {
+			len = end - start;
+		}
+		count += scan_count(chunk, len, '\n');
+	}
+	return count;
+}
+
+bool
+gbf_nth_newline(GapBuffer *gbuf, size_t offset, size_t n, size_t *found) {
+	size_t len;
+	char *chunk;
+	char *nl;
+
+	if (n == 0) {
+		return false;
+	}
+	for (; (len = gbf_chunk(gbuf, offset, &chunk)) > 0; offset += len) {
+		if ((nl = scan_nth(chunk, len, '\n', &n)) != NULL) {
+			*found = offset + (nl - chunk);
+			return true;
+		}
+	}
+	return false;
 }
 
 size_t
@@ -233,114 +677,174 @@ gbf_text_length(GapBuffer *gbuf) {
 	return max_offset(gbuf);
 }
 
-STATIC void
-make_lps_table(char *pattern, size_t plen, size_t array[]) {
-	size_t len = 0;
-	size_t i = 1;
-
-	array[0] = 0;
-
-	while (i < plen) {
-		if (pattern[i] == pattern[len]) {
-			array[i] = len + 1;
-			i++;
-			len++;
-		} else {
-			if (len != 0) {
-				len = array[len - 1];
-			} else {
-				array[i] = 0;
-				i++;
-			}
+// Extends the line index, until it contains offset and the start of line
+// (counted from 0), or until the whole text is indexed. Returns false, if
+// memory allocation fails. Then the text has no index.
+STATIC bool
+index_lines(GapBuffer *gbuf, size_t offset, size_t line) {
+	size_t len = max_offset(gbuf);
+	size_t indexed;
+	char *chunk;
+
+	if (gbuf->lines == NULL) {
+		gbuf->lines = line_index_new();
+		if (gbuf->lines == NULL) {
+			return false;
 		}
 	}
+	indexed = line_index_length(gbuf->lines);
+	while (indexed < len && (indexed <= offset || line_index_lines(gbuf->lines) <= line)) {
+		size_t n = gbf_chunk(gbuf, indexed, &chunk);
+		if (n > INDEX_STEP) {
+			n = INDEX_STEP;
+		}
+		if (!line_index_insert(gbuf->lines, indexed, chunk, n)) {
+			line_index_free(&gbuf->lines);
+			return false;
+		}
+		indexed += n;
+	}
+	return true;
+}
+
+// Finds the line containing offset without the index, like gbf_line_at.
+STATIC size_t
+count_line_at(GapBuffer *gbuf, size_t offset) {
+	if (offset > max_offset(gbuf)) {
+		offset = max_offset(gbuf);
+	}
+	return gbf_count_newlines(gbuf, 0, offset) + 1;
+}
+
+// Finds the start of a line without the index, like gbf_line_start.
+STATIC bool
+find_line_start(GapBuffer *gbuf, size_t line, size_t *offset) {
+	size_t nl;
+
+	if (line == 1) {
+		*offset = 0;
+		return true;
+	} else if (!gbf_nth_newline(gbuf, 0, line - 1, &nl)) {
+		return false;
+	}
+	*offset = nl + 1;
+	return true;
+}
+
+size_t
+gbf_line_at(GapBuffer *gbuf, size_t offset) {
+	if (!index_lines(gbuf, offset, 0)) {
+		// Without memory for the index, the lines are counted.
+		return count_line_at(gbuf, offset);
+	}
+	return line_index_line(gbuf->lines, offset) + 1;
 }
 
 bool
-gbf_search(GapBuffer *gbuf, char *pattern, size_t plen, size_t start, size_t *off) {
-	size_t table[plen];
-	size_t ti = start;
-	size_t pi = 0;
-	size_t text_length = gbf_text_length(gbuf);
+gbf_line_start(GapBuffer *gbuf, size_t line, size_t *offset) {
+	if (line == 0) {
+		return false;
+	}
+	if (!index_lines(gbuf, 0, line - 1)) {
+		return find_line_start(gbuf, line, offset);
+	}
+	if (line > line_index_lines(gbuf->lines)) {
+		return false;
+	}
+	*offset = line_index_offset(gbuf->lines, line - 1);
+	return true;
+}
 
-	make_lps_table(pattern, plen, table);
+// Checks, if the text at offset matches pattern. The text may span several chunks.
+STATIC bool
+matches_at(GapBuffer *gbuf, size_t offset, char *pattern, size_t plen) {
+	size_t len;
+	char *chunk;
 
-	while (ti < text_length) {
-		while (gbf_at(gbuf, ti) == pattern[pi]) {
-			ti++;
-			pi++;
-			if (pi == plen) {
-				*off = ti - plen;
-				return true;
-			}
+	while (plen > 0) {
+		len = gbf_chunk(gbuf, offset, &chunk);
+		if (len == 0) {
+			return false;
 		}
-		if (pi == 0) {
-			ti++;
-		} else {
-			pi = table[pi - 1];
+		if (len > plen) {
+			len = plen;
 		}
+		if (memcmp(chunk, pattern, len) != 0) {
+			return false;
+		}
+		offset += len;
+		pattern += len;
+		plen -= len;
 	}
-	return false;
+	return true;
 }
 
-STATIC void
-make_lps_table_reverse(char *pattern, size_t plen, size_t array[]) {
-	size_t last = plen - 1;
-	size_t len = last;
-	size_t i = last - 1;
-
-	array[last] = len;
-
-	while (true) {
-		if (pattern[i] == pattern[len]) {
-			array[i] = len - 1;
-			if (i == 0) {
-				return;
-			}
-			i--;
-			len--;
-		} else {
-			if (len != last) {
-				len = array[len + 1];
-			} else {
-				array[i] = last;
-				if (i == 0) {
-					return;
-				}
-				i--;
+bool
+gbf_search(GapBuffer *gbuf, char *pattern, size_t plen, size_t start, size_t *off) {
+	size_t len;
+	char *chunk;
+	char *found;
+
+	if (plen == 0) {
+		return false;
+	}
+	for (; (len = gbf_chunk(gbuf, start, &chunk)) > 0; start += len) {
+		found = scan_string(chunk, len, pattern, plen);
+		if (found != NULL) {
+			*off = start + (found - chunk);
+			return true;
+		}
+
+		// Matches, that start in this chunk and end in the next one.
+		found = chunk + (len >= plen ? len - plen + 1 : 0);
+		while ((found = scan_byte(found, chunk + len - found, pattern[0])) != NULL) {
+			if (matches_at(gbuf, start + (found - chunk), pattern, plen)) {
+				*off = start + (found - chunk);
+				return true;
 			}
+			found++;
 		}
 	}
+	return false;
 }
 
 bool
 gbf_search_reverse(GapBuffer *gbuf, char *pattern, size_t plen, size_t start, size_t *off) {
-	size_t table[plen];
-	size_t ti = start;
-	size_t last = plen - 1;
-	size_t pi = last;
-
-	make_lps_table_reverse(pattern, plen, table);
+	size_t text_length = gbf_text_length(gbuf);
+	size_t limit;
+	size_t end;
+	size_t len;
+	char *chunk;
+	char *found;
 
-	while (true) {
-		while (gbf_at(gbuf, ti) == pattern[pi]) {
-			if (pi == 0) {
-				*off = ti;
+	if (plen == 0 || text_length == 0) {
+		return false;
+	}
+	if (start >= text_length) {
+		// The bytes after the text are not part of the text.
+		start = text_length - 1;
+	}
+	// Matches must end before limit.
+	limit = start + 1;
+
+	for (end = limit; (len = gbf_chunk_reverse(gbuf, end, &chunk)) > 0; end -= len) {
+		size_t base = end - len;
+
+		// Matches, that start in this chunk and end in a later one, start after
+		// all matches inside this chunk.
+		for (size_t i = len; end < limit && i > 0 && i + plen > len + 1; i--) {
+			size_t offset = base + i - 1;
+			if (chunk[i - 1] == pattern[0] && offset + plen <= limit &&
+				matches_at(gbuf, offset, pattern, plen)) {
+				*off = offset;
 				return true;
 			}
-			if (ti == 0) {
-				return false;
-			}
-			ti--;
-			pi--;
 		}
-		if (pi == last) {
-			if (ti == 0) {
-				return false;
-			}
-			ti--;
-		} else {
-			pi = table[pi + 1];
+
+		found = scan_string_reverse(chunk, len, pattern, plen);
+		if (found != NULL) {
+			*off = base + (found - chunk);
+			return true;
 		}
 	}
 	return false;
@@ -12,31 +12,171 @@
 /// \endcode
 ///
 /// TODO Describe what a gapbuffer is and how it works.
+///
+/// When the gap is too small for an insert, the buffer grows by a fraction
+/// of the text length, so inserts are amortized O(1). When a delete leaves a gap
+/// that is much larger than the text, the memory is handed back.
+///
+/// The GapBuffer keeps an index of the lines in the text (see line_index.h), so
+/// lines can be found in O(log n). The index is built on demand and only as far
+/// as lookups reach into the text. Inserts and deletes update it incrementally.
 
 /// A gap buffer.
 typedef struct GapBuffer GapBuffer;
 
+/// A journal of the edits (see journal.h).
+struct Journal;
+
 /// gbf_new creates a new GapBuffer.
 /// \return An empty GapBuffer. The GapBuffer needs to be freed with gbf_free.
 /// If memory allocation fails, the function will return NULL.
 GapBuffer *gbf_new(void);
 
+/// gbf_new_piece_table creates a new GapBuffer, that stores its text in a
+/// piece table (see piece_table.h) instead of a single block of memory.
+/// All gbf_* functions work on it. Edits do not move the text, so this is
+/// better suited for very large texts.
+/// \return An empty GapBuffer. The GapBuffer needs to be freed with gbf_free.
+/// If memory allocation fails, the function will return NULL.
+GapBuffer *gbf_new_piece_table(void);
+
+/// gbf_map_file maps a file read-only and makes it the text of an empty
+/// GapBuffer created by gbf_new_piece_table. The file is not read, its pages
+/// are loaded, when the text is accessed. Edits are stored on the heap.
+/// The file must not be truncated, while it is mapped (see gbf_is_mapped).
+/// \param gbuf An empty GapBuffer, that uses a piece table.
+/// \param fd A file descriptor opened for reading. It can be closed afterwards.
+/// \param size The size of the file.
+/// \return true on success, false if gbuf is not an empty piece table
+///         or if the file cannot be mapped.
+bool gbf_map_file(GapBuffer *gbuf, int fd, size_t size);
+
+/// gbf_is_mapped checks, if the text may refer to a mapped file.
+/// \param gbuf A GapBuffer.
+/// \return true if a file is mapped, false otherwise.
+bool gbf_is_mapped(GapBuffer *gbuf);
+
+/// gbf_snapshot creates a read-only copy of the text, for example to write it
+/// on another thread, while the text is edited. If the text is stored in a
+/// piece table, the copy shares the text (see piece_table_snapshot) and gbuf
+/// must not be cleared or freed, while the copy is used. Otherwise the text
+/// is copied.
+/// \param gbuf A GapBuffer.
+/// \return A new GapBuffer or NULL, if out of memory.
+///         The copy needs to be freed with gbf_free.
+GapBuffer *gbf_snapshot(GapBuffer *gbuf);
+
 /// gbf_free frees a GapBuffer and sets gbuf to NULL.
 /// \param gbuf A GapBuffer.
 void gbf_free(GapBuffer **gbuf);
 
 /// gbf_text returns the contents of buf.
+/// The text may contain '\0' bytes, use gbf_text_length to get its length.
 /// \param gbuf A GapBuffer.
-/// \return A pointer to dynamically allocated memory containing the text or
-/// NULL on allocation failure.
+/// \return A pointer to dynamically allocated memory containing the text,
+/// followed by a '\0' byte, or NULL on allocation failure.
 char *gbf_text(GapBuffer *gbuf);
 
+/// gbf_text_n copies up to n bytes, starting at offset, into buffer.
+/// No terminating '\0' byte is added.
+/// \param gbuf A GapBuffer.
+/// \param offset The position of the first byte to copy.
+/// \param n The maximum number of bytes to copy.
+/// \param buffer An allocated buffer of at least n bytes.
+/// \return The number of bytes copied. This is less than n, if the text
+///         ends before offset + n.
+size_t gbf_text_n(GapBuffer *gbuf, size_t offset, size_t n, char *buffer);
+
+/// gbf_chunk gives direct access to the text, without copying it.
+/// The text is stored in (at most two) contiguous segments. This function returns
+/// the part of the segment, that starts at offset, so a range of text can be read by
+/// calling gbf_chunk until the range is covered:
+/// \code
+/// char *chunk;
+/// size_t len;
+///
+/// for (size_t off = start; (len = gbf_chunk(gbuf, off, &chunk)) > 0; off += len) {
+///         // chunk[0] ... chunk[len - 1] is the text at off ... off + len - 1.
+/// }
+/// \endcode
+/// The pointer is valid until the GapBuffer is changed.
+/// \param gbuf A GapBuffer.
+/// \param offset The position of the first byte.
+/// \param chunk This will be set to the first byte.
+/// \return The number of contiguous bytes at chunk or 0, if offset is out of range.
+size_t gbf_chunk(GapBuffer *gbuf, size_t offset, char **chunk);
+
+/// gbf_chunk_reverse is like gbf_chunk, but it returns the part of the segment,
+/// that ends before offset. This is used to read the text from right to left.
+/// \param gbuf A GapBuffer.
+/// \param offset The position after the last byte.
+/// \param chunk This will be set to the first byte of the segment. The last
+///        byte is chunk[len - 1], the byte at offset - 1.
+/// \return The number of contiguous bytes at chunk or 0, if offset is 0.
+size_t gbf_chunk_reverse(GapBuffer *gbuf, size_t offset, char **chunk);
+
 /// gbf_insert inserts a string into the gap buffer.
 /// \param gbuf A GapBuffer
 /// \param s The string to insert.
 /// \param offset The position.
 ///        If offset is out of range, the string will be inserted at the end.
-void gbf_insert(GapBuffer *gbuf, char *s, size_t offset);
+/// \return true on success, false if out of memory. On failure the text is
+///         unchanged.
+bool gbf_insert(GapBuffer *gbuf, char *s, size_t offset);
+
+/// gbf_insert_n inserts len bytes into the gap buffer. s may contain '\0' bytes.
+/// \param gbuf A GapBuffer
+/// \param s The bytes to insert.
+/// \param len The number of bytes to insert.
+/// \param offset The position.
+///        If offset is out of range, the bytes will be inserted at the end.
+/// \return true on success, false if out of memory. On failure the text is
+///         unchanged.
+bool gbf_insert_n(GapBuffer *gbuf, char *s, size_t len, size_t offset);
+
+/// gbf_reserve makes room for at least bytes bytes, so that inserting up to bytes bytes
+/// does not reallocate the buffer. Loaders and paste functions should call this,
+/// if they know how much text they are going to insert.
+/// \param gbuf A GapBuffer.
+/// \param bytes The number of bytes to reserve.
+/// \return true on success, false if memory allocation failed.
+///         On failure the GapBuffer is left unchanged.
+bool gbf_reserve(GapBuffer *gbuf, size_t bytes);
+
+/// gbf_read reads up to len bytes from a file and inserts them at offset.
+/// The bytes are read directly into the buffer, without a copy. Loaders should
+/// call gbf_reserve with the file size first.
+/// \param gbuf A GapBuffer.
+/// \param fd A file descriptor opened for reading.
+/// \param len The maximum number of bytes to read.
+/// \param offset The position.
+///        If offset is out of range, the bytes will be inserted at the end.
+/// \param bytes This will be set to the number of bytes read. It is 0 at the
+///        end of the file.
+/// \return true on success, false on error. errno is set to ENOMEM, if out of
+///         memory, or by read. On failure the text is unchanged.
+bool gbf_read(GapBuffer *gbuf, int fd, size_t len, size_t offset, size_t *bytes);
+
+/// gbf_write_begin makes room for len bytes at offset and returns it. The
+/// bytes can be written later, for example by another thread, and become part
+/// of the text with gbf_write_commit. Until then, the text must not be changed.
+/// If the gap is too small, it grows like it does for inserts. Call gbf_reserve
+/// first, if the final size is known.
+/// \param gbuf A GapBuffer.
+/// \param offset The position. This must not be larger than the text length.
+/// \param len The number of bytes.
+/// \return A pointer to len bytes of memory or NULL, if out of memory.
+char *gbf_write_begin(GapBuffer *gbuf, size_t offset, size_t len);
+
+/// gbf_write_commit inserts bytes, that were written to the memory returned by
+/// gbf_write_begin. It can be called several times, each time with the bytes,
+/// that follow the ones of the previous call.
+/// \param gbuf A GapBuffer.
+/// \param offset The position of the bytes.
+/// \param len The number of bytes.
+/// \return true on success, false if out of memory. On failure the text is
+///         unchanged.
+bool gbf_write_commit(GapBuffer *gbuf, size_t offset, size_t len);
 
 /// gbf_delete deletes n bytes after off.
 /// \param gbuf A GapBuffer.
@@ -45,12 +185,33 @@ void gbf_insert(GapBuffer *gbuf, char *s, size_t offset);
 /// \param bytes The number of bytes to delete. If this is larger
 ///        than the number of remaining bytes in gbuf, the function
 ///        will delete to the end of the buffer.
-void gbf_delete(GapBuffer *gbuf, size_t offset, size_t bytes);
+/// \return true on success, false if out of memory. A piece table may need
+///         memory to split a piece. On failure the text is unchanged.
+bool gbf_delete(GapBuffer *gbuf, size_t offset, size_t bytes);
 
 /// gbf_clear clears the gapbuffer (deletes all text).
 /// \param gbuf A GapBuffer.
 void gbf_clear(GapBuffer *gbuf);
 
+/// gbf_first_change finds the first byte, that was inserted or deleted since
+/// the GapBuffer was created or since the last call to gbf_mark_saved.
+/// The text before it is unchanged.
+/// \param gbuf A GapBuffer.
+/// \param offset This will be set to the offset of the first changed byte.
+/// \return true if the text was changed, false otherwise.
+bool gbf_first_change(GapBuffer *gbuf, size_t *offset);
+
+/// gbf_mark_saved marks the text as unchanged, for example after it was
+/// written to a file.
+/// \param gbuf A GapBuffer.
+void gbf_mark_saved(GapBuffer *gbuf);
+
+/// gbf_set_journal sets the journal, that records all following inserts and
+/// deletes (see journal.h).
+/// \param gbuf A GapBuffer.
+/// \param j A Journal or NULL to stop recording.
+void gbf_set_journal(GapBuffer *gbuf, struct Journal *j);
+
 /// gbf_at returns the byte at position off.
 /// \param gbuf A GapBuffer.
 /// \param offset The position of the byte.
@@ -62,15 +223,57 @@ char gbf_at(GapBuffer *gbuf, size_t offset);
 /// \return The text length in bytes.
 size_t gbf_text_length(GapBuffer *gbuf);
 
+/// gbf_line_at returns the line containing offset. Lines are counted from 1.
+/// \param gbuf A GapBuffer.
+/// \param offset The offset. If this is out of range, the last line is returned.
+/// \return The line number.
+size_t gbf_line_at(GapBuffer *gbuf, size_t offset);
+
+/// gbf_line_start finds the start of a line. Lines are counted from 1.
+/// \param gbuf A GapBuffer.
+/// \param line The line number.
+/// \param offset This will be set to the offset of the first byte in the line.
+/// \return true if the line exists, false otherwise.
+bool gbf_line_start(GapBuffer *gbuf, size_t line, size_t *offset);
+
 /// gbf_get_line copies the line containing offset into buffer.
 /// \param gbuf A GapBuffer.
 /// \param offset The offset.
 /// \param buffer An allocated buffer.
 void gbf_get_line(GapBuffer *gbuf, size_t offset, char *buffer);
 
+/// gbf_next_newline finds the first newline at or after offset.
+/// \param gbuf A GapBuffer.
+/// \param offset The position, where the search starts.
+/// \param found This will be set to the position of the newline.
+/// \return true if a newline was found, false otherwise.
+bool gbf_next_newline(GapBuffer *gbuf, size_t offset, size_t *found);
+
+/// gbf_prev_newline finds the last newline before offset.
+/// \param gbuf A GapBuffer.
+/// \param offset The position after the searched text.
+/// \param found This will be set to the position of the newline.
+/// \return true if a newline was found, false otherwise.
+bool gbf_prev_newline(GapBuffer *gbuf, size_t offset, size_t *found);
+
+/// gbf_count_newlines counts the newlines in a range of text.
+/// \param gbuf A GapBuffer.
+/// \param start The first position in the range.
+/// \param end The position after the range.
+/// \return The number of newlines.
+size_t gbf_count_newlines(GapBuffer *gbuf, size_t start, size_t end);
+
+/// gbf_nth_newline finds the n-th newline at or after offset.
+/// \param gbuf A GapBuffer.
+/// \param offset The position, where the search starts.
+/// \param n The number of the newline. 1 is the next newline.
+/// \param found This will be set to the position of the newline.
+/// \return true if the newline was found, false otherwise.
+bool gbf_nth_newline(GapBuffer *gbuf, size_t offset, size_t n, size_t *found);
+
 /// gbf_search searches for a pattern in the GapBuffer, from left to right.
 /// \param gbuf The GapBuffer to search.
-/// \param pattern The pattern to search for.
+/// \param pattern The pattern to search for. This may contain '\0' bytes.
 /// \param plen The length of the pattern.
 /// \param start Where to start the search.
 /// \param off This will be set to the start of the match, if any.
@@ -79,9 +282,9 @@ bool gbf_search(GapBuffer *gbuf, char *pattern, size_t plen, size_t start, size_
 
 /// gbf_search_reverse searches for a pattern in the GapBuffer, from right to left.
 /// \param gbuf The GapBuffer to search.
-/// \param pattern The pattern to search for.
+/// \param pattern The pattern to search for. This may contain '\0' bytes.
 /// \param plen The length of the pattern.
-/// \param start Where to start the search.
+/// \param start Where to start the search. This is the last byte a match may end on.
 /// \param off This will be set to the start of the match, if any.
 /// \return true on success, false otherwise.
 bool gbf_search_reverse(GapBuffer *gbuf, char *pattern, size_t plen, size_t start, size_t *off);
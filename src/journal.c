@@ -0,0 +1,433 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "gapbuffer.h"
+#include "journal.h"
+#include "static.h"
+
+
+// The first bytes of a journal.
+#define JOURNAL_MAGIC "DRTEJRNL"
+#define JOURNAL_MAGIC_LENGTH 8
+// The types of records.
+#define RECORD_INSERT 'I'
+#define RECORD_DELETE 'D'
+// The most bytes of a variable length integer.
+#define MAX_VARINT_LENGTH 10
+// The most bytes of a header and of a record without its bytes.
+#define MAX_HEADER_LENGTH (JOURNAL_MAGIC_LENGTH + 2 * MAX_VARINT_LENGTH)
+#define MAX_RECORD_LENGTH (1 + 2 * MAX_VARINT_LENGTH)
+// The pending records are written, when they reach FLUSH_SIZE bytes. The bytes
+// of larger inserts are written directly.
+#define FLUSH_SIZE (1024 * 1024)
+
+struct Journal {
+	int fd;
+	char *filename; // The name of the journal file.
+	size_t length; // The length of the journal file.
+	size_t start; // The length of the header.
+	size_t mark; // The length at journal_mark or SIZE_MAX.
+	char *pending; // The records, that were not written yet.
+	size_t pending_len;
+	size_t pending_size;
+	time_t pending_since; // When the oldest pending record was recorded.
+	bool failed; // True, if the journal cannot be written.
+};
+
+STATIC size_t put_varint(char *p, uint64_t n);
+STATIC bool get_varint(char *p, size_t len, size_t *pos, uint64_t *n);
+STATIC size_t make_header(char *p, size_t size, long long mtime);
+STATIC bool write_all(Journal *j, char *s, size_t len);
+STATIC bool append(Journal *j, char *s, size_t len);
+STATIC size_t make_record(char *p, char type, size_t offset, size_t len);
+STATIC void record(Journal *j, char type, size_t offset, size_t len);
+STATIC char *read_journal(int fd, size_t *len);
+STATIC size_t replay(char *s, size_t len, GapBuffer *gbuf, size_t *replayed);
+STATIC bool write_repair(Journal *j, size_t size, GapBuffer *text, size_t first);
+STATIC bool start_over(Journal *j, size_t size, long long mtime, GapBuffer *text,
+                       size_t first);
+
+
+// Writes n as a variable length integer: 7 bits per byte, the lowest first.
+// The high bit is set, if more bytes follow. Returns the number of bytes.
+STATIC size_t
+put_varint(char *p, uint64_t n) {
+	size_t i = 0;
+
+	while (n >= 0x80) {
+		p[i++] = (char)(n & 0x7f) | 0x80;
+		n >>= 7;
+	}
+	p[i++] = (char)n;
+	return i;
+}
+
+// Reads a variable length integer at *pos and advances *pos. Returns false,
+// if it is incomplete or too long.
+STATIC bool
+get_varint(char *p, size_t len, size_t *pos, uint64_t *n) {
+	*n = 0;
+	for (int shift = 0; shift < 64; shift += 7) {
+		unsigned char c;
+
+		if (*pos >= len) {
+			return false;
+		}
+		c = p[(*pos)++];
+		*n |= (uint64_t)(c & 0x7f) << shift;
+		if ((c & 0x80) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+STATIC size_t
+make_header(char *p, size_t size, long long mtime) {
+	size_t len = JOURNAL_MAGIC_LENGTH;
+
+	memcpy(p, JOURNAL_MAGIC, JOURNAL_MAGIC_LENGTH);
+	len += put_varint(p + len, size);
+	len += put_varint(p + len, (uint64_t)(mtime + 1));
+	return len;
+}
+
+// Writes len bytes to the end of the journal file.
+STATIC bool
+write_all(Journal *j, char *s, size_t len) {
+	while (len > 0) {
+		ssize_t n = pwrite(j->fd, s, len, j->length);
+
+		if (n == -1 && errno == EINTR) {
+			continue;
+		} else if (n <= 0) {
+			j->failed = true;
+			return false;
+		}
+		s += n;
+		len -= n;
+		j->length += n;
+	}
+	return true;
+}
+
+// Appends len bytes to the pending records.
+STATIC bool
+append(Journal *j, char *s, size_t len) {
+	if (j->pending_len + len > j->pending_size) {
+		size_t size = j->pending_size == 0 ? 4096 : j->pending_size;
+		char *p;
+
+		while (size < j->pending_len + len) {
+			size *= 2;
+		}
+		p = realloc(j->pending, size);
+		if (p == NULL) {
+			j->failed = true;
+			return false;
+		}
+		j->pending = p;
+		j->pending_size = size;
+	}
+	if (j->pending_len == 0) {
+		j->pending_since = time(NULL);
+	}
+	memcpy(j->pending + j->pending_len, s, len);
+	j->pending_len += len;
+	return true;
+}
+
+// Writes the type, the offset and the length of a record to p. Returns the
+// number of bytes.
+STATIC size_t
+make_record(char *p, char type, size_t offset, size_t len) {
+	size_t n = 0;
+
+	p[n++] = type;
+	n += put_varint(p + n, offset);
+	n += put_varint(p + n, len);
+	return n;
+}
+
+// Appends the type, the offset and the length of a record.
+STATIC void
+record(Journal *j, char type, size_t offset, size_t len) {
+	char rec[MAX_RECORD_LENGTH];
+
+	append(j, rec, make_record(rec, type, offset, len));
+}
+
+// Reads the whole journal file into a new string.
+STATIC char *
+read_journal(int fd, size_t *len) {
+	struct stat st;
+	char *s;
+
+	*len = 0;
+	if (fstat(fd, &st) != 0) {
+		return NULL;
+	}
+	s = malloc(st.st_size + 1);
+	if (s == NULL) {
+		return NULL;
+	}
+	while (*len < (size_t)st.st_size) {
+		ssize_t n = pread(fd, s + *len, st.st_size - *len, *len);
+
+		if (n == -1 && errno == EINTR) {
+			continue;
+		} else if (n <= 0) {
+			break;
+		}
+		*len += n;
+	}
+	return s;
+}
+
+// Applies the records in s to gbuf. Returns the length of the valid records.
+// The first record, that is incomplete, does not fit the text or cannot be
+// applied for lack of memory, ends them.
+STATIC size_t
+replay(char *s, size_t len, GapBuffer *gbuf, size_t *replayed) {
+	size_t pos = 0;
+
+	for (;;) {
+		size_t next = pos + 1;
+		size_t length = gbf_text_length(gbuf);
+		uint64_t offset;
+		uint64_t n;
+
+		if (next > len || !get_varint(s, len, &next, &offset) ||
+			!get_varint(s, len, &next, &n) || offset > length) {
+			return pos;
+		}
+		if (s[pos] == RECORD_INSERT && n <= len - next) {
+			if (!gbf_insert_n(gbuf, s + next, n, offset)) {
+				return pos;
+			}
+			next += n;
+		} else if (s[pos] == RECORD_DELETE && n <= length - offset) {
+			if (!gbf_delete(gbuf, offset, n)) {
+				return pos;
+			}
+		} else {
+			return pos;
+		}
+		pos = next;
+		(*replayed)++;
+	}
+}
+
+Journal *
+journal_open(char *filename, size_t size, long long mtime, GapBuffer *gbuf,
+             size_t *replayed) {
+	Journal *j = malloc(sizeof(*j));
+	char header[MAX_HEADER_LENGTH];
+	size_t hlen = make_header(header, size, mtime);
+	size_t len = 0;
+	char *s;
+
+	if (replayed != NULL) {
+		*replayed = 0;
+	}
+	if (j == NULL) {
+		return NULL;
+	}
+	memset(j, 0, sizeof(*j));
+	j->mark = SIZE_MAX;
+	j->filename = malloc(strlen(filename) + sizeof(JOURNAL_SUFFIX));
+	if (j->filename == NULL) {
+		free(j);
+		return NULL;
+	}
+	sprintf(j->filename, "%s%s", filename, JOURNAL_SUFFIX);
+	// The journal contains the text, so only the user may read it.
+	j->fd = open(j->filename, O_RDWR | O_CREAT, 0600);
+	if (j->fd == -1) {
+		free(j->filename);
+		free(j);
+		return NULL;
+	}
+
+	s = replayed != NULL ? read_journal(j->fd, &len) : NULL;
+	if (s != NULL && len >= hlen && memcmp(s, header, hlen) == 0) {
+		// The journal belongs to this version of the file.
+		j->length = hlen + replay(s + hlen, len - hlen, gbuf, replayed);
+	}
+	free(s);
+	// Anything after the valid records is cut off, new records follow them.
+	if (ftruncate(j->fd, j->length) != 0 ||
+		(j->length == 0 && !write_all(j, header, hlen))) {
+		journal_free(&j, true);
+		return NULL;
+	}
+	j->start = hlen;
+	return j;
+}
+
+void
+journal_insert(Journal *j, size_t offset, char *s, size_t len) {
+	if (j->failed || len == 0) {
+		return;
+	}
+	record(j, RECORD_INSERT, offset, len);
+	if (len < FLUSH_SIZE) {
+		append(j, s, len);
+	} else if (journal_flush(j)) {
+		write_all(j, s, len);
+	}
+	if (j->pending_len >= FLUSH_SIZE) {
+		journal_flush(j);
+	}
+}
+
+void
+journal_delete(Journal *j, size_t offset, size_t len) {
+	if (j->failed || len == 0) {
+		return;
+	}
+	record(j, RECORD_DELETE, offset, len);
+	if (j->pending_len >= FLUSH_SIZE) {
+		journal_flush(j);
+	}
+}
+
+bool
+journal_is_pending(Journal *j) {
+	return j->failed || j->pending_len > 0;
+}
+
+bool
+journal_flush_due(Journal *j, unsigned interval) {
+	return j->failed || (j->pending_len > 0 && time(NULL) - j->pending_since >= (time_t)interval);
+}
+
+bool
+journal_flush(Journal *j) {
+	if (!j->failed && j->pending_len > 0) {
+		write_all(j, j->pending, j->pending_len);
+		j->pending_len = 0;
+	}
+	return !j->failed;
+}
+
+void
+journal_mark(Journal *j) {
+	journal_flush(j);
+	j->mark = j->length;
+}
+
+// Writes the records, that turn a file of size bytes, which matches text only
+// before first, into text.
+STATIC bool
+write_repair(Journal *j, size_t size, GapBuffer *text, size_t first) {
+	char rec[MAX_RECORD_LENGTH];
+	size_t length = gbf_text_length(text);
+	size_t n;
+	char *chunk;
+
+	if (size > first && !write_all(j, rec, make_record(rec, RECORD_DELETE, first, size - first))) {
+		return false;
+	}
+	if (length <= first) {
+		return true;
+	}
+	if (!write_all(j, rec, make_record(rec, RECORD_INSERT, first, length - first))) {
+		return false;
+	}
+	for (size_t off = first; off < length; off += n) {
+		n = gbf_chunk(text, off, &chunk);
+		if (!write_all(j, chunk, n)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Writes a new header and keeps the records after the mark. If text is not
+// NULL, the records of write_repair precede them.
+STATIC bool
+start_over(Journal *j, size_t size, long long mtime, GapBuffer *text, size_t first) {
+	char header[MAX_HEADER_LENGTH];
+	size_t hlen = make_header(header, size, mtime);
+	size_t len;
+	char *s;
+
+	if (!journal_flush(j) || j->mark == SIZE_MAX) {
+		return false;
+	}
+	// The records after the mark are read back and follow the new header.
+	len = j->length - j->mark;
+	s = malloc(len + 1);
+	if (s == NULL) {
+		j->failed = true;
+		return false;
+	}
+	for (size_t done = 0; done < len;) {
+		ssize_t n = pread(j->fd, s + done, len - done, j->mark + done);
+
+		if (n == -1 && errno == EINTR) {
+			continue;
+		} else if (n <= 0) {
+			free(s);
+			j->failed = true;
+			return false;
+		}
+		done += n;
+	}
+
+	j->length = 0;
+	j->mark = SIZE_MAX;
+	j->start = hlen;
+	if (ftruncate(j->fd, 0) != 0) {
+		j->failed = true;
+	}
+	if (!j->failed && write_all(j, header, hlen) &&
+		(text == NULL || write_repair(j, size, text, first))) {
+		write_all(j, s, len);
+	}
+	free(s);
+	return !j->failed;
+}
+
+bool
+journal_rebase(Journal *j, size_t size, long long mtime) {
+	return start_over(j, size, mtime, NULL, 0);
+}
+
+bool
+journal_repair(Journal *j, size_t size, long long mtime, GapBuffer *text, size_t first) {
+	return start_over(j, size, mtime, text, first);
+}
+
+bool
+journal_grow(Journal *j, size_t size, long long mtime) {
+	// All records are kept.
+	j->mark = j->start;
+	return journal_rebase(j, size, mtime);
+}
+
+void
+journal_free(Journal **j, bool remove) {
+	if (!remove) {
+		journal_flush(*j);
+	}
+	close((*j)->fd);
+	if (remove) {
+		unlink((*j)->filename);
+	}
+	free((*j)->filename);
+	free((*j)->pending);
+	free(*j);
+	*j = NULL;
+}
@@ -0,0 +1,123 @@
+#ifndef DRTE_JOURNAL_H
+#define DRTE_JOURNAL_H
+
+/// \file
+/// journal.h implements a journal of the edits of a file, that is used to
+/// recover them after a crash.
+///
+/// Usage:
+/// \code
+/// #include <stdbool.h>
+/// #include <stdlib.h>
+///
+/// #include "gapbuffer.h"
+/// #include "journal.h"
+/// \endcode
+///
+/// The journal of a file is stored next to it, its name is the filename with
+/// JOURNAL_SUFFIX appended. It starts with the size and the modification time
+/// of the file, that the edits apply to. Then every insert and delete follows
+/// as a record: The type of the record, the offset and the length as variable
+/// length integers, and the inserted bytes. Records are collected in memory
+/// and appended with a single write, when the journal is flushed.
+///
+/// When the file is opened again, while its journal exists, the edits are
+/// replayed, so recovering costs time proportional to the edits, not to the
+/// size of the file. An incomplete record at the end is ignored.
+
+/// The suffix of journal files.
+#define JOURNAL_SUFFIX ".drte-journal"
+
+/// A journal.
+typedef struct Journal Journal;
+
+/// journal_open opens the journal of a file. If there is a journal for the
+/// same size and modification time of the file, its edits are applied to
+/// gbuf and new edits are appended. Otherwise a new journal is created.
+/// \param filename The name of the file.
+/// \param size The size of the file, when it was read.
+/// \param mtime The modification time of the file, when it was read, or -1
+///        if the file did not exist.
+/// \param gbuf The text of the file. It must not have a journal yet.
+/// \param replayed This will be set to the number of edits, that were applied.
+///        If it is NULL, an existing journal is discarded.
+/// \return A new Journal or NULL, if the journal cannot be written or if out of
+///         memory. The Journal needs to be freed with journal_free.
+Journal *journal_open(char *filename, size_t size, long long mtime, GapBuffer *gbuf,
+                      size_t *replayed);
+
+/// journal_insert records an insert.
+/// \param j A Journal.
+/// \param offset The position of the inserted bytes.
+/// \param s The inserted bytes.
+/// \param len The number of bytes.
+void journal_insert(Journal *j, size_t offset, char *s, size_t len);
+
+/// journal_delete records a delete.
+/// \param j A Journal.
+/// \param offset The position of the deleted bytes.
+/// \param len The number of bytes.
+void journal_delete(Journal *j, size_t offset, size_t len);
+
+/// journal_is_pending checks, if there are records, that were not written.
+/// \param j A Journal.
+/// \return true if there are pending records, false otherwise.
+bool journal_is_pending(Journal *j);
+
+/// journal_flush_due checks, if the oldest pending record was recorded at
+/// least interval seconds ago.
+/// \param j A Journal.
+/// \param interval The interval in seconds.
+/// \return true if the journal should be flushed, false otherwise.
+bool journal_flush_due(Journal *j, unsigned interval);
+
+/// journal_flush writes the pending records with a single write.
+/// \param j A Journal.
+/// \return true on success, false if the journal cannot be written. Then it
+///         stops recording.
+bool journal_flush(Journal *j);
+
+/// journal_mark flushes the journal and remembers its end. This is used, when
+/// a snapshot of the text is saved: The records after the mark apply to the
+/// snapshot.
+/// \param j A Journal.
+void journal_mark(Journal *j);
+
+/// journal_rebase starts the journal over for a file, that was written from
+/// the snapshot taken at journal_mark. The records after the mark are kept.
+/// \param j A Journal.
+/// \param size The new size of the file.
+/// \param mtime The new modification time of the file.
+/// \return true on success, false if the journal cannot be written.
+bool journal_rebase(Journal *j, size_t size, long long mtime);
+
+/// journal_repair starts the journal over for a file, that was written from
+/// the snapshot taken at journal_mark only in part. The file is known to match
+/// the snapshot before first. The rest of the snapshot is recorded, followed
+/// by the records after the mark.
+/// \param j A Journal.
+/// \param size The size of the file.
+/// \param mtime The modification time of the file.
+/// \param text The snapshot.
+/// \param first The first byte of the file, that may not match the snapshot.
+/// \return true on success, false if the journal cannot be written.
+bool journal_repair(Journal *j, size_t size, long long mtime, GapBuffer *text,
+                    size_t first);
+
+/// journal_grow starts the journal over for a file, that bytes were appended
+/// to, while the text was edited. All records are kept, since the file did not
+/// change before the appended bytes.
+/// \param j A Journal.
+/// \param size The new size of the file.
+/// \param mtime The new modification time of the file.
+/// \return true on success, false if the journal cannot be written.
+bool journal_grow(Journal *j, size_t size, long long mtime);
+
+/// journal_free closes a Journal and sets j to NULL.
+/// \param j A Journal.
+/// \param remove If true, the journal file is removed. This is done, when
+///        the edits are saved or discarded.
+void journal_free(Journal **j, bool remove);
+
+
+#endif
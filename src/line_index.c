@@ -0,0 +1,465 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "line_index.h"
+#include "scan.h"
+#include "static.h"
+
+
+#define LEAF_SIZE 512
+
+typedef struct {
+	size_t count; // The number of lines in the leaf.
+	size_t bytes; // The sum of all line lengths in the leaf.
+	size_t lengths[LEAF_SIZE]; // The line lengths, including the newline.
+} Leaf;
+
+struct LineIndex {
+	Leaf **leaves; // The leaves, in text order.
+	size_t nleaves; // The number of leaves.
+	size_t capacity; // The number of leaves that fit into leaves.
+	size_t *byte_tree; // A Fenwick tree over the number of bytes per leaf.
+	size_t *line_tree; // A Fenwick tree over the number of lines per leaf.
+	size_t length; // The length of the text.
+	size_t lines; // The number of lines in the text.
+};
+
+// LeafWriter appends line lengths to a sequence of new leaves.
+typedef struct {
+	Leaf *current; // The leaf that is filled.
+	Leaf **added; // The leaves, that were created.
+	size_t nadded; // The number of created leaves.
+	size_t capacity; // The number of leaves that fit into added.
+} LeafWriter;
+
+STATIC void fenwick_add(size_t *tree, size_t n, size_t i, size_t delta);
+STATIC size_t fenwick_prefix(size_t *tree, size_t i);
+STATIC size_t fenwick_find(size_t *tree, size_t n, size_t *target);
+STATIC void rebuild_trees(LineIndex *li);
+STATIC bool reserve_leaves(LineIndex *li, size_t n);
+STATIC Leaf *alloc_leaf(void);
+STATIC void leaf_sum(Leaf *leaf);
+STATIC void locate_offset(LineIndex *li, size_t offset, size_t *leaf, size_t *pos, size_t *rem);
+STATIC bool writer_append(LeafWriter *w, size_t length);
+
+// New leaves are filled up to LEAF_FILL lines, so lines can be added without
+// splitting them right away.
+STATIC size_t LEAF_FILL = LEAF_SIZE / 4 * 3;
+
+// Adds delta to the i-th element. Negative values are added as their
+// two's complement, so the unsigned arithmetic wraps around correctly.
+STATIC void
+fenwick_add(size_t *tree, size_t n, size_t i, size_t delta) {
+	for (i++; i <= n; i += i & -i) {
+		tree[i] += delta;
+	}
+}
+
+// Returns the sum of the first i elements.
+STATIC size_t
+fenwick_prefix(size_t *tree, size_t i) {
+	size_t sum = 0;
+
+	for (; i > 0; i -= i & -i) {
+		sum += tree[i];
+	}
+	return sum;
+}
+
+// Returns the element, that contains target, where every element covers a range
+// as large as its value. target is set to the position inside the element.
+STATIC size_t
+fenwick_find(size_t *tree, size_t n, size_t *target) {
+	size_t pos = 0;
+	size_t step = 1;
+
+	while (step * 2 <= n) {
+		step *= 2;
+	}
+	for (; step > 0; step /= 2) {
+		if (pos + step <= n && tree[pos + step] <= *target) {
+			pos += step;
+			*target -= tree[pos];
+		}
+	}
+	return pos;
+}
+
+// Rebuilds both Fenwick trees from the leaves in O(number of leaves).
+STATIC void
+rebuild_trees(LineIndex *li) {
+	size_t n = li->nleaves;
+
+	for (size_t i = 1; i <= n; i++) {
+		li->byte_tree[i] = li->leaves[i - 1]->bytes;
+		li->line_tree[i] = li->leaves[i - 1]->count;
+	}
+	for (size_t i = 1; i <= n; i++) {
+		size_t parent = i + (i & -i);
+		if (parent <= n) {
+			li->byte_tree[parent] += li->byte_tree[i];
+			li->line_tree[parent] += li->line_tree[i];
+		}
+	}
+}
+
+// Makes room for n leaves.
+STATIC bool
+reserve_leaves(LineIndex *li, size_t n) {
+	size_t capacity = li->capacity;
+	void *new;
+
+	if (n <= capacity) {
+		return true;
+	}
+	while (capacity < n) {
+		capacity *= 2;
+	}
+	new = realloc(li->leaves, capacity * sizeof(*li->leaves));
+	if (new == NULL) {
+		return false;
+	}
+	li->leaves = new;
+	new = realloc(li->byte_tree, (capacity + 1) * sizeof(*li->byte_tree));
+	if (new == NULL) {
+		return false;
+	}
+	li->byte_tree = new;
+	new = realloc(li->line_tree, (capacity + 1) * sizeof(*li->line_tree));
+	if (new == NULL) {
+		return false;
+	}
+	li->line_tree = new;
+	li->capacity = capacity;
+
+	return true;
+}
+
+STATIC Leaf *
+alloc_leaf(void) {
+	Leaf *leaf = malloc(sizeof(*leaf));
+
+	if (leaf == NULL) {
+		return NULL;
+	}
+	leaf->count = 0;
+	leaf->bytes = 0;
+	return leaf;
+}
+
+// Recomputes the number of bytes in a leaf.
+STATIC void
+leaf_sum(Leaf *leaf) {
+	leaf->bytes = 0;
+	for (size_t i = 0; i < leaf->count; i++) {
+		leaf->bytes += leaf->lengths[i];
+	}
+}
+
+// Finds the line containing offset. leaf and pos are set to the leaf and the
+// position of the line inside the leaf, rem is set to the offset inside the line.
+// If offset is at or after the end of the text, the last line is returned.
+STATIC void
+locate_offset(LineIndex *li, size_t offset, size_t *leaf, size_t *pos, size_t *rem) {
+	Leaf *l;
+	size_t i = 0;
+
+	if (offset >= li->length) {
+		*leaf = li->nleaves - 1;
+		l = li->leaves[*leaf];
+		*pos = l->count - 1;
+		*rem = l->lengths[*pos];
+		return;
+	}
+	*leaf = fenwick_find(li->byte_tree, li->nleaves, &offset);
+	l = li->leaves[*leaf];
+	while (offset >= l->lengths[i]) {
+		offset -= l->lengths[i];
+		i++;
+	}
+	*pos = i;
+	*rem = offset;
+}
+
+// Appends a line to the current leaf. If the leaf is full, a new leaf is created.
+STATIC bool
+writer_append(LeafWriter *w, size_t length) {
+	if (w->current->count >= LEAF_FILL) {
+		Leaf *leaf;
+
+		if (w->nadded == w->capacity) {
+			size_t capacity = w->capacity == 0 ? 16 : w->capacity * 2;
+			Leaf **new = realloc(w->added, capacity * sizeof(*new));
+			if (new == NULL) {
+				return false;
+			}
+			w->added = new;
+			w->capacity = capacity;
+		}
+		leaf = alloc_leaf();
+		if (leaf == NULL) {
+			return false;
+		}
+		w->added[w->nadded] = leaf;
+		w->nadded++;
+		w->current = leaf;
+	}
+	w->current->lengths[w->current->count] = length;
+	w->current->count++;
+	w->current->bytes += length;
+
+	return true;
+}
+
+LineIndex *
+line_index_new(void) {
+	LineIndex *li = malloc(sizeof(*li));
+
+	if (li == NULL) {
+		return NULL;
+	}
+	memset(li, 0, sizeof(*li));
+	li->capacity = 4;
+	li->leaves = malloc(li->capacity * sizeof(*li->leaves));
+	li->byte_tree = malloc((li->capacity + 1) * sizeof(*li->byte_tree));
+	li->line_tree = malloc((li->capacity + 1) * sizeof(*li->line_tree));
+	if (li->leaves == NULL || li->byte_tree == NULL || li->line_tree == NULL) {
+		line_index_free(&li);
+		return NULL;
+	}
+	li->leaves[0] = alloc_leaf();
+	if (li->leaves[0] == NULL) {
+		line_index_free(&li);
+		return NULL;
+	}
+	li->nleaves = 1;
+	li->leaves[0]->lengths[0] = 0;
+	li->leaves[0]->count = 1;
+	li->lines = 1;
+	rebuild_trees(li);
+
+	return li;
+}
+
+void
+line_index_free(LineIndex **li) {
+	if (*li == NULL) {
+		return;
+	}
+	if ((*li)->leaves != NULL) {
+		for (size_t i = 0; i < (*li)->nleaves; i++) {
+			free((*li)->leaves[i]);
+		}
+	}
+	free((*li)->leaves);
+	free((*li)->byte_tree);
+	free((*li)->line_tree);
+	free(*li);
+	*li = NULL;
+}
+
+size_t
+line_index_length(LineIndex *li) {
+	return li->length;
+}
+
+size_t
+line_index_lines(LineIndex *li) {
+	return li->lines;
+}
+
+bool
+line_index_insert(LineIndex *li, size_t offset, char *text, size_t len) {
+	size_t j;
+	size_t i;
+	size_t rem;
+	size_t newlines;
+	size_t tail;
+	size_t start = 0;
+	char *end = text + len;
+	char *nl;
+	Leaf *l;
+
+	if (len == 0) {
+		return true;
+	}
+	locate_offset(li, offset, &j, &i, &rem);
+	l = li->leaves[j];
+	newlines = scan_count(text, len, '\n');
+
+	if (newlines == 0) {
+		l->lengths[i] += len;
+		l->bytes += len;
+		li->length += len;
+		fenwick_add(li->byte_tree, li->nleaves, j, len);
+		return true;
+	}
+
+	tail = l->lengths[i] - rem;
+	if (l->count + newlines <= LEAF_SIZE) {
+		// The new lines fit into the leaf.
+		size_t pos = i;
+		size_t first = rem;
+
+		memmove(&l->lengths[i + 1 + newlines], &l->lengths[i + 1],
+				(l->count - i - 1) * sizeof(l->lengths[0]));
+		while ((nl = scan_byte(text + start, end - (text + start), '\n')) != NULL) {
+			l->lengths[pos] = first + (nl - text) + 1 - start;
+			first = 0;
+			start = (nl - text) + 1;
+			pos++;
+		}
+		l->lengths[pos] = (len - start) + tail;
+		l->count += newlines;
+		l->bytes += len;
+		li->length += len;
+		li->lines += newlines;
+		fenwick_add(li->byte_tree, li->nleaves, j, len);
+		fenwick_add(li->line_tree, li->nleaves, j, newlines);
+		return true;
+	}
+
+	// The leaf is split: The lines after line i are saved, line i and the
+	// new lines are appended to the leaf and to new leaves, then the saved lines
+	// are appended.
+	size_t saved[LEAF_SIZE];
+	size_t rest = l->count - i - 1;
+	size_t first = rem;
+	LeafWriter w = {0};
+
+	memcpy(saved, &l->lengths[i + 1], rest * sizeof(saved[0]));
+	l->count = i;
+	leaf_sum(l);
+	w.current = l;
+
+	while ((nl = scan_byte(text + start, end - (text + start), '\n')) != NULL) {
+		if (!writer_append(&w, first + (nl - text) + 1 - start)) {
+			goto fail;
+		}
+		first = 0;
+		start = (nl - text) + 1;
+	}
+	if (!writer_append(&w, (len - start) + tail)) {
+		goto fail;
+	}
+	for (size_t k = 0; k < rest; k++) {
+		if (!writer_append(&w, saved[k])) {
+			goto fail;
+		}
+	}
+	if (!reserve_leaves(li, li->nleaves + w.nadded)) {
+		goto fail;
+	}
+	memmove(&li->leaves[j + 1 + w.nadded], &li->leaves[j + 1],
+			(li->nleaves - j - 1) * sizeof(li->leaves[0]));
+	memcpy(&li->leaves[j + 1], w.added, w.nadded * sizeof(w.added[0]));
+	li->nleaves += w.nadded;
+	li->length += len;
+	li->lines += newlines;
+	rebuild_trees(li);
+	free(w.added);
+
+	return true;
+
+fail:
+	for (size_t k = 0; k < w.nadded; k++) {
+		free(w.added[k]);
+	}
+	free(w.added);
+	return false;
+}
+
+void
+line_index_delete(LineIndex *li, size_t offset, size_t len) {
+	size_t ja;
+	size_t ia;
+	size_t rema;
+	size_t jb;
+	size_t ib;
+	size_t remb;
+	Leaf *a;
+	Leaf *b;
+
+	if (len == 0) {
+		return;
+	}
+	locate_offset(li, offset, &ja, &ia, &rema);
+	locate_offset(li, offset + len, &jb, &ib, &remb);
+	a = li->leaves[ja];
+	b = li->leaves[jb];
+	li->length -= len;
+
+	if (ja == jb && ia == ib) {
+		// The deleted text does not contain a newline.
+		a->lengths[ia] -= len;
+		a->bytes -= len;
+		fenwick_add(li->byte_tree, li->nleaves, ja, -len);
+		return;
+	}
+
+	// The start of line ia and the end of line ib become one line.
+	size_t joined = rema + (b->lengths[ib] - remb);
+	size_t removed = (fenwick_prefix(li->line_tree, jb) + ib) -
+		(fenwick_prefix(li->line_tree, ja) + ia);
+
+	li->lines -= removed;
+	if (ja == jb) {
+		a->lengths[ia] = joined;
+		memmove(&a->lengths[ia + 1], &a->lengths[ib + 1],
+				(a->count - ib - 1) * sizeof(a->lengths[0]));
+		a->count -= removed;
+		a->bytes -= len;
+		fenwick_add(li->byte_tree, li->nleaves, ja, -len);
+		fenwick_add(li->line_tree, li->nleaves, ja, -removed);
+		return;
+	}
+
+	a->lengths[ia] = joined;
+	a->count = ia + 1;
+	leaf_sum(a);
+	for (size_t k = ja + 1; k < jb; k++) {
+		free(li->leaves[k]);
+	}
+	memmove(&b->lengths[0], &b->lengths[ib + 1], (b->count - ib - 1) * sizeof(b->lengths[0]));
+	b->count -= ib + 1;
+	leaf_sum(b);
+
+	size_t first_kept = jb;
+	if (b->count == 0) {
+		free(b);
+		first_kept++;
+	}
+	memmove(&li->leaves[ja + 1], &li->leaves[first_kept],
+			(li->nleaves - first_kept) * sizeof(li->leaves[0]));
+	li->nleaves -= first_kept - (ja + 1);
+	rebuild_trees(li);
+}
+
+size_t
+line_index_line(LineIndex *li, size_t offset) {
+	size_t j;
+	size_t i;
+	size_t rem;
+
+	locate_offset(li, offset, &j, &i, &rem);
+	return fenwick_prefix(li->line_tree, j) + i;
+}
+
+size_t
+line_index_offset(LineIndex *li, size_t line) {
+	size_t j;
+	size_t offset;
+	Leaf *l;
+
+	if (line >= li->lines) {
+		line = li->lines - 1;
+	}
+	j = fenwick_find(li->line_tree, li->nleaves, &line);
+	l = li->leaves[j];
+	offset = fenwick_prefix(li->byte_tree, j);
+	for (size_t i = 0; i < line; i++) {
+		offset += l->lengths[i];
+	}
+	return offset;
+}
@@ -0,0 +1,80 @@
+#ifndef DRTE_LINE_INDEX_H
+#define DRTE_LINE_INDEX_H
+
+/// \file
+/// line_index.h implements an index of the lines in a text.
+///
+/// Usage:
+/// \code
+/// #include <stdbool.h>
+/// #include <stdlib.h>
+///
+/// #include "line_index.h"
+/// \endcode
+///
+/// The index stores the length of every line (including the newline) in
+/// leaves of up to a few hundred lines. Two Fenwick trees hold the number of
+/// bytes and the number of lines per leaf, so the leaf containing an offset or
+/// a line can be found in O(log n). Inserts and deletes only touch the affected
+/// leaves and update the trees. Only when leaves are split or removed, the trees
+/// are rebuilt. This costs O(number of leaves) and happens once every few hundred
+/// new lines.
+///
+/// Lines and offsets start at 0. A text with n newlines has n + 1 lines.
+/// The last line has no newline and may be empty.
+
+/// A line index.
+typedef struct LineIndex LineIndex;
+
+/// line_index_new creates a new LineIndex for an empty text.
+/// \return A new LineIndex or NULL, if out of memory.
+///         The index needs to be freed with line_index_free.
+LineIndex *line_index_new(void);
+
+/// line_index_free frees a LineIndex and sets li to NULL.
+/// \param li A LineIndex.
+void line_index_free(LineIndex **li);
+
+/// line_index_length returns the length of the indexed text.
+/// \param li A LineIndex.
+/// \return The text length in bytes.
+size_t line_index_length(LineIndex *li);
+
+/// line_index_lines returns the number of lines in the indexed text.
+/// \param li A LineIndex.
+/// \return The number of lines. This is at least 1.
+size_t line_index_lines(LineIndex *li);
+
+/// line_index_insert updates the index after text was inserted.
+/// \param li A LineIndex.
+/// \param offset The position of the inserted text. This must not be larger
+///        than the text length.
+/// \param text The inserted text.
+/// \param len The length of the inserted text.
+/// \return true on success, false if out of memory. On failure the index is
+///         invalid and needs to be freed.
+bool line_index_insert(LineIndex *li, size_t offset, char *text, size_t len);
+
+/// line_index_delete updates the index after text was deleted.
+/// \param li A LineIndex.
+/// \param offset The position of the deleted text.
+/// \param len The number of deleted bytes. offset + len must not be larger than
+///        the text length.
+void line_index_delete(LineIndex *li, size_t offset, size_t len);
+
+/// line_index_line returns the line containing offset.
+/// \param li A LineIndex.
+/// \param offset An offset. If this is larger than the text length, the last
+///        line is returned.
+/// \return The line.
+size_t line_index_line(LineIndex *li, size_t offset);
+
+/// line_index_offset returns the offset of the first byte in a line.
+/// \param li A LineIndex.
+/// \param line A line. If the line does not exist, the start of the last
+///        line is returned.
+/// \return The offset.
+size_t line_index_offset(LineIndex *li, size_t line);
+
+
+#endif
@@ -0,0 +1,134 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "loader.h"
+#include "worker.h"
+#include "static.h"
+
+
+// The number of bytes read at once. After each step the bytes are published.
+#define LOAD_STEP (4 << 20)
+
+// How long the worker waits for input in milliseconds, before it checks, if it
+// was canceled. Regular files are always ready.
+#define POLL_TIMEOUT 100
+
+struct Loader {
+	Worker *worker;
+	pthread_mutex_t mutex; // Protects the fields below.
+	size_t bytes; // The number of bytes read so far.
+	LoaderState state;
+	bool canceled; // Set by loader_free.
+	int fd;
+	char *text;
+	size_t size;
+};
+
+STATIC void load(void *arg);
+STATIC bool is_canceled(Loader *l);
+
+
+STATIC bool
+is_canceled(Loader *l) {
+	bool canceled;
+
+	pthread_mutex_lock(&l->mutex);
+	canceled = l->canceled;
+	pthread_mutex_unlock(&l->mutex);
+	return canceled;
+}
+
+// The worker thread. The bytes are written before the mutex is released, so
+// the main thread sees them, when it sees the new count.
+STATIC void
+load(void *arg) {
+	Loader *l = arg;
+	struct pollfd pfd = { .fd = l->fd, .events = POLLIN };
+	LoaderState state = LOADER_DONE;
+	size_t bytes = 0;
+
+	while (bytes < l->size && !is_canceled(l)) {
+		size_t len = l->size - bytes < LOAD_STEP ? l->size - bytes : LOAD_STEP;
+		ssize_t n;
+
+		n = poll(&pfd, 1, POLL_TIMEOUT);
+		if (n == 0 || (n == -1 && errno == EINTR)) {
+			continue;
+		}
+		do {
+			n = read(l->fd, l->text + bytes, len);
+		} while (n == -1 && errno == EINTR);
+		if (n == -1) {
+			state = LOADER_FAILED;
+			break;
+		} else if (n == 0) {
+			break;
+		}
+		bytes += n;
+
+		pthread_mutex_lock(&l->mutex);
+		l->bytes = bytes;
+		pthread_mutex_unlock(&l->mutex);
+	}
+
+	pthread_mutex_lock(&l->mutex);
+	l->state = state;
+	pthread_mutex_unlock(&l->mutex);
+}
+
+Loader *
+loader_new(int fd, char *text, size_t size) {
+	Loader *l = malloc(sizeof(*l));
+
+	if (l == NULL) {
+		return NULL;
+	}
+	l->bytes = 0;
+	l->state = LOADER_RUNNING;
+	l->canceled = false;
+	l->fd = fd;
+	l->text = text;
+	l->size = size;
+	if (pthread_mutex_init(&l->mutex, NULL) != 0) {
+		free(l);
+		return NULL;
+	}
+
+	l->worker = worker_new(load, l);
+	if (l->worker == NULL) {
+		pthread_mutex_destroy(&l->mutex);
+		free(l);
+		return NULL;
+	}
+	return l;
+}
+
+LoaderState
+loader_poll(Loader *l, size_t *bytes) {
+	LoaderState state;
+
+	pthread_mutex_lock(&l->mutex);
+	*bytes = l->bytes;
+	state = l->state;
+	pthread_mutex_unlock(&l->mutex);
+	return state;
+}
+
+void
+loader_free(Loader **l) {
+	pthread_mutex_lock(&(*l)->mutex);
+	(*l)->canceled = true;
+	pthread_mutex_unlock(&(*l)->mutex);
+
+	worker_free(&(*l)->worker);
+	pthread_mutex_destroy(&(*l)->mutex);
+	close((*l)->fd);
+	free(*l);
+	*l = NULL;
+}
@@ -0,0 +1,50 @@
+#ifndef DRTE_LOADER_H
+#define DRTE_LOADER_H
+
+/// \file
+/// loader.h implements reading a file on a worker thread.
+///
+/// Usage:
+/// \code
+/// #include <stdbool.h>
+/// #include <stdlib.h>
+///
+/// #include "loader.h"
+/// \endcode
+///
+/// The worker reads the file into memory, that is owned by the caller, in
+/// steps of a few megabytes. The caller polls the number of bytes read so far.
+/// These bytes are complete and will not be changed by the worker anymore.
+
+/// LoaderState is the return type of loader_poll.
+typedef enum {
+	LOADER_RUNNING = 0, ///< The worker is still reading.
+	LOADER_DONE = 1, ///< The worker reached the end of the file or the size.
+	LOADER_FAILED = 2 ///< A read failed.
+} LoaderState;
+
+/// A loader.
+typedef struct Loader Loader;
+
+/// loader_new starts a thread, that reads up to size bytes from fd into text.
+/// \param fd A file descriptor opened for reading. It is closed by loader_free.
+/// \param text The memory for the bytes. It must stay valid until loader_free
+///        returns.
+/// \param size The maximum number of bytes.
+/// \return A new Loader or NULL, if out of memory or the thread could not be
+///         started. The Loader needs to be freed with loader_free.
+Loader *loader_new(int fd, char *text, size_t size);
+
+/// loader_poll returns the state of a loader.
+/// \param l A Loader.
+/// \param bytes This will be set to the number of bytes read so far.
+/// \return The state.
+LoaderState loader_poll(Loader *l, size_t *bytes);
+
+/// loader_free stops the thread, if it is still running, closes the file
+/// descriptor and frees a Loader. Sets l to NULL.
+/// \param l A Loader.
+void loader_free(Loader **l);
+
+
+#endif
@@ -6,6 +6,7 @@
 #include <stdint.h>
 #include <signal.h>
 #include <stdbool.h>
+#include <unistd.h>
 
 #include <sys/ioctl.h>
 
@@ -18,14 +19,29 @@
 #include "buffer.h"
 #include "editor.h"
 #include "utf8.h"
+#include "pool.h"
 
 
+// The default number of seconds between journal writes (see journal.h).
+#define JOURNAL_INTERVAL 2
+// The default undo history per buffer in megabytes.
+#define UNDO_LIMIT 128
+// The most threads, that read files ahead (see buffer_update_preload).
+#define PRELOAD_MAX_THREADS 8
+
+static void usage(void);
 static void sigcont_handler(int unused);
 static void sigwinch_handler(int unused);
 
 static Editor *e;
 
 
+static void
+usage(void) {
+	fprintf(stderr, "Usage: drte [-j seconds] [-k] [-m megabytes] [-u megabytes] [file | -, ...]\n");
+	exit(-1);
+}
+
 static void
 sigcont_handler(int unused) {
 	(void)unused;
@@ -42,6 +58,42 @@ sigwinch_handler(int unused) {
 
 int
 main(int argc, char **argv) {
+	unsigned journal_interval = JOURNAL_INTERVAL;
+	size_t stream_limit = 0;
+	size_t undo_limit = UNDO_LIMIT * 1024 * 1024;
+	bool keep_history = false;
+	size_t files = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "j:km:u:")) != -1) {
+		char *end;
+
+		switch (opt) {
+		case 'j':
+			journal_interval = strtoul(optarg, &end, 10);
+			if (*optarg == '\0' || *end != '\0') {
+				usage();
+			}
+			break;
+		case 'k':
+			keep_history = true;
+			break;
+		case 'm':
+			stream_limit = strtoul(optarg, &end, 10) * 1024 * 1024;
+			if (*optarg == '\0' || *end != '\0') {
+				usage();
+			}
+			break;
+		case 'u':
+			undo_limit = strtoul(optarg, &end, 10) * 1024 * 1024;
+			if (*optarg == '\0' || *end != '\0') {
+				usage();
+			}
+			break;
+		default:
+			usage();
+		}
+	}
 
 	e = malloc(sizeof(*e));
 	if (e == NULL) {
@@ -49,6 +101,9 @@ main(int argc, char **argv) {
 		exit(-1);
 	}
 	memset(e, 0, sizeof(*e));
+	e->journal_interval = journal_interval;
+	e->undo_limit = undo_limit;
+	e->keep_history = keep_history;
 
 	e->macro_info.chunk_list = chunk_list_new(4096);
 	if (e->macro_info.chunk_list == NULL) {
@@ -64,19 +119,35 @@ main(int argc, char **argv) {
 
 	resize(e);
 
-	for (int i = 1; i < argc; i++) {
-		char *s = strdup(argv[i]);
-		if (s == NULL) {
-			fprintf(stderr, "Out of memory\n");
-			exit(-1);
+	for (int i = optind; i < argc; i++) {
+		Buffer *b;
+
+		if (strcmp(argv[i], "-") == 0) {
+			// Input is read from the terminal, so stdin can be a pipe.
+			b = buffer_new_stream(e, STDIN_FILENO, stream_limit);
+		} else {
+			char *s = strdup(argv[i]);
+			if (s == NULL) {
+				fprintf(stderr, "Out of memory\n");
+				exit(-1);
+			}
+			// The file is read on the pool or when the buffer is shown.
+			b = buffer_new_lazy(e, s);
+			files++;
 		}
-		Buffer *b = buffer_new(e, s);
 		if (b != NULL) {
 			buffer_append(&(e->current_buffer), b);
 		}
 	}
 	if (e->current_buffer == NULL) {
 		buffer_append(&(e->current_buffer), buffer_new(e, NULL));
+	} else if (files > 1) {
+		long threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+		// Without a pool, the files are still read, when they are shown.
+		threads = threads < 1 ? 1 : threads;
+		threads = threads > PRELOAD_MAX_THREADS ? PRELOAD_MAX_THREADS : threads;
+		e->pool = pool_new(threads);
 	}
 	if (e->current_buffer == NULL) {
 		fprintf(stderr, "Ouf of memory\n");
@@ -168,7 +168,7 @@ static void
 file_chooser_draw_func(Editor *e) {
 	Buffer *b = e->current_buffer;
 	char *text = gbf_text(b->gbuf);
-	size_t text_len = strlen(text);
+	size_t text_len = gbf_text_length(b->gbuf);
 	size_t lines = b->win->size.lines;
 	size_t line = 0;
 	MenuItemList *items = b->menu_items;
@@ -338,7 +338,7 @@ menu_choose_file(Editor *e) {
 	e->current_buffer = b;
 
 	cwd = getcwd(NULL, 0);
-	gbf_insert(path, cwd, 0);
+	gbf_insert_n(path, cwd, strlen(cwd), 0);
 	free(cwd);
 
 	do {
@@ -383,8 +383,8 @@ menu_choose_file(Editor *e) {
 		if (selected != NULL) {
 			char *cp;
 
-			gbf_insert(path, "/", gbf_text_length(path));
-			gbf_insert(path, selected, gbf_text_length(path));
+			gbf_insert_n(path, "/", 1, gbf_text_length(path));
+			gbf_insert_n(path, selected, strlen(selected), gbf_text_length(path));
 			free(selected);
 
 			cp = gbf_text(path);
@@ -413,7 +413,7 @@ static void
 buffer_chooser_draw_func(Editor *e) {
 	Buffer *b = e->current_buffer;
 	char *text = gbf_text(b->gbuf);
-	size_t text_len = strlen(text);
+	size_t text_len = gbf_text_length(b->gbuf);
 	size_t lines = b->win->size.lines;
 	size_t line = 0;
 	MenuItemList *items = b->menu_items;
@@ -0,0 +1,443 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "piece_table.h"
+#include "static.h"
+
+
+// A Piece describes a run of bytes in the store.
+typedef struct {
+	char *start; // The first byte.
+	size_t length; // The number of bytes.
+} Piece;
+
+// A Block is a part of the append-only store.
+typedef struct Block {
+	struct Block *next; // The previous block.
+	size_t size; // The number of bytes in data.
+	size_t used; // The number of used bytes in data.
+	char data[]; // The stored bytes.
+} Block;
+
+struct PieceTable {
+	Piece *pieces; // The pieces, in text order. No piece is empty.
+	size_t npieces; // The number of pieces.
+	size_t capacity; // The number of pieces, that fit into pieces.
+	size_t *starts; // The offsets of the pieces.
+	size_t valid; // starts[0] ... starts[valid - 1] are up to date.
+	size_t length; // The length of the text.
+	Block *blocks; // The store. New bytes are appended to the first block.
+	char *mapping; // A mapped file, the pieces may point into, or NULL.
+	size_t mapping_size; // The size of the mapping.
+};
+
+STATIC size_t find_piece(PieceTable *pt, size_t offset, size_t *rel);
+STATIC bool reserve_pieces(PieceTable *pt, size_t n);
+STATIC void insert_pieces(PieceTable *pt, size_t index, size_t n);
+STATIC void remove_pieces(PieceTable *pt, size_t index, size_t n);
+STATIC void invalidate_starts(PieceTable *pt, size_t index);
+STATIC void insert_stored(PieceTable *pt, size_t len, size_t offset);
+STATIC void free_blocks(PieceTable *pt);
+STATIC void unmap_file(PieceTable *pt);
+
+// The minimum size of a block in the store.
+STATIC size_t BLOCK_SIZE = 64 * 1024;
+
+// Returns the index of the piece containing offset and sets rel to the position
+// inside the piece. offset must be smaller than the text length.
+// Piece offsets are computed lazily: Edits only invalidate the offsets after
+// the changed piece, so repeated edits at the same place do not touch the
+// rest of the table.
+STATIC size_t
+find_piece(PieceTable *pt, size_t offset, size_t *rel) {
+	size_t lo = 0;
+	size_t hi;
+
+	while (pt->valid < pt->npieces) {
+		size_t i = pt->valid;
+		if (i > 0 && pt->starts[i - 1] + pt->pieces[i - 1].length > offset) {
+			break;
+		}
+		pt->starts[i] = i == 0 ? 0 : pt->starts[i - 1] + pt->pieces[i - 1].length;
+		pt->valid++;
+	}
+	hi = pt->valid;
+	while (hi - lo > 1) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (pt->starts[mid] <= offset) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+	*rel = offset - pt->starts[lo];
+	return lo;
+}
+
+// Makes room for n pieces.
+STATIC bool
+reserve_pieces(PieceTable *pt, size_t n) {
+	size_t capacity = pt->capacity;
+	void *new;
+
+	if (n <= capacity) {
+		return true;
+	}
+	while (capacity < n) {
+		capacity *= 2;
+	}
+	new = realloc(pt->pieces, capacity * sizeof(*pt->pieces));
+	if (new == NULL) {
+		return false;
+	}
+	pt->pieces = new;
+	new = realloc(pt->starts, capacity * sizeof(*pt->starts));
+	if (new == NULL) {
+		return false;
+	}
+	pt->starts = new;
+	pt->capacity = capacity;
+
+	return true;
+}
+
+// Inserts n uninitialized pieces before index. There must be room for them.
+STATIC void
+insert_pieces(PieceTable *pt, size_t index, size_t n) {
+	memmove(&pt->pieces[index + n], &pt->pieces[index],
+			(pt->npieces - index) * sizeof(*pt->pieces));
+	pt->npieces += n;
+	invalidate_starts(pt, index);
+}
+
+// Removes n pieces, starting at index.
+STATIC void
+remove_pieces(PieceTable *pt, size_t index, size_t n) {
+	memmove(&pt->pieces[index], &pt->pieces[index + n],
+			(pt->npieces - index - n) * sizeof(*pt->pieces));
+	pt->npieces -= n;
+	invalidate_starts(pt, index);
+}
+
+// Marks the offsets of the pieces, starting at index, as outdated.
+STATIC void
+invalidate_starts(PieceTable *pt, size_t index) {
+	if (pt->valid > index) {
+		pt->valid = index;
+	}
+}
+
+STATIC void
+free_blocks(PieceTable *pt) {
+	while (pt->blocks != NULL) {
+		Block *next = pt->blocks->next;
+		free(pt->blocks);
+		pt->blocks = next;
+	}
+}
+
+STATIC void
+unmap_file(PieceTable *pt) {
+	if (pt->mapping != NULL) {
+		munmap(pt->mapping, pt->mapping_size);
+		pt->mapping = NULL;
+		pt->mapping_size = 0;
+	}
+}
+
+PieceTable *
+piece_table_new(void) {
+	PieceTable *pt = malloc(sizeof(*pt));
+
+	if (pt == NULL) {
+		return NULL;
+	}
+	memset(pt, 0, sizeof(*pt));
+	pt->capacity = 16;
+	pt->pieces = malloc(pt->capacity * sizeof(*pt->pieces));
+	pt->starts = malloc(pt->capacity * sizeof(*pt->starts));
+	if (pt->pieces == NULL || pt->starts == NULL) {
+		piece_table_free(&pt);
+		return NULL;
+	}
+	return pt;
+}
+
+void
+piece_table_free(PieceTable **pt) {
+	if (*pt == NULL) {
+		return;
+	}
+	free_blocks(*pt);
+	unmap_file(*pt);
+	free((*pt)->pieces);
+	free((*pt)->starts);
+	free(*pt);
+	*pt = NULL;
+}
+
+bool
+piece_table_map_file(PieceTable *pt, int fd, size_t size) {
+	char *mapping;
+
+	if (pt->length != 0 || pt->mapping != NULL) {
+		return false;
+	}
+	if (size == 0) {
+		return true;
+	}
+	mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (mapping == MAP_FAILED) {
+		return false;
+	}
+	pt->mapping = mapping;
+	pt->mapping_size = size;
+	pt->pieces[0].start = mapping;
+	pt->pieces[0].length = size;
+	pt->npieces = 1;
+	pt->valid = 0;
+	pt->length = size;
+
+	return true;
+}
+
+bool
+piece_table_is_mapped(PieceTable *pt) {
+	return pt->mapping != NULL;
+}
+
+PieceTable *
+piece_table_snapshot(PieceTable *pt) {
+	PieceTable *copy = piece_table_new();
+
+	if (copy == NULL || !reserve_pieces(copy, pt->npieces)) {
+		piece_table_free(&copy);
+		return NULL;
+	}
+	// The copy has no blocks and no mapping of its own, so freeing it does
+	// not free the shared bytes.
+	memcpy(copy->pieces, pt->pieces, pt->npieces * sizeof(*pt->pieces));
+	copy->npieces = pt->npieces;
+	copy->length = pt->length;
+	return copy;
+}
+
+size_t
+piece_table_length(PieceTable *pt) {
+	return pt->length;
+}
+
+bool
+piece_table_reserve(PieceTable *pt, size_t bytes) {
+	size_t size = bytes > BLOCK_SIZE ? bytes : BLOCK_SIZE;
+	Block *block;
+
+	if (pt->blocks != NULL && pt->blocks->size - pt->blocks->used >= bytes) {
+		return true;
+	}
+	block = malloc(sizeof(*block) + size);
+	if (block == NULL) {
+		return false;
+	}
+	block->size = size;
+	block->used = 0;
+	block->next = pt->blocks;
+	pt->blocks = block;
+
+	return true;
+}
+
+// Inserts the len bytes at the end of the first block at offset. The space for
+// the bytes and for two more pieces must be reserved.
+STATIC void
+insert_stored(PieceTable *pt, size_t len, size_t offset) {
+	Piece new;
+	size_t k;
+	size_t rel;
+
+	new.start = pt->blocks->data + pt->blocks->used;
+	new.length = len;
+	pt->blocks->used += len;
+	pt->length += len;
+
+	if (offset == 0) {
+		insert_pieces(pt, 0, 1);
+		pt->pieces[0] = new;
+		return;
+	}
+
+	k = find_piece(pt, offset - 1, &rel);
+	rel++;
+	if (rel == pt->pieces[k].length) {
+		if (pt->pieces[k].start + rel == new.start) {
+			// The bytes follow the piece in the store. This happens when typing.
+			pt->pieces[k].length += len;
+			invalidate_starts(pt, k + 1);
+			return;
+		}
+		insert_pieces(pt, k + 1, 1);
+		pt->pieces[k + 1] = new;
+		return;
+	}
+
+	// Split piece k.
+	insert_pieces(pt, k + 1, 2);
+	pt->pieces[k + 1] = new;
+	pt->pieces[k + 2].start = pt->pieces[k].start + rel;
+	pt->pieces[k + 2].length = pt->pieces[k].length - rel;
+	pt->pieces[k].length = rel;
+}
+
+bool
+piece_table_insert(PieceTable *pt, char *s, size_t len, size_t offset) {
+	if (len == 0) {
+		return true;
+	}
+	// Allocate everything first, so a failure leaves the text unchanged.
+	if (!piece_table_reserve(pt, len) || !reserve_pieces(pt, pt->npieces + 2)) {
+		return false;
+	}
+	memcpy(pt->blocks->data + pt->blocks->used, s, len);
+	insert_stored(pt, len, offset);
+
+	return true;
+}
+
+bool
+piece_table_read(PieceTable *pt, int fd, size_t len, size_t offset, size_t *bytes,
+                 char **text) {
+	ssize_t n;
+
+	*bytes = 0;
+	if (len == 0) {
+		return true;
+	}
+	if (!piece_table_reserve(pt, len) || !reserve_pieces(pt, pt->npieces + 2)) {
+		errno = ENOMEM;
+		return false;
+	}
+	do {
+		n = read(fd, pt->blocks->data + pt->blocks->used, len);
+	} while (n == -1 && errno == EINTR);
+	if (n == -1) {
+		return false;
+	}
+	if (n > 0) {
+		*text = pt->blocks->data + pt->blocks->used;
+		*bytes = n;
+		insert_stored(pt, n, offset);
+	}
+	return true;
+}
+
+char *
+piece_table_write_begin(PieceTable *pt, size_t len) {
+	if (!piece_table_reserve(pt, len)) {
+		return NULL;
+	}
+	return pt->blocks->data + pt->blocks->used;
+}
+
+char *
+piece_table_write_commit(PieceTable *pt, size_t offset, size_t len) {
+	char *text = pt->blocks->data + pt->blocks->used;
+
+	if (!reserve_pieces(pt, pt->npieces + 2)) {
+		return NULL;
+	}
+	insert_stored(pt, len, offset);
+	return text;
+}
+
+bool
+piece_table_delete(PieceTable *pt, size_t offset, size_t bytes) {
+	size_t ka;
+	size_t ra;
+	size_t kb;
+	size_t rb;
+	size_t first;
+	size_t last;
+
+	if (bytes == 0) {
+		return true;
+	}
+	ka = find_piece(pt, offset, &ra);
+	kb = find_piece(pt, offset + bytes - 1, &rb);
+	rb++;
+
+	if (ka == kb && ra > 0 && rb < pt->pieces[ka].length) {
+		// The deleted bytes are in the middle of a piece.
+		if (!reserve_pieces(pt, pt->npieces + 1)) {
+			return false;
+		}
+		insert_pieces(pt, ka + 1, 1);
+		pt->pieces[ka + 1].start = pt->pieces[ka].start + rb;
+		pt->pieces[ka + 1].length = pt->pieces[ka].length - rb;
+		pt->pieces[ka].length = ra;
+		pt->length -= bytes;
+		return true;
+	}
+
+	// Cut the end of piece ka and the start of piece kb, then remove all
+	// pieces in between and all pieces that became empty.
+	first = ka;
+	if (ra > 0) {
+		pt->pieces[ka].length = ra;
+		first++;
+	}
+	last = kb + 1;
+	if (rb < pt->pieces[kb].length) {
+		pt->pieces[kb].start += rb;
+		pt->pieces[kb].length -= rb;
+		last--;
+	}
+	remove_pieces(pt, first, last - first);
+	invalidate_starts(pt, ka + 1);
+	pt->length -= bytes;
+
+	return true;
+}
+
+void
+piece_table_clear(PieceTable *pt) {
+	free_blocks(pt);
+	unmap_file(pt);
+	pt->npieces = 0;
+	pt->valid = 0;
+	pt->length = 0;
+}
+
+size_t
+piece_table_chunk(PieceTable *pt, size_t offset, char **chunk) {
+	size_t k;
+	size_t rel;
+
+	if (offset >= pt->length) {
+		*chunk = NULL;
+		return 0;
+	}
+	k = find_piece(pt, offset, &rel);
+	*chunk = pt->pieces[k].start + rel;
+	return pt->pieces[k].length - rel;
+}
+
+size_t
+piece_table_chunk_reverse(PieceTable *pt, size_t offset, char **chunk) {
+	size_t k;
+	size_t rel;
+
+	if (offset == 0) {
+		*chunk = NULL;
+		return 0;
+	}
+	k = find_piece(pt, offset - 1, &rel);
+	*chunk = pt->pieces[k].start;
+	return rel + 1;
+}
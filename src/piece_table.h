@@ -0,0 +1,146 @@
+#ifndef DRTE_PIECE_TABLE_H
+#define DRTE_PIECE_TABLE_H
+
+/// \file
+/// piece_table.h implements a piece table, a text store for large texts.
+///
+/// Usage:
+/// \code
+/// #include <stdbool.h>
+/// #include <stdlib.h>
+///
+/// #include "piece_table.h"
+/// \endcode
+///
+/// The text is described by a list of pieces. Every piece points to a run of
+/// bytes in an append-only store. Inserted text is appended to the store and
+/// a piece for it is added to the list, deleted text is cut out of the pieces.
+/// The stored bytes are never moved, so the cost of an edit depends on the
+/// number of pieces, not on the length of the text.
+///
+/// The store is a list of blocks. A block is never reallocated, so pointers into
+/// the text stay valid while bytes are appended.
+///
+/// The initial text can be a read-only mapping of a file (piece_table_map_file).
+/// Opening a file then only costs the mmap call: Pages are read when they are
+/// accessed and only edits are stored on the heap.
+
+/// A piece table.
+typedef struct PieceTable PieceTable;
+
+/// piece_table_new creates an empty PieceTable.
+/// \return A new PieceTable or NULL, if out of memory.
+///         The PieceTable needs to be freed with piece_table_free.
+PieceTable *piece_table_new(void);
+
+/// piece_table_free frees a PieceTable and sets pt to NULL.
+/// \param pt A PieceTable.
+void piece_table_free(PieceTable **pt);
+
+/// piece_table_map_file maps a file read-only and makes it the text of an empty
+/// PieceTable. The mapping is private, but changes made to the file by other
+/// programs may still become visible. The file must not be truncated while
+/// it is mapped.
+/// \param pt An empty PieceTable.
+/// \param fd A file descriptor opened for reading. It can be closed afterwards.
+/// \param size The size of the file.
+/// \return true on success, false if pt is not empty or if mmap failed.
+bool piece_table_map_file(PieceTable *pt, int fd, size_t size);
+
+/// piece_table_is_mapped checks, if the text may refer to a mapped file.
+/// \param pt A PieceTable.
+/// \return true if a file is mapped, false otherwise.
+bool piece_table_is_mapped(PieceTable *pt);
+
+/// piece_table_snapshot creates a copy of the text, that shares the stored
+/// bytes and the mapped file with pt. Only the list of pieces is copied, so
+/// this is cheap. Later edits of pt do not change the copy, because stored
+/// bytes are never changed.
+/// pt must not be cleared or freed, while the copy is used. The copy must
+/// not be changed.
+/// \param pt A PieceTable.
+/// \return A new PieceTable or NULL, if out of memory.
+///         The copy needs to be freed with piece_table_free.
+PieceTable *piece_table_snapshot(PieceTable *pt);
+
+/// piece_table_length returns the length of the text.
+/// \param pt A PieceTable.
+/// \return The text length in bytes.
+size_t piece_table_length(PieceTable *pt);
+
+/// piece_table_reserve makes room for at least bytes bytes in the store, so that
+/// inserting up to bytes bytes does not allocate memory.
+/// \param pt A PieceTable.
+/// \param bytes The number of bytes.
+/// \return true on success, false if out of memory.
+bool piece_table_reserve(PieceTable *pt, size_t bytes);
+
+/// piece_table_insert inserts len bytes at offset.
+/// \param pt A PieceTable.
+/// \param s The bytes to insert.
+/// \param len The number of bytes.
+/// \param offset The position. This must not be larger than the text length.
+/// \return true on success, false if out of memory. On failure the text is unchanged.
+bool piece_table_insert(PieceTable *pt, char *s, size_t len, size_t offset);
+
+/// piece_table_read reads up to len bytes from a file and inserts them at
+/// offset. The bytes are read directly into the store.
+/// \param pt A PieceTable.
+/// \param fd A file descriptor opened for reading.
+/// \param len The maximum number of bytes.
+/// \param offset The position. This must not be larger than the text length.
+/// \param bytes This will be set to the number of bytes read. It is 0 at the
+///        end of the file.
+/// \param text This will be set to the inserted bytes, if any were read.
+/// \return true on success, false on error. errno is set to ENOMEM, if out of
+///         memory, or by read. On failure the text is unchanged.
+bool piece_table_read(PieceTable *pt, int fd, size_t len, size_t offset, size_t *bytes,
+                      char **text);
+
+/// piece_table_write_begin makes room for len bytes in the store and returns
+/// it. The bytes become part of the text with piece_table_write_commit.
+/// Nothing else must be inserted in between.
+/// \param pt A PieceTable.
+/// \param len The number of bytes.
+/// \return A pointer to len bytes of memory or NULL, if out of memory.
+char *piece_table_write_begin(PieceTable *pt, size_t len);
+
+/// piece_table_write_commit inserts the next len bytes of the memory returned
+/// by piece_table_write_begin at offset.
+/// \param pt A PieceTable.
+/// \param offset The position. This must not be larger than the text length.
+/// \param len The number of bytes.
+/// \return A pointer to the inserted bytes or NULL, if out of memory.
+///         On failure the text is unchanged.
+char *piece_table_write_commit(PieceTable *pt, size_t offset, size_t len);
+
+/// piece_table_delete deletes bytes bytes at offset.
+/// \param pt A PieceTable.
+/// \param offset The position.
+/// \param bytes The number of bytes. offset + bytes must not be larger than
+///        the text length.
+/// \return true on success, false if out of memory. On failure the text is unchanged.
+bool piece_table_delete(PieceTable *pt, size_t offset, size_t bytes);
+
+/// piece_table_clear deletes all text.
+/// \param pt A PieceTable.
+void piece_table_clear(PieceTable *pt);
+
+/// piece_table_chunk returns the contiguous run of bytes, that starts at offset.
+/// \param pt A PieceTable.
+/// \param offset The position of the first byte.
+/// \param chunk This will be set to the first byte.
+/// \return The number of bytes at chunk or 0, if offset is out of range.
+size_t piece_table_chunk(PieceTable *pt, size_t offset, char **chunk);
+
+/// piece_table_chunk_reverse returns the contiguous run of bytes, that ends
+/// before offset.
+/// \param pt A PieceTable.
+/// \param offset The position after the last byte. This must not be larger
+///        than the text length.
+/// \param chunk This will be set to the first byte of the run.
+/// \return The number of bytes at chunk or 0, if offset is 0.
+size_t piece_table_chunk_reverse(PieceTable *pt, size_t offset, char **chunk);
+
+
+#endif
@@ -0,0 +1,196 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "pool.h"
+#include "worker.h"
+#include "static.h"
+
+
+typedef struct Job {
+	PoolFunc func;
+	void *arg;
+	struct Job *next;
+} Job;
+
+struct Pool {
+	pthread_mutex_t mutex; // Protects the lists and stop.
+	pthread_cond_t added; // Signaled, when a job is added or the pool stops.
+	Job *queued; // The jobs, that wait for a thread.
+	Job *last_queued;
+	Job *finished; // The jobs, that ran and were not taken.
+	size_t pending; // The number of jobs, that were not taken.
+	bool stop; // True, when the threads should return.
+	Worker **workers;
+	size_t threads;
+};
+
+STATIC void serve(void *arg);
+
+
+// Runs the queued jobs, until the pool stops.
+STATIC void
+serve(void *arg) {
+	Pool *p = arg;
+
+	pthread_mutex_lock(&p->mutex);
+	for (;;) {
+		Job *job;
+
+		while (p->queued == NULL && !p->stop) {
+			pthread_cond_wait(&p->added, &p->mutex);
+		}
+		if (p->stop) {
+			break;
+		}
+		job = p->queued;
+		p->queued = job->next;
+		if (p->queued == NULL) {
+			p->last_queued = NULL;
+		}
+		pthread_mutex_unlock(&p->mutex);
+
+		job->func(job->arg);
+
+		pthread_mutex_lock(&p->mutex);
+		job->next = p->finished;
+		p->finished = job;
+	}
+	pthread_mutex_unlock(&p->mutex);
+}
+
+Pool *
+pool_new(size_t threads) {
+	Pool *p = malloc(sizeof(*p));
+
+	if (p == NULL) {
+		return NULL;
+	}
+	p->queued = NULL;
+	p->last_queued = NULL;
+	p->finished = NULL;
+	p->pending = 0;
+	p->stop = false;
+	p->threads = 0;
+	p->workers = malloc(threads * sizeof(*p->workers));
+	if (p->workers == NULL) {
+		free(p);
+		return NULL;
+	}
+	if (pthread_mutex_init(&p->mutex, NULL) != 0) {
+		free(p->workers);
+		free(p);
+		return NULL;
+	}
+	if (pthread_cond_init(&p->added, NULL) != 0) {
+		pthread_mutex_destroy(&p->mutex);
+		free(p->workers);
+		free(p);
+		return NULL;
+	}
+	// Fewer threads are fine, none are not.
+	while (p->threads < threads) {
+		p->workers[p->threads] = worker_new(serve, p);
+		if (p->workers[p->threads] == NULL) {
+			break;
+		}
+		p->threads++;
+	}
+	if (p->threads == 0) {
+		pool_free(&p, NULL);
+	}
+	return p;
+}
+
+size_t
+pool_threads(Pool *p) {
+	return p->threads;
+}
+
+bool
+pool_add(Pool *p, PoolFunc func, void *arg) {
+	Job *job = malloc(sizeof(*job));
+
+	if (job == NULL) {
+		return false;
+	}
+	job->func = func;
+	job->arg = arg;
+	job->next = NULL;
+
+	pthread_mutex_lock(&p->mutex);
+	if (p->last_queued == NULL) {
+		p->queued = job;
+	} else {
+		p->last_queued->next = job;
+	}
+	p->last_queued = job;
+	p->pending++;
+	pthread_cond_signal(&p->added);
+	pthread_mutex_unlock(&p->mutex);
+	return true;
+}
+
+void *
+pool_take(Pool *p) {
+	Job *job;
+	void *arg = NULL;
+
+	pthread_mutex_lock(&p->mutex);
+	job = p->finished;
+	if (job != NULL) {
+		p->finished = job->next;
+		p->pending--;
+	}
+	pthread_mutex_unlock(&p->mutex);
+
+	if (job != NULL) {
+		arg = job->arg;
+		free(job);
+	}
+	return arg;
+}
+
+size_t
+pool_pending(Pool *p) {
+	size_t pending;
+
+	pthread_mutex_lock(&p->mutex);
+	pending = p->pending;
+	pthread_mutex_unlock(&p->mutex);
+	return pending;
+}
+
+void
+pool_free(Pool **p, PoolFunc discard) {
+	Job *lists[2];
+
+	pthread_mutex_lock(&(*p)->mutex);
+	(*p)->stop = true;
+	pthread_cond_broadcast(&(*p)->added);
+	pthread_mutex_unlock(&(*p)->mutex);
+	for (size_t i = 0; i < (*p)->threads; i++) {
+		worker_free(&(*p)->workers[i]);
+	}
+
+	lists[0] = (*p)->queued;
+	lists[1] = (*p)->finished;
+	for (size_t i = 0; i < 2; i++) {
+		while (lists[i] != NULL) {
+			Job *next = lists[i]->next;
+
+			if (discard != NULL) {
+				discard(lists[i]->arg);
+			}
+			free(lists[i]);
+			lists[i] = next;
+		}
+	}
+	pthread_cond_destroy(&(*p)->added);
+	pthread_mutex_destroy(&(*p)->mutex);
+	free((*p)->workers);
+	free(*p);
+	*p = NULL;
+}
@@ -0,0 +1,62 @@
+#ifndef DRTE_POOL_H
+#define DRTE_POOL_H
+
+/// \file
+/// pool.h implements a pool of worker threads, that run jobs in parallel.
+///
+/// Usage:
+/// \code
+/// #include <stdbool.h>
+/// #include <stdlib.h>
+///
+/// #include "pool.h"
+/// \endcode
+///
+/// Jobs are run in the order, in which they were added, by the first idle
+/// thread. A finished job is kept, until the main thread takes it with
+/// pool_take, so the result of a job is handed back to the main thread. A job
+/// owns its argument, while it is in the pool.
+
+/// A pool of worker threads.
+typedef struct Pool Pool;
+
+/// PoolFunc is the type of jobs.
+typedef void (*PoolFunc)(void *arg);
+
+/// pool_new starts a pool of threads.
+/// \param threads The number of threads. It must be at least 1.
+/// \return A new Pool or NULL, if out of memory or no thread could be
+///         started. The Pool needs to be freed with pool_free.
+Pool *pool_new(size_t threads);
+
+/// pool_threads returns the number of threads of a pool.
+/// \param p A Pool.
+/// \return The number of threads.
+size_t pool_threads(Pool *p);
+
+/// pool_add adds a job, that calls func(arg) on one of the threads.
+/// \param p A Pool.
+/// \param func The function.
+/// \param arg The argument of func.
+/// \return true on success, false if out of memory.
+bool pool_add(Pool *p, PoolFunc func, void *arg);
+
+/// pool_take takes a finished job out of the pool.
+/// \param p A Pool.
+/// \return The argument of the job or NULL, if no job has finished.
+void *pool_take(Pool *p);
+
+/// pool_pending returns the number of jobs, that were added, but not taken.
+/// \param p A Pool.
+/// \return The number of jobs.
+size_t pool_pending(Pool *p);
+
+/// pool_free stops the threads, after they finished their current jobs, and
+/// frees a Pool. Sets p to NULL.
+/// \param p A Pool.
+/// \param discard This is called with the arguments of the jobs, that were
+///        not taken, whether they ran or not. It can be NULL.
+void pool_free(Pool **p, PoolFunc discard);
+
+
+#endif
@@ -0,0 +1,311 @@
+#define _XOPEN_SOURCE 700
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "gapbuffer.h"
+#include "input.h"
+#include "display.h"
+#include "funcs.h"
+#include "chunk_list.h"
+#include "menus.h"
+#include "buffer.h"
+#include "save.h"
+#include "journal.h"
+#include "undo.h"
+#include "worker.h"
+#include "static.h"
+
+
+// Files are saved to a temporary file, named after the file with SAVE_SUFFIX
+// appended, which then replaces the file.
+#define SAVE_SUFFIX ".drte-XXXXXX"
+// The number of text segments, that are written with one call to writev.
+#define SAVE_IOVECS 64
+// Files of at least PARTIAL_SAVE_MIN_SIZE bytes are rewritten in place from the
+// first changed byte on.
+#define PARTIAL_SAVE_MIN_SIZE (32 * 1024 * 1024)
+// The most bytes of a mapped text, that are copied to the heap for that.
+// Larger rewrites use a temporary file.
+#define PARTIAL_SAVE_MAX_COPY (64 * 1024 * 1024)
+
+struct Save {
+	Worker *worker;
+	GapBuffer *text; // The snapshot, that is written.
+	char *filename; // A copy of the filename.
+	bool rewrite; // True, if the file is rewritten in place.
+	size_t first; // The first byte, that is rewritten.
+	mode_t mode; // The mode of a new file.
+	// These are set by the worker. They are read after it is done.
+	bool ok; // True, if the file was written.
+	size_t file_size; // The size of the written file.
+	long long file_mtime; // The modification time of the written file or -1.
+	long file_mtime_nsec; // The nanoseconds of file_mtime.
+};
+
+STATIC bool write_text(GapBuffer *gbuf, int fd, size_t start);
+STATIC bool can_rewrite(Buffer *b, size_t *first);
+STATIC bool rewrite_file(GapBuffer *gbuf, char *filename, size_t first);
+STATIC bool replace_file(GapBuffer *gbuf, char *filename, mode_t mode);
+STATIC void write_file(void *arg);
+
+
+// Writes the text, from start on, to fd. The segments of the text are written
+// directly, up to SAVE_IOVECS at once. Returns true on success.
+STATIC bool
+write_text(GapBuffer *gbuf, int fd, size_t start) {
+	struct iovec iov[SAVE_IOVECS];
+	size_t off = start;
+
+	for (;;) {
+		size_t next = off;
+		size_t len;
+		char *chunk;
+		int n = 0;
+		ssize_t written;
+
+		while (n < SAVE_IOVECS && (len = gbf_chunk(gbuf, next, &chunk)) > 0) {
+			iov[n].iov_base = chunk;
+			iov[n].iov_len = len;
+			next += len;
+			n++;
+		}
+		if (n == 0) {
+			return true;
+		}
+		// A short write is continued at the first byte, that was not written.
+		written = writev(fd, iov, n);
+		if (written == -1 && errno == EINTR) {
+			continue;
+		} else if (written <= 0) {
+			return false;
+		}
+		off += written;
+	}
+}
+
+// Checks, if the file of b can be rewritten in place and finds the first byte,
+// that has to be written.
+STATIC bool
+can_rewrite(Buffer *b, size_t *first) {
+	size_t length = gbf_text_length(b->gbuf);
+	struct stat st;
+
+	if (b->file_mtime == -1 || b->file_size < PARTIAL_SAVE_MIN_SIZE ||
+		stat(b->filename, &st) != 0 || !S_ISREG(st.st_mode)) {
+		return false;
+	}
+	// The file must still contain the text, that was read or written last time.
+	// A rewrite of the same size within a second only changes the nanoseconds.
+	if ((size_t)st.st_size != b->file_size || st.st_mtime != b->file_mtime ||
+		st.st_mtim.tv_nsec != b->file_mtime_nsec) {
+		return false;
+	}
+	if (!gbf_first_change(b->gbuf, first)) {
+		*first = length;
+	}
+	return !gbf_is_mapped(b->gbuf) || length - *first <= PARTIAL_SAVE_MAX_COPY;
+}
+
+// Rewrites filename in place from first on and cuts it off after the text.
+STATIC bool
+rewrite_file(GapBuffer *gbuf, char *filename, size_t first) {
+	bool ok;
+	int fd;
+
+	if ((fd = open(filename, O_WRONLY)) == -1) {
+		return false;
+	}
+	ok = lseek(fd, first, SEEK_SET) != -1 && write_text(gbuf, fd, first);
+	ok = ok && ftruncate(fd, gbf_text_length(gbuf)) == 0;
+	ok = ok && fsync(fd) == 0;
+	ok = close(fd) == 0 && ok;
+	return ok;
+}
+
+// Writes the text to a temporary file in the same directory, which then
+// replaces filename. So filename is never left half-written, and a mapped file
+// is not truncated, while it is read. A new file gets mode, an existing one
+// keeps its mode.
+STATIC bool
+replace_file(GapBuffer *gbuf, char *filename, mode_t mode) {
+	char *target = filename;
+	char *resolved = NULL;
+	char *tmp;
+	struct stat st;
+	bool exists = stat(filename, &st) == 0;
+	bool ok;
+	int fd;
+
+	if (lstat(filename, &st) == 0 && S_ISLNK(st.st_mode)) {
+		// Replace the file, that the link points to, not the link.
+		resolved = realpath(filename, NULL);
+		if (resolved != NULL) {
+			target = resolved;
+		}
+		exists = stat(target, &st) == 0;
+	}
+
+	tmp = malloc(strlen(target) + sizeof(SAVE_SUFFIX));
+	if (tmp == NULL) {
+		free(resolved);
+		return false;
+	}
+	sprintf(tmp, "%s%s", target, SAVE_SUFFIX);
+	if ((fd = mkstemp(tmp)) == -1) {
+		free(tmp);
+		free(resolved);
+		return false;
+	}
+
+	// mkstemp creates the file with mode 0600.
+	ok = fchmod(fd, exists ? st.st_mode & 07777 : mode) == 0;
+	ok = ok && write_text(gbuf, fd, 0);
+	ok = ok && fsync(fd) == 0;
+	ok = close(fd) == 0 && ok;
+	ok = ok && rename(tmp, target) == 0;
+	if (!ok) {
+		unlink(tmp);
+	}
+
+	free(tmp);
+	free(resolved);
+	return ok;
+}
+
+// The worker thread.
+STATIC void
+write_file(void *arg) {
+	Save *s = arg;
+	struct stat st;
+
+	if (s->rewrite) {
+		s->ok = rewrite_file(s->text, s->filename, s->first);
+	} else {
+		s->ok = replace_file(s->text, s->filename, s->mode);
+	}
+	s->file_mtime = -1;
+	if (s->ok && stat(s->filename, &st) == 0) {
+		s->file_size = st.st_size;
+		s->file_mtime = st.st_mtime;
+		s->file_mtime_nsec = st.st_mtim.tv_nsec;
+	}
+}
+
+Save *
+save_start(Buffer *b) {
+	Save *s = malloc(sizeof(*s));
+	size_t length = gbf_text_length(b->gbuf);
+
+	if (s == NULL) {
+		return NULL;
+	}
+	memset(s, 0, sizeof(*s));
+	// The umask can only be read by setting it, which is not done on the
+	// worker thread.
+	s->mode = umask(0);
+	umask(s->mode);
+	s->mode = 0666 & ~s->mode;
+	s->rewrite = can_rewrite(b, &s->first);
+	if (s->rewrite && gbf_is_mapped(b->gbuf) && s->first < length) {
+		// The mapped text would change, while the file is rewritten, so its
+		// part after first is moved to the heap.
+		size_t n = length - s->first;
+		char *copy = malloc(n);
+
+		if (copy == NULL) {
+			free(s);
+			return NULL;
+		}
+		// The text does not change, so this is not recorded in the journal.
+		// The copy is inserted first, so a failure leaves the text unchanged.
+		// The old bytes then end the text and start after a piece, deleting
+		// them splits no piece and needs no memory.
+		gbf_set_journal(b->gbuf, NULL);
+		gbf_text_n(b->gbuf, s->first, n, copy);
+		if (!gbf_insert_n(b->gbuf, copy, n, s->first)) {
+			gbf_set_journal(b->gbuf, b->journal);
+			free(copy);
+			free(s);
+			return NULL;
+		}
+		gbf_delete(b->gbuf, s->first + n, n);
+		gbf_set_journal(b->gbuf, b->journal);
+		free(copy);
+	}
+
+	s->text = gbf_snapshot(b->gbuf);
+	s->filename = malloc(strlen(b->filename) + 1);
+	if (s->text == NULL || s->filename == NULL) {
+		gbf_free(&s->text);
+		free(s->filename);
+		free(s);
+		return NULL;
+	}
+	strcpy(s->filename, b->filename);
+
+	s->worker = worker_new(write_file, s);
+	if (s->worker == NULL) {
+		gbf_free(&s->text);
+		free(s->filename);
+		free(s);
+		return NULL;
+	}
+	gbf_mark_saved(b->gbuf);
+	if (b->journal != NULL) {
+		// The edits after this point apply to the snapshot.
+		journal_mark(b->journal);
+	}
+	if (b->undo != NULL) {
+		undo_mark(b->undo);
+	}
+	return s;
+}
+
+bool
+save_is_done(Save *s) {
+	return worker_is_done(s->worker);
+}
+
+bool
+save_finish(Save **s, Buffer *b) {
+	bool ok;
+
+	worker_free(&(*s)->worker);
+	ok = (*s)->ok;
+	if (ok) {
+		b->file_size = (*s)->file_size;
+		b->file_mtime = (*s)->file_mtime;
+		b->file_mtime_nsec = (*s)->file_mtime_nsec;
+		if (b->journal != NULL) {
+			journal_rebase(b->journal, b->file_size, b->file_mtime);
+		}
+		if (b->undo != NULL) {
+			undo_saved(b->undo);
+		}
+	} else {
+		struct stat st;
+
+		// The file is in an unknown state, the next save writes all of it.
+		b->file_mtime = -1;
+		b->has_changed = true;
+		if ((*s)->rewrite && b->journal != NULL && stat(b->filename, &st) == 0) {
+			// Only the bytes before first are known to be intact. The journal
+			// records the rest of the snapshot, so it fits the file as it is.
+			journal_repair(b->journal, st.st_size, st.st_mtime, (*s)->text, (*s)->first);
+		}
+	}
+
+	gbf_free(&(*s)->text);
+	free((*s)->filename);
+	free(*s);
+	*s = NULL;
+	return ok;
+}
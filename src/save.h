@@ -0,0 +1,55 @@
+#ifndef DRTE_SAVE_H
+#define DRTE_SAVE_H
+
+/// \file
+/// save.h implements writing a buffer to its file on a worker thread.
+///
+/// Usage:
+/// \code
+/// #include <stdbool.h>
+/// #include <stdlib.h>
+///
+/// #include "gapbuffer.h"
+/// #include "input.h"
+/// #include "display.h"
+/// #include "funcs.h"
+/// #include "chunk_list.h"
+/// #include "menus.h"
+/// #include "buffer.h"
+/// #include "save.h"
+/// \endcode
+///
+/// A snapshot of the text is written (see gbf_snapshot), so the buffer can be
+/// edited, while it is saved. Large files, that did not change on disk since
+/// they were read or written, are only rewritten from the first changed byte
+/// on. Other files are written to a temporary file, which then replaces them.
+
+/// A save in progress.
+typedef struct Save Save;
+
+/// save_start starts writing the text of a buffer to its file.
+/// The text counts as saved from now on: gbf_first_change only reports
+/// later edits. If the save fails, save_finish marks the file as unknown,
+/// so the next save writes it completely.
+/// \param b A buffer with a filename, that is not loading or saving.
+/// \return A new Save or NULL, if out of memory. Then nothing was written.
+///         The Save needs to be freed with save_finish.
+Save *save_start(Buffer *b);
+
+/// save_is_done checks, if the file has been written.
+/// \param s A Save.
+/// \return true if the worker is done, false otherwise.
+bool save_is_done(Save *s);
+
+/// save_finish waits, until the file has been written, and frees a Save.
+/// On success, the size and modification time of the file are stored in b
+/// and its journal starts over from the written file (see journal_rebase).
+/// If a rewrite in place fails, the journal starts over from the partly
+/// written file (see journal_repair). Sets s to NULL.
+/// \param s A Save.
+/// \param b The buffer, that was saved.
+/// \return true if the file was written, false otherwise.
+bool save_finish(Save **s, Buffer *b);
+
+
+#endif
@@ -0,0 +1,445 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "scan.h"
+#include "static.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__) && defined(__GNUC__)
+#define SCAN_X86
+#include <immintrin.h>
+
+// Functions marked with AVX2 are only called, if the CPU supports AVX2.
+#define AVX2 __attribute__((target("avx2")))
+
+STATIC bool has_avx2(void);
+STATIC char *nth_in_mask(char *block, uint32_t mask, size_t *n);
+STATIC char *byte_sse2(char *s, size_t len, char c);
+STATIC char *byte_reverse_sse2(char *s, size_t len, char c);
+STATIC size_t count_sse2(char *s, size_t len, char c);
+STATIC char *nth_sse2(char *s, size_t len, char c, size_t *n);
+STATIC AVX2 char *byte_avx2(char *s, size_t len, char c);
+STATIC AVX2 char *byte_reverse_avx2(char *s, size_t len, char c);
+STATIC AVX2 size_t count_avx2(char *s, size_t len, char c);
+STATIC AVX2 char *nth_avx2(char *s, size_t len, char c, size_t *n);
+STATIC char *string_sse2(char *s, size_t len, char *p, size_t plen);
+STATIC char *string_reverse_sse2(char *s, size_t len, char *p, size_t plen);
+STATIC AVX2 char *string_avx2(char *s, size_t len, char *p, size_t plen);
+STATIC AVX2 char *string_reverse_avx2(char *s, size_t len, char *p, size_t plen);
+#endif
+
+STATIC char *string_tail(char *s, size_t from, size_t to, char *p, size_t plen);
+STATIC char *string_tail_reverse(char *s, size_t from, size_t to, char *p, size_t plen);
+
+#ifdef SCAN_X86
+
+STATIC bool
+has_avx2(void) {
+	static int avx2 = -1;
+
+	if (avx2 == -1) {
+		__builtin_cpu_init();
+		avx2 = __builtin_cpu_supports("avx2") != 0;
+	}
+	return avx2;
+}
+
+// Returns the n-th set bit of mask as a pointer into block, or decreases n
+// by the number of set bits.
+STATIC char *
+nth_in_mask(char *block, uint32_t mask, size_t *n) {
+	size_t count = __builtin_popcount(mask);
+
+	if (count < *n) {
+		*n -= count;
+		return NULL;
+	}
+	for (size_t i = 1; i < *n; i++) {
+		mask &= mask - 1;
+	}
+	*n = 0;
+	return block + __builtin_ctz(mask);
+}
+
+STATIC char *
+byte_sse2(char *s, size_t len, char c) {
+	__m128i needle = _mm_set1_epi8(c);
+	size_t i = 0;
+
+	for (; i + 16 <= len; i += 16) {
+		__m128i v = _mm_loadu_si128((__m128i *)(s + i));
+		uint32_t mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, needle));
+		if (mask != 0) {
+			return s + i + __builtin_ctz(mask);
+		}
+	}
+	for (; i < len; i++) {
+		if (s[i] == c) {
+			return s + i;
+		}
+	}
+	return NULL;
+}
+
+STATIC char *
+byte_reverse_sse2(char *s, size_t len, char c) {
+	__m128i needle = _mm_set1_epi8(c);
+
+	for (; len >= 16; len -= 16) {
+		__m128i v = _mm_loadu_si128((__m128i *)(s + len - 16));
+		uint32_t mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, needle));
+		if (mask != 0) {
+			return s + len - 16 + (31 - __builtin_clz(mask));
+		}
+	}
+	while (len > 0) {
+		len--;
+		if (s[len] == c) {
+			return s + len;
+		}
+	}
+	return NULL;
+}
+
+STATIC size_t
+count_sse2(char *s, size_t len, char c) {
+	__m128i needle = _mm_set1_epi8(c);
+	__m128i zero = _mm_setzero_si128();
+	size_t count = 0;
+	size_t i = 0;
+
+	while (i + 16 <= len) {
+		// Matches are counted in 8 bit counters, which are summed up,
+		// before they can overflow.
+		__m128i acc = zero;
+		size_t end = len - i > 16 * 255 ? i + 16 * 255 : len;
+
+		for (; i + 16 <= end; i += 16) {
+			__m128i v = _mm_loadu_si128((__m128i *)(s + i));
+			acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(v, needle));
+		}
+		__m128i sum = _mm_sad_epu8(acc, zero);
+		count += _mm_cvtsi128_si32(sum) + _mm_extract_epi16(sum, 4);
+	}
+	for (; i < len; i++) {
+		count += s[i] == c;
+	}
+	return count;
+}
+
+STATIC char *
+nth_sse2(char *s, size_t len, char c, size_t *n) {
+	__m128i needle = _mm_set1_epi8(c);
+	size_t i = 0;
+	char *found;
+
+	for (; i + 16 <= len; i += 16) {
+		__m128i v = _mm_loadu_si128((__m128i *)(s + i));
+		uint32_t mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, needle));
+		if (mask != 0 && (found = nth_in_mask(s + i, mask, n)) != NULL) {
+			return found;
+		}
+	}
+	for (; i < len; i++) {
+		if (s[i] == c && --(*n) == 0) {
+			return s + i;
+		}
+	}
+	return NULL;
+}
+
+STATIC AVX2 char *
+byte_avx2(char *s, size_t len, char c) {
+	__m256i needle = _mm256_set1_epi8(c);
+	size_t i = 0;
+
+	for (; i + 32 <= len; i += 32) {
+		__m256i v = _mm256_loadu_si256((__m256i *)(s + i));
+		uint32_t mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, needle));
+		if (mask != 0) {
+			return s + i + __builtin_ctz(mask);
+		}
+	}
+	return byte_sse2(s + i, len - i, c);
+}
+
+STATIC AVX2 char *
+byte_reverse_avx2(char *s, size_t len, char c) {
+	__m256i needle = _mm256_set1_epi8(c);
+
+	for (; len >= 32; len -= 32) {
+		__m256i v = _mm256_loadu_si256((__m256i *)(s + len - 32));
+		uint32_t mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, needle));
+		if (mask != 0) {
+			return s + len - 32 + (31 - __builtin_clz(mask));
+		}
+	}
+	return byte_reverse_sse2(s, len, c);
+}
+
+STATIC AVX2 size_t
+count_avx2(char *s, size_t len, char c) {
+	__m256i needle = _mm256_set1_epi8(c);
+	__m256i zero = _mm256_setzero_si256();
+	uint64_t lanes[4];
+	size_t count = 0;
+	size_t i = 0;
+
+	while (i + 32 <= len) {
+		__m256i acc = zero;
+		size_t end = len - i > 32 * 255 ? i + 32 * 255 : len;
+
+		for (; i + 32 <= end; i += 32) {
+			__m256i v = _mm256_loadu_si256((__m256i *)(s + i));
+			acc = _mm256_sub_epi8(acc, _mm256_cmpeq_epi8(v, needle));
+		}
+		_mm256_storeu_si256((__m256i *)lanes, _mm256_sad_epu8(acc, zero));
+		count += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+	}
+	return count + count_sse2(s + i, len - i, c);
+}
+
+STATIC AVX2 char *
+nth_avx2(char *s, size_t len, char c, size_t *n) {
+	__m256i needle = _mm256_set1_epi8(c);
+	size_t i = 0;
+	char *found;
+
+	for (; i + 32 <= len; i += 32) {
+		__m256i v = _mm256_loadu_si256((__m256i *)(s + i));
+		uint32_t mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, needle));
+		if (mask != 0 && (found = nth_in_mask(s + i, mask, n)) != NULL) {
+			return found;
+		}
+	}
+	return nth_sse2(s + i, len - i, c, n);
+}
+
+// The string functions compare the first and the last byte of the pattern at
+// 16 or 32 positions at once and only compare the rest at positions, where
+// both match. Patterns must be at least 2 bytes long.
+STATIC char *
+string_sse2(char *s, size_t len, char *p, size_t plen) {
+	__m128i first = _mm_set1_epi8(p[0]);
+	__m128i last = _mm_set1_epi8(p[plen - 1]);
+	size_t i = 0;
+
+	for (; i + plen - 1 + 16 <= len; i += 16) {
+		__m128i a = _mm_loadu_si128((__m128i *)(s + i));
+		__m128i b = _mm_loadu_si128((__m128i *)(s + i + plen - 1));
+		uint32_t mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first),
+														 _mm_cmpeq_epi8(b, last)));
+		for (; mask != 0; mask &= mask - 1) {
+			size_t k = i + __builtin_ctz(mask);
+			if (memcmp(s + k + 1, p + 1, plen - 2) == 0) {
+				return s + k;
+			}
+		}
+	}
+	return string_tail(s, i, len - plen + 1, p, plen);
+}
+
+STATIC char *
+string_reverse_sse2(char *s, size_t len, char *p, size_t plen) {
+	__m128i first = _mm_set1_epi8(p[0]);
+	__m128i last = _mm_set1_epi8(p[plen - 1]);
+	// The positions before end have not been checked.
+	size_t end = len - plen + 1;
+
+	for (; end >= 16; end -= 16) {
+		__m128i a = _mm_loadu_si128((__m128i *)(s + end - 16));
+		__m128i b = _mm_loadu_si128((__m128i *)(s + end - 16 + plen - 1));
+		uint32_t mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first),
+														 _mm_cmpeq_epi8(b, last)));
+		while (mask != 0) {
+			size_t bit = 31 - __builtin_clz(mask);
+			size_t k = end - 16 + bit;
+			if (memcmp(s + k + 1, p + 1, plen - 2) == 0) {
+				return s + k;
+			}
+			mask &= ~(1u << bit);
+		}
+	}
+	return string_tail_reverse(s, 0, end, p, plen);
+}
+
+STATIC AVX2 char *
+string_avx2(char *s, size_t len, char *p, size_t plen) {
+	__m256i first = _mm256_set1_epi8(p[0]);
+	__m256i last = _mm256_set1_epi8(p[plen - 1]);
+	size_t i = 0;
+
+	for (; i + plen - 1 + 32 <= len; i += 32) {
+		__m256i a = _mm256_loadu_si256((__m256i *)(s + i));
+		__m256i b = _mm256_loadu_si256((__m256i *)(s + i + plen - 1));
+		uint32_t mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first),
+															   _mm256_cmpeq_epi8(b, last)));
+		for (; mask != 0; mask &= mask - 1) {
+			size_t k = i + __builtin_ctz(mask);
+			if (memcmp(s + k + 1, p + 1, plen - 2) == 0) {
+				return s + k;
+			}
+		}
+	}
+	return string_tail(s, i, len - plen + 1, p, plen);
+}
+
+STATIC AVX2 char *
+string_reverse_avx2(char *s, size_t len, char *p, size_t plen) {
+	__m256i first = _mm256_set1_epi8(p[0]);
+	__m256i last = _mm256_set1_epi8(p[plen - 1]);
+	size_t end = len - plen + 1;
+
+	for (; end >= 32; end -= 32) {
+		__m256i a = _mm256_loadu_si256((__m256i *)(s + end - 32));
+		__m256i b = _mm256_loadu_si256((__m256i *)(s + end - 32 + plen - 1));
+		uint32_t mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first),
+															   _mm256_cmpeq_epi8(b, last)));
+		while (mask != 0) {
+			size_t bit = 31 - __builtin_clz(mask);
+			size_t k = end - 32 + bit;
+			if (memcmp(s + k + 1, p + 1, plen - 2) == 0) {
+				return s + k;
+			}
+			mask &= ~(1u << bit);
+		}
+	}
+	return string_tail_reverse(s, 0, end, p, plen);
+}
+#endif
+
+// Checks the positions from ... to - 1 for the pattern, from left to right.
+STATIC char *
+string_tail(char *s, size_t from, size_t to, char *p, size_t plen) {
+	char *c = s + from;
+
+	while (c < s + to && (c = scan_byte(c, s + to - c, p[0])) != NULL) {
+		if (memcmp(c + 1, p + 1, plen - 1) == 0) {
+			return c;
+		}
+		c++;
+	}
+	return NULL;
+}
+
+// Checks the positions from ... to - 1 for the pattern, from right to left.
+STATIC char *
+string_tail_reverse(char *s, size_t from, size_t to, char *p, size_t plen) {
+	char *c;
+
+	while (to > from && (c = scan_byte_reverse(s + from, to - from, p[0])) != NULL) {
+		if (memcmp(c + 1, p + 1, plen - 1) == 0) {
+			return c;
+		}
+		to = c - s;
+	}
+	return NULL;
+}
+
+char *
+scan_byte(char *s, size_t len, char c) {
+#ifdef SCAN_X86
+	if (has_avx2()) {
+		return byte_avx2(s, len, c);
+	}
+	return byte_sse2(s, len, c);
+#else
+	return memchr(s, c, len);
+#endif
+}
+
+char *
+scan_byte_reverse(char *s, size_t len, char c) {
+#ifdef SCAN_X86
+	if (has_avx2()) {
+		return byte_reverse_avx2(s, len, c);
+	}
+	return byte_reverse_sse2(s, len, c);
+#else
+	while (len > 0) {
+		len--;
+		if (s[len] == c) {
+			return s + len;
+		}
+	}
+	return NULL;
+#endif
+}
+
+size_t
+scan_count(char *s, size_t len, char c) {
+#ifdef SCAN_X86
+	if (has_avx2()) {
+		return count_avx2(s, len, c);
+	}
+	return count_sse2(s, len, c);
+#else
+	size_t count = 0;
+
+	for (size_t i = 0; i < len; i++) {
+		count += s[i] == c;
+	}
+	return count;
+#endif
+}
+
+char *
+scan_nth(char *s, size_t len, char c, size_t *n) {
+	if (*n == 0) {
+		return NULL;
+	}
+#ifdef SCAN_X86
+	if (has_avx2()) {
+		return nth_avx2(s, len, c, n);
+	}
+	return nth_sse2(s, len, c, n);
+#else
+	char *end = s + len;
+	char *found;
+
+	while ((found = memchr(s, c, end - s)) != NULL) {
+		if (--(*n) == 0) {
+			return found;
+		}
+		s = found + 1;
+	}
+	return NULL;
+#endif
+}
+
+char *
+scan_string(char *s, size_t len, char *p, size_t plen) {
+	if (plen == 0 || plen > len) {
+		return NULL;
+	}
+	if (plen == 1) {
+		return scan_byte(s, len, p[0]);
+	}
+#ifdef SCAN_X86
+	if (has_avx2()) {
+		return string_avx2(s, len, p, plen);
+	}
+	return string_sse2(s, len, p, plen);
+#else
+	return string_tail(s, 0, len - plen + 1, p, plen);
+#endif
+}
+
+char *
+scan_string_reverse(char *s, size_t len, char *p, size_t plen) {
+	if (plen == 0 || plen > len) {
+		return NULL;
+	}
+	if (plen == 1) {
+		return scan_byte_reverse(s, len, p[0]);
+	}
+#ifdef SCAN_X86
+	if (has_avx2()) {
+		return string_reverse_avx2(s, len, p, plen);
+	}
+	return string_reverse_sse2(s, len, p, plen);
+#else
+	return string_tail_reverse(s, 0, len - plen + 1, p, plen);
+#endif
+}
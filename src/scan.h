@@ -0,0 +1,65 @@
+#ifndef DRTE_SCAN_H
+#define DRTE_SCAN_H
+
+/// \file
+/// scan.h implements fast functions to find and count bytes and patterns in memory.
+///
+/// Usage:
+/// \code
+/// #include <stdlib.h>
+///
+/// #include "scan.h"
+/// \endcode
+///
+/// On x86 the functions compare 16 (SSE2) or 32 (AVX2) bytes at once. AVX2 is
+/// used, if the CPU supports it. Other platforms use a portable version.
+/// The GapBuffer uses these functions to find lines and to search.
+
+/// scan_byte finds the first occurrence of c.
+/// \param s The memory to search.
+/// \param len The length of s.
+/// \param c The byte to find.
+/// \return A pointer to the first c or NULL, if s does not contain c.
+char *scan_byte(char *s, size_t len, char c);
+
+/// scan_byte_reverse finds the last occurrence of c.
+/// \param s The memory to search.
+/// \param len The length of s.
+/// \param c The byte to find.
+/// \return A pointer to the last c or NULL, if s does not contain c.
+char *scan_byte_reverse(char *s, size_t len, char c);
+
+/// scan_count counts the occurrences of c.
+/// \param s The memory to search.
+/// \param len The length of s.
+/// \param c The byte to count.
+/// \return The number of bytes in s, that are equal to c.
+size_t scan_count(char *s, size_t len, char c);
+
+/// scan_nth finds the n-th occurrence of c. Larger texts can be searched in
+/// parts: If s contains less than n bytes c, n is decreased by their number.
+/// \param s The memory to search.
+/// \param len The length of s.
+/// \param c The byte to find.
+/// \param n The number of the occurrence, starting at 1.
+/// \return A pointer to the n-th c or NULL, if there are not enough of them.
+char *scan_nth(char *s, size_t len, char c, size_t *n);
+
+/// scan_string finds the first occurrence of a pattern.
+/// \param s The memory to search.
+/// \param len The length of s.
+/// \param p The pattern. It may contain any bytes.
+/// \param plen The length of the pattern.
+/// \return A pointer to the first match or NULL, if there is none.
+char *scan_string(char *s, size_t len, char *p, size_t plen);
+
+/// scan_string_reverse finds the last occurrence of a pattern.
+/// \param s The memory to search.
+/// \param len The length of s.
+/// \param p The pattern. It may contain any bytes.
+/// \param plen The length of the pattern.
+/// \return A pointer to the last match or NULL, if there is none.
+char *scan_string_reverse(char *s, size_t len, char *p, size_t plen);
+
+
+#endif
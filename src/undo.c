@@ -0,0 +1,645 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "gapbuffer.h"
+#include "undo.h"
+#include "static.h"
+
+
+// The bytes of the records are stored in chunks of UNDO_CHUNK_SIZE bytes. Larger
+// records get a chunk of their own.
+#define UNDO_CHUNK_SIZE (64 * 1024)
+// Edits of up to MERGE_CHAR_SIZE bytes, one UTF-8 character, are merged, until
+// a record has MERGE_MAX_SIZE bytes.
+#define MERGE_CHAR_SIZE 4
+#define MERGE_MAX_SIZE 1024
+// The initial number of records.
+#define INITIAL_RECORDS 64
+// The first bytes of a history file.
+#define HISTORY_MAGIC "DRTEUNDO"
+#define HISTORY_MAGIC_LENGTH 8
+// A history file starts with the magic, the size and the modification time of
+// the file plus one, the number of records and the position of the index. The
+// bytes of the records follow, then the index: The offset, the length, the
+// position of the bytes and the type of each record. All numbers are 64 bit
+// integers in host byte order, so a record is found without reading the others.
+#define HISTORY_HEADER_LENGTH (HISTORY_MAGIC_LENGTH + 4 * 8)
+#define HISTORY_ENTRY_LENGTH (4 * 8)
+
+typedef struct UndoChunk {
+	struct UndoChunk *next;
+	size_t size;
+	size_t used;
+	char text[];
+} UndoChunk;
+
+typedef struct Record {
+	bool insert; // True for an insert, false for a delete.
+	bool merging; // True, if single characters are merged into the record.
+	size_t offset;
+	size_t len;
+	UndoChunk *chunk; // The chunk, that contains text.
+	char *text;
+} Record;
+
+struct Undo {
+	char *map; // The history file or NULL (see undo_open_history).
+	size_t map_size;
+	size_t map_first; // The oldest record in the history file.
+	size_t map_current; // Like current for the records in the history file.
+	size_t map_end; // The end of the records in the history file.
+	size_t map_records; // The number of records in the history file.
+	size_t index; // The position of the index in the history file.
+	Record *records;
+	size_t first; // The oldest record.
+	size_t current; // The records before current can be undone, the others redone.
+	size_t n; // The end of the records.
+	size_t size; // The number of allocated records.
+	UndoChunk *chunks; // The chunk of the oldest record.
+	UndoChunk *last; // The chunk, that bytes are appended to.
+	size_t bytes; // The size of all chunks.
+	size_t limit;
+	bool sealed; // True, if the next edit must not be merged.
+	// The position of the text, when it was last saved, and when the last save
+	// started, counted in records from the oldest one, or SIZE_MAX if the
+	// records do not reach back to it.
+	size_t saved;
+	size_t marked;
+};
+
+STATIC char *alloc_text(Undo *u, size_t len, UndoChunk **chunk);
+STATIC bool extend_record(Undo *u, Record *r, size_t len);
+STATIC Record *merge_candidate(Undo *u, bool insert, size_t len);
+STATIC Record *add_record(Undo *u, bool insert, size_t offset, size_t len);
+STATIC void drop_redo(Undo *u);
+STATIC void drop_oldest(Undo *u);
+STATIC size_t memory_used(Undo *u);
+STATIC size_t position(Undo *u);
+STATIC void forget(size_t *pos, size_t end);
+STATIC bool apply(Record *r, bool undo, GapBuffer *gbuf, size_t *offset);
+STATIC uint64_t get_u64(char *p);
+STATIC void put_u64(char *p, uint64_t n);
+STATIC bool map_record(Undo *u, size_t i, Record *r);
+STATIC void unmap_history(Undo *u);
+STATIC bool write_bytes(int fd, char *s, size_t len);
+
+
+// Returns room for len bytes at the end of the chunks.
+STATIC char *
+alloc_text(Undo *u, size_t len, UndoChunk **chunk) {
+	UndoChunk *c = u->last;
+
+	if (c == NULL || c->size - c->used < len) {
+		size_t size = len > UNDO_CHUNK_SIZE ? len : UNDO_CHUNK_SIZE;
+
+		c = malloc(sizeof(*c) + size);
+		if (c == NULL) {
+			return NULL;
+		}
+		c->next = NULL;
+		c->size = size;
+		c->used = 0;
+		if (u->last == NULL) {
+			u->chunks = c;
+		} else {
+			u->last->next = c;
+		}
+		u->last = c;
+		u->bytes += size;
+	}
+	*chunk = c;
+	c->used += len;
+	return c->text + c->used - len;
+}
+
+// Grows the bytes of r by len, if they end the chunks and the chunk has room.
+STATIC bool
+extend_record(Undo *u, Record *r, size_t len) {
+	UndoChunk *c = r->chunk;
+
+	if (c != u->last || r->text + r->len != c->text + c->used || c->size - c->used < len) {
+		return false;
+	}
+	c->used += len;
+	return true;
+}
+
+// Returns the last record, if an edit of len bytes may be merged into it.
+STATIC Record *
+merge_candidate(Undo *u, bool insert, size_t len) {
+	Record *r;
+
+	if (u->sealed || u->current == u->first || len > MERGE_CHAR_SIZE) {
+		return NULL;
+	}
+	r = &u->records[u->current - 1];
+	if (r->insert != insert || !r->merging || r->len + len > MERGE_MAX_SIZE) {
+		return NULL;
+	}
+	return r;
+}
+
+// Appends a record with room for len bytes. If out of memory, all records are
+// dropped, since the older ones do not fit the text without this one.
+STATIC Record *
+add_record(Undo *u, bool insert, size_t offset, size_t len) {
+	Record *r;
+
+	if (u->n == u->size) {
+		if (u->first > 0) {
+			memmove(u->records, u->records + u->first, (u->n - u->first) * sizeof(*r));
+			u->n -= u->first;
+			u->current -= u->first;
+			u->first = 0;
+		} else {
+			size_t size = u->size == 0 ? INITIAL_RECORDS : u->size * 2;
+			Record *records = realloc(u->records, size * sizeof(*r));
+
+			if (records == NULL) {
+				undo_clear(u);
+				return NULL;
+			}
+			u->records = records;
+			u->size = size;
+		}
+	}
+	r = &u->records[u->n];
+	r->insert = insert;
+	r->merging = len <= MERGE_CHAR_SIZE;
+	r->offset = offset;
+	r->len = len;
+	r->text = alloc_text(u, len, &r->chunk);
+	if (r->text == NULL) {
+		undo_clear(u);
+		return NULL;
+	}
+	u->n++;
+	u->current = u->n;
+	u->sealed = false;
+	return r;
+}
+
+// Drops the records, that were undone, and their bytes.
+STATIC void
+drop_redo(Undo *u) {
+	Record *r;
+	UndoChunk *c;
+
+	forget(&u->saved, position(u));
+	forget(&u->marked, position(u));
+	if (u->map_current < u->map_end) {
+		u->map_end = u->map_current;
+		u->sealed = true;
+	}
+	if (u->current == u->n) {
+		return;
+	}
+	r = &u->records[u->current];
+	c = r->chunk->next;
+	r->chunk->used = r->text - r->chunk->text;
+	r->chunk->next = NULL;
+	u->last = r->chunk;
+	while (c != NULL) {
+		UndoChunk *next = c->next;
+
+		u->bytes -= c->size;
+		free(c);
+		c = next;
+	}
+	u->n = u->current;
+	u->sealed = true;
+}
+
+// Drops the oldest record and the chunks, that only it used. The records in the
+// history file are older than the others.
+STATIC void
+drop_oldest(Undo *u) {
+	forget(&u->saved, 0);
+	forget(&u->marked, 0);
+	if (u->map_first < u->map_end) {
+		u->map_first++;
+		if (u->map_current < u->map_first) {
+			u->map_current = u->map_first;
+		}
+		return;
+	}
+	u->first++;
+	if (u->current < u->first) {
+		u->current = u->first;
+	}
+	while (u->chunks != NULL && (u->first == u->n || u->chunks != u->records[u->first].chunk)) {
+		UndoChunk *next = u->chunks->next;
+
+		u->bytes -= u->chunks->size;
+		free(u->chunks);
+		u->chunks = next;
+	}
+	if (u->chunks == NULL) {
+		u->last = NULL;
+	}
+}
+
+STATIC size_t
+memory_used(Undo *u) {
+	return u->bytes + (u->n - u->first) * sizeof(Record);
+}
+
+// Returns the number of records, that can be undone.
+STATIC size_t
+position(Undo *u) {
+	return u->map_current - u->map_first + u->current - u->first;
+}
+
+// Adjusts a saved position for dropping the records after end, or the oldest
+// one, if end is 0.
+STATIC void
+forget(size_t *pos, size_t end) {
+	if (*pos == SIZE_MAX) {
+		return;
+	} else if (end == 0) {
+		*pos = *pos == 0 ? SIZE_MAX : *pos - 1;
+	} else if (*pos > end) {
+		*pos = SIZE_MAX;
+	}
+}
+
+// Undoes or redoes r.
+STATIC bool
+apply(Record *r, bool undo, GapBuffer *gbuf, size_t *offset) {
+	if (r->insert != undo) {
+		if (!gbf_reserve(gbuf, r->len) || !gbf_insert_n(gbuf, r->text, r->len, r->offset)) {
+			return false;
+		}
+		*offset = r->offset + r->len;
+	} else {
+		if (!gbf_delete(gbuf, r->offset, r->len)) {
+			return false;
+		}
+		*offset = r->offset;
+	}
+	return true;
+}
+
+STATIC uint64_t
+get_u64(char *p) {
+	uint64_t n;
+
+	memcpy(&n, p, sizeof(n));
+	return n;
+}
+
+STATIC void
+put_u64(char *p, uint64_t n) {
+	memcpy(p, &n, sizeof(n));
+}
+
+// Reads record i of the history file. Only its index entry is read, its bytes
+// are paged in, when it is applied. Returns false, if it is damaged.
+STATIC bool
+map_record(Undo *u, size_t i, Record *r) {
+	char *entry = u->map + u->index + i * HISTORY_ENTRY_LENGTH;
+	uint64_t pos = get_u64(entry + 16);
+
+	r->offset = get_u64(entry);
+	r->len = get_u64(entry + 8);
+	r->insert = get_u64(entry + 24) != 0;
+	r->merging = false;
+	r->chunk = NULL;
+	r->text = u->map + pos;
+	return pos >= HISTORY_HEADER_LENGTH && pos <= u->index && r->len <= u->index - pos;
+}
+
+STATIC void
+unmap_history(Undo *u) {
+	if (u->map != NULL) {
+		munmap(u->map, u->map_size);
+	}
+	u->map = NULL;
+	u->map_size = 0;
+	u->map_first = 0;
+	u->map_current = 0;
+	u->map_end = 0;
+	u->map_records = 0;
+}
+
+STATIC bool
+write_bytes(int fd, char *s, size_t len) {
+	while (len > 0) {
+		ssize_t n = write(fd, s, len);
+
+		if (n == -1 && errno == EINTR) {
+			continue;
+		} else if (n <= 0) {
+			return false;
+		}
+		s += n;
+		len -= n;
+	}
+	return true;
+}
+
+Undo *
+undo_new(size_t limit) {
+	Undo *u = malloc(sizeof(*u));
+
+	if (u == NULL) {
+		return NULL;
+	}
+	memset(u, 0, sizeof(*u));
+	u->limit = limit;
+	u->sealed = true;
+	u->saved = 0;
+	u->marked = SIZE_MAX;
+	return u;
+}
+
+void
+undo_insert(Undo *u, size_t offset, char *s, size_t len) {
+	Record *r;
+
+	if (len == 0) {
+		return;
+	}
+	drop_redo(u);
+	r = merge_candidate(u, true, len);
+	if (r != NULL && offset == r->offset + r->len && extend_record(u, r, len)) {
+		memcpy(r->text + r->len, s, len);
+		r->len += len;
+	} else if ((r = add_record(u, true, offset, len)) != NULL) {
+		memcpy(r->text, s, len);
+	}
+	while (memory_used(u) > u->limit && u->first < u->n) {
+		drop_oldest(u);
+	}
+}
+
+void
+undo_delete(Undo *u, GapBuffer *gbuf, size_t offset, size_t len) {
+	Record *r;
+
+	if (len == 0) {
+		return;
+	}
+	drop_redo(u);
+	r = merge_candidate(u, false, len);
+	if (r != NULL && offset == r->offset && extend_record(u, r, len)) {
+		// Delete: The bytes follow the deleted ones.
+		gbf_text_n(gbuf, offset, len, r->text + r->len);
+		r->len += len;
+	} else if (r != NULL && offset + len == r->offset && extend_record(u, r, len)) {
+		// Backspace: The bytes precede the deleted ones.
+		memmove(r->text + len, r->text, r->len);
+		gbf_text_n(gbuf, offset, len, r->text);
+		r->offset = offset;
+		r->len += len;
+	} else if ((r = add_record(u, false, offset, len)) != NULL) {
+		gbf_text_n(gbuf, offset, len, r->text);
+	}
+	while (memory_used(u) > u->limit && u->first < u->n) {
+		drop_oldest(u);
+	}
+}
+
+void
+undo_seal(Undo *u) {
+	u->sealed = true;
+}
+
+bool
+undo_undo(Undo *u, GapBuffer *gbuf, size_t *offset) {
+	Record r;
+
+	if (u->current > u->first) {
+		if (!apply(&u->records[u->current - 1], true, gbuf, offset)) {
+			return false;
+		}
+		u->current--;
+	} else if (u->map_current > u->map_first) {
+		if (!map_record(u, u->map_current - 1, &r)) {
+			// The older records cannot be undone.
+			u->map_first = u->map_current;
+			return false;
+		}
+		if (!apply(&r, true, gbuf, offset)) {
+			return false;
+		}
+		u->map_current--;
+	} else {
+		return false;
+	}
+	u->sealed = true;
+	return true;
+}
+
+bool
+undo_redo(Undo *u, GapBuffer *gbuf, size_t *offset) {
+	Record r;
+
+	if (u->map_current < u->map_end) {
+		if (!map_record(u, u->map_current, &r)) {
+			return false;
+		}
+		if (!apply(&r, false, gbuf, offset)) {
+			return false;
+		}
+		u->map_current++;
+	} else if (u->current < u->n) {
+		if (!apply(&u->records[u->current], false, gbuf, offset)) {
+			return false;
+		}
+		u->current++;
+	} else {
+		return false;
+	}
+	u->sealed = true;
+	return true;
+}
+
+void
+undo_mark(Undo *u) {
+	u->marked = position(u);
+}
+
+void
+undo_saved(Undo *u) {
+	u->saved = u->marked;
+}
+
+bool
+undo_open_history(Undo *u, char *filename, size_t size, long long mtime) {
+	char *name = malloc(strlen(filename) + sizeof(UNDO_SUFFIX));
+	struct stat st;
+	uint64_t count;
+	int fd;
+
+	if (name == NULL) {
+		return false;
+	}
+	sprintf(name, "%s%s", filename, UNDO_SUFFIX);
+	fd = open(name, O_RDONLY);
+	free(name);
+	if (fd == -1) {
+		return false;
+	}
+	if (fstat(fd, &st) != 0 || st.st_size < HISTORY_HEADER_LENGTH) {
+		close(fd);
+		return false;
+	}
+	u->map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (u->map == MAP_FAILED) {
+		u->map = NULL;
+		return false;
+	}
+	u->map_size = st.st_size;
+
+	// Only the header is checked, the records are checked, when they are used.
+	count = get_u64(u->map + HISTORY_MAGIC_LENGTH + 16);
+	u->index = get_u64(u->map + HISTORY_MAGIC_LENGTH + 24);
+	if (memcmp(u->map, HISTORY_MAGIC, HISTORY_MAGIC_LENGTH) != 0 ||
+		get_u64(u->map + HISTORY_MAGIC_LENGTH) != size ||
+		get_u64(u->map + HISTORY_MAGIC_LENGTH + 8) != (uint64_t)(mtime + 1) ||
+		u->index < HISTORY_HEADER_LENGTH || u->index > u->map_size ||
+		count > (u->map_size - u->index) / HISTORY_ENTRY_LENGTH) {
+		unmap_history(u);
+		return false;
+	}
+	u->map_records = count;
+	u->map_end = count;
+	u->map_current = count;
+	u->saved = count;
+	return true;
+}
+
+bool
+undo_write_history(Undo *u, char *filename, size_t size, long long mtime) {
+	char *name = malloc(strlen(filename) + sizeof(UNDO_SUFFIX) + 4);
+	char header[HISTORY_HEADER_LENGTH];
+	char *index = NULL;
+	size_t mapped;
+	size_t count;
+	size_t kept = 0;
+	size_t skip;
+	size_t bytes = 0;
+	size_t pos = HISTORY_HEADER_LENGTH;
+	bool ok = false;
+	int fd;
+
+	if (u->saved == SIZE_MAX || mtime == -1 || name == NULL) {
+		free(name);
+		return false;
+	}
+	if (u->map_first == 0 && u->saved == u->map_records && u->map_end == u->map_records) {
+		// The history file holds these records already.
+		free(name);
+		return true;
+	}
+	count = u->saved;
+	mapped = u->map_end - u->map_first < count ? u->map_end - u->map_first : count;
+	// Like the log, the file holds at most limit bytes: the newest records.
+	while (kept < count) {
+		size_t i = count - kept - 1;
+		Record r;
+
+		if (i < mapped) {
+			if (!map_record(u, u->map_first + i, &r)) {
+				break;
+			}
+		} else {
+			r = u->records[u->first + i - mapped];
+		}
+		bytes += r.len;
+		if (bytes > u->limit) {
+			break;
+		}
+		kept++;
+	}
+	skip = count - kept;
+	index = malloc((count - skip) * HISTORY_ENTRY_LENGTH + 1);
+	if (index == NULL) {
+		free(name);
+		return false;
+	}
+
+	// The file is replaced at once, the old one may still be mapped.
+	sprintf(name, "%s%s.tmp", filename, UNDO_SUFFIX);
+	fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd != -1 && lseek(fd, HISTORY_HEADER_LENGTH, SEEK_SET) == HISTORY_HEADER_LENGTH) {
+		ok = true;
+		for (size_t i = skip; ok && i < count; i++) {
+			char *entry = index + (i - skip) * HISTORY_ENTRY_LENGTH;
+			Record r;
+
+			if (i < mapped) {
+				map_record(u, u->map_first + i, &r);
+			} else {
+				r = u->records[u->first + i - mapped];
+			}
+			put_u64(entry, r.offset);
+			put_u64(entry + 8, r.len);
+			put_u64(entry + 16, pos);
+			put_u64(entry + 24, r.insert);
+			ok = write_bytes(fd, r.text, r.len);
+			pos += r.len;
+		}
+		memcpy(header, HISTORY_MAGIC, HISTORY_MAGIC_LENGTH);
+		put_u64(header + HISTORY_MAGIC_LENGTH, size);
+		put_u64(header + HISTORY_MAGIC_LENGTH + 8, (uint64_t)(mtime + 1));
+		put_u64(header + HISTORY_MAGIC_LENGTH + 16, count - skip);
+		put_u64(header + HISTORY_MAGIC_LENGTH + 24, pos);
+		ok = ok && write_bytes(fd, index, (count - skip) * HISTORY_ENTRY_LENGTH) &&
+			pwrite(fd, header, HISTORY_HEADER_LENGTH, 0) == HISTORY_HEADER_LENGTH;
+	}
+	if (fd != -1 && close(fd) != 0) {
+		ok = false;
+	}
+	if (ok) {
+		char *tmp = strdup(name);
+
+		name[strlen(name) - 4] = '\0';
+		ok = tmp != NULL && rename(tmp, name) == 0;
+		free(tmp);
+	} else if (fd != -1) {
+		unlink(name);
+	}
+	free(index);
+	free(name);
+	return ok;
+}
+
+void
+undo_clear(Undo *u) {
+	while (u->chunks != NULL) {
+		UndoChunk *next = u->chunks->next;
+
+		free(u->chunks);
+		u->chunks = next;
+	}
+	u->last = NULL;
+	u->bytes = 0;
+	u->first = 0;
+	u->current = 0;
+	u->n = 0;
+	u->sealed = true;
+	u->saved = SIZE_MAX;
+	u->marked = SIZE_MAX;
+	unmap_history(u);
+}
+
+void
+undo_free(Undo **u) {
+	undo_clear(*u);
+	free((*u)->records);
+	free(*u);
+	*u = NULL;
+}
@@ -0,0 +1,126 @@
+#ifndef DRTE_UNDO_H
+#define DRTE_UNDO_H
+
+/// \file
+/// undo.h implements undo and redo with a log of the inserts and deletes of a
+/// text.
+///
+/// Usage:
+/// \code
+/// #include <stdbool.h>
+/// #include <stdlib.h>
+///
+/// #include "gapbuffer.h"
+/// #include "undo.h"
+/// \endcode
+///
+/// Every edit is a record: The type, the offset and the inserted or deleted
+/// bytes. The bytes are appended to large chunks, so recording an edit does
+/// not allocate memory most of the time. The bytes of a record are never split
+/// between chunks, so a record is undone with a single insert or delete, no
+/// matter how large it is.
+///
+/// Edits of single characters, that follow each other, like typing a word or
+/// deleting it with backspace, are merged into one record, until undo_seal is
+/// called.
+///
+/// When the log exceeds its limit, the oldest records are dropped.
+///
+/// The records up to the last save can be kept in a history file next to the
+/// file, its name is the filename with UNDO_SUFFIX appended. It is checked
+/// against the size and the modification time of the file and mapped, when the
+/// file is opened again. Only the index entry of a record is read, when it is
+/// undone, so opening a file with a long history costs no more than opening it
+/// without one.
+
+/// The suffix of history files.
+#define UNDO_SUFFIX ".drte-undo"
+
+/// An undo log.
+typedef struct Undo Undo;
+
+/// undo_new creates a new, empty undo log.
+/// \param limit The most bytes of memory, that the log uses. A single edit,
+///        that is larger, cannot be undone.
+/// \return A new Undo or NULL, if out of memory. The Undo needs to be freed
+///         with undo_free.
+Undo *undo_new(size_t limit);
+
+/// undo_insert records an insert. The edits, that were undone, cannot be
+/// redone anymore.
+/// \param u An Undo.
+/// \param offset The position of the inserted bytes.
+/// \param s The inserted bytes.
+/// \param len The number of bytes.
+void undo_insert(Undo *u, size_t offset, char *s, size_t len);
+
+/// undo_delete records a delete. This has to be called before the bytes are
+/// deleted, since they are copied from the text. The edits, that were undone,
+/// cannot be redone anymore.
+/// \param u An Undo.
+/// \param gbuf The text.
+/// \param offset The position of the deleted bytes.
+/// \param len The number of bytes.
+void undo_delete(Undo *u, GapBuffer *gbuf, size_t offset, size_t len);
+
+/// undo_seal ends merging: The next edit starts a new record.
+/// \param u An Undo.
+void undo_seal(Undo *u);
+
+/// undo_undo reverts the last edit, that was not undone.
+/// \param u An Undo.
+/// \param gbuf The text.
+/// \param offset This will be set to the position of the cursor after the edit.
+/// \return true on success, false if there is nothing to undo or if out of
+///         memory.
+bool undo_undo(Undo *u, GapBuffer *gbuf, size_t *offset);
+
+/// undo_redo applies the last edit, that was undone, again.
+/// \param u An Undo.
+/// \param gbuf The text.
+/// \param offset This will be set to the position of the cursor after the edit.
+/// \return true on success, false if there is nothing to redo or if out of
+///         memory.
+bool undo_redo(Undo *u, GapBuffer *gbuf, size_t *offset);
+
+/// undo_mark remembers the position in the log, when a snapshot of the text
+/// is saved.
+/// \param u An Undo.
+void undo_mark(Undo *u);
+
+/// undo_saved records, that the snapshot taken at undo_mark was written. The
+/// records up to it are written by undo_write_history.
+/// \param u An Undo.
+void undo_saved(Undo *u);
+
+/// undo_open_history maps the history file of a file into an empty log, if it
+/// was written for the same size and modification time.
+/// \param u An empty Undo.
+/// \param filename The name of the file.
+/// \param size The size of the file.
+/// \param mtime The modification time of the file.
+/// \return true if the history was opened, false otherwise.
+bool undo_open_history(Undo *u, char *filename, size_t size, long long mtime);
+
+/// undo_write_history replaces the history file of a file with the records up
+/// to the last save, or up to the opening of the file, if it was not saved.
+/// At most limit bytes of the newest records are written.
+/// \param u An Undo.
+/// \param filename The name of the file.
+/// \param size The size of the file, when it was last saved.
+/// \param mtime The modification time of the file then.
+/// \return true on success, false if the records do not reach back to the
+///         last save, or if the history file cannot be written.
+bool undo_write_history(Undo *u, char *filename, size_t size, long long mtime);
+
+/// undo_clear drops all records. This is used, when the offsets of the records
+/// do not fit the text anymore.
+/// \param u An Undo.
+void undo_clear(Undo *u);
+
+/// undo_free frees an Undo and sets u to NULL.
+/// \param u An Undo.
+void undo_free(Undo **u);
+
+
+#endif
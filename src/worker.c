@@ -0,0 +1,82 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "worker.h"
+#include "static.h"
+
+
+struct Worker {
+	pthread_t thread;
+	pthread_mutex_t mutex; // Protects done.
+	bool done; // True, when func has returned.
+	WorkerFunc func;
+	void *arg;
+};
+
+STATIC void *run(void *arg);
+
+
+STATIC void *
+run(void *arg) {
+	Worker *w = arg;
+
+	w->func(w->arg);
+
+	pthread_mutex_lock(&w->mutex);
+	w->done = true;
+	pthread_mutex_unlock(&w->mutex);
+	return NULL;
+}
+
+Worker *
+worker_new(WorkerFunc func, void *arg) {
+	Worker *w = malloc(sizeof(*w));
+	sigset_t all;
+	sigset_t old;
+	int err;
+
+	if (w == NULL) {
+		return NULL;
+	}
+	w->done = false;
+	w->func = func;
+	w->arg = arg;
+	if (pthread_mutex_init(&w->mutex, NULL) != 0) {
+		free(w);
+		return NULL;
+	}
+
+	// The thread inherits the signal mask.
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	err = pthread_create(&w->thread, NULL, run, w);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	if (err != 0) {
+		pthread_mutex_destroy(&w->mutex);
+		free(w);
+		return NULL;
+	}
+	return w;
+}
+
+bool
+worker_is_done(Worker *w) {
+	bool done;
+
+	pthread_mutex_lock(&w->mutex);
+	done = w->done;
+	pthread_mutex_unlock(&w->mutex);
+	return done;
+}
+
+void
+worker_free(Worker **w) {
+	pthread_join((*w)->thread, NULL);
+	pthread_mutex_destroy(&(*w)->mutex);
+	free(*w);
+	*w = NULL;
+}
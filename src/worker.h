@@ -0,0 +1,43 @@
+#ifndef DRTE_WORKER_H
+#define DRTE_WORKER_H
+
+/// \file
+/// worker.h implements running a function on a separate thread.
+///
+/// Usage:
+/// \code
+/// #include <stdbool.h>
+/// #include <stdlib.h>
+///
+/// #include "worker.h"
+/// \endcode
+///
+/// All signals are blocked in the thread, so signals like SIGWINCH are still
+/// delivered to the main thread and interrupt its reads. The function and the
+/// main thread have to protect the data, that they share.
+
+/// A worker thread.
+typedef struct Worker Worker;
+
+/// WorkerFunc is the type of the functions, that a Worker runs.
+typedef void (*WorkerFunc)(void *arg);
+
+/// worker_new starts a thread, that calls func(arg).
+/// \param func The function.
+/// \param arg The argument of func.
+/// \return A new Worker or NULL, if out of memory or the thread could not be
+///         started. The Worker needs to be freed with worker_free.
+Worker *worker_new(WorkerFunc func, void *arg);
+
+/// worker_is_done checks, if the function has returned.
+/// \param w A Worker.
+/// \return true if the function has returned, false otherwise.
+bool worker_is_done(Worker *w);
+
+/// worker_free waits, until the function has returned, and frees a Worker.
+/// Sets w to NULL.
+/// \param w A Worker.
+void worker_free(Worker **w);
+
+
+#endif
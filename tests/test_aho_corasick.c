@@ -0,0 +1,261 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+#include "../src/gapbuffer.h"
+#include "../src/aho_corasick.h"
+
+// Builds an AhoCorasick from patterns separated by '|'.
+static AhoCorasick *
+make_ac(char *patterns) {
+	char *copy = strdup(patterns);
+	char *list[16];
+	size_t lengths[16];
+	size_t n = 0;
+	AhoCorasick *ac;
+
+	for (char *p = strtok(copy, "|"); p != NULL; p = strtok(NULL, "|")) {
+		list[n] = p;
+		lengths[n] = strlen(p);
+		n++;
+	}
+	ac = aho_corasick_new(list, lengths, n);
+	free(copy);
+	return ac;
+}
+
+// Counts all matches of all patterns by comparing at every position.
+static size_t
+naive_count(char **patterns, size_t n, char *text, size_t len) {
+	size_t count = 0;
+
+	for (size_t i = 0; i < len; i++) {
+		for (size_t k = 0; k < n; k++) {
+			size_t plen = strlen(patterns[k]);
+			if (i + plen <= len && memcmp(text + i, patterns[k], plen) == 0) {
+				count++;
+			}
+		}
+	}
+	return count;
+}
+
+static void
+test_aho_corasick_scan(void) {
+	AhoCorasick *ac = make_ac("ERROR|WARN|FATAL");
+	char *text = "INFO ok\nWARN disk\nERROR io\n";
+	size_t state = 0;
+	size_t length = 0;
+	char *found;
+
+	test_assert_not_null(ac);
+	test_assert_size_t_eql(aho_corasick_longest(ac), (size_t)5);
+
+	found = aho_corasick_scan(ac, &state, text, strlen(text), &length);
+	test_assert_ptr_eql(found, text + 11);
+	test_assert_size_t_eql(length, (size_t)4);
+	found++;
+	found = aho_corasick_scan(ac, &state, found, strlen(found), &length);
+	test_assert_ptr_eql(found, text + 22);
+	test_assert_size_t_eql(length, (size_t)5);
+	found++;
+	test_assert_null(aho_corasick_scan(ac, &state, found, strlen(found), &length));
+
+	// The state carries partial matches from one part to the next.
+	state = 0;
+	test_assert_null(aho_corasick_scan(ac, &state, "xxFA", 4, &length));
+	found = "TAL";
+	test_assert_ptr_eql(aho_corasick_scan(ac, &state, found, 3, &length), found + 2);
+	test_assert_size_t_eql(length, (size_t)5);
+
+	aho_corasick_free(&ac);
+	test_assert_null(ac);
+}
+
+static void
+test_aho_corasick_overlap(void) {
+	AhoCorasick *ac = make_ac("he|she|his|hers");
+	char *text = "ushers";
+	size_t state = 0;
+	size_t length = 0;
+
+	// "she" and "he" end at the same byte, the longer one is reported.
+	test_assert_ptr_eql(aho_corasick_scan(ac, &state, text, 6, &length), text + 3);
+	test_assert_size_t_eql(length, (size_t)3);
+
+	state = 0;
+	test_assert_size_t_eql(aho_corasick_count(ac, &state, text, 6), (size_t)3);
+
+	aho_corasick_free(&ac);
+}
+
+static void
+test_aho_corasick_count_random(void) {
+	char *patterns[] = {"ab", "ba", "aab", "b", "abba"};
+	size_t lengths[] = {2, 2, 3, 1, 4};
+	AhoCorasick *ac = aho_corasick_new(patterns, lengths, 5);
+	size_t size = 3000;
+	char *text = malloc(size);
+	bool ok = true;
+
+	srand(11);
+	for (int round = 0; round < 200 && ok; round++) {
+		size_t len = rand() % size;
+		size_t state = 0;
+		size_t count = 0;
+		size_t split = len == 0 ? 0 : rand() % len;
+
+		for (size_t i = 0; i < len; i++) {
+			text[i] = rand() % 3 == 0 ? 'b' : 'a';
+		}
+		count += aho_corasick_count(ac, &state, text, split);
+		count += aho_corasick_count(ac, &state, text + split, len - split);
+		ok = count == naive_count(patterns, 5, text, len);
+	}
+	test_assert_int_eql(ok, true);
+
+	free(text);
+	aho_corasick_free(&ac);
+}
+
+static void
+test_aho_corasick_search(void) {
+	AhoCorasick *ac = make_ac("bcd|abcdef|x");
+	GapBuffer *gbuf = gbf_new();
+	size_t offset = 0;
+	size_t length = 0;
+
+	gbf_insert(gbuf, "abcdef bcd x", 0);
+
+	// "bcd" ends first, but "abcdef" starts earlier.
+	test_assert_int_eql(aho_corasick_search(ac, gbuf, 0, &offset, &length), true);
+	test_assert_size_t_eql(offset, (size_t)0);
+	test_assert_size_t_eql(length, (size_t)6);
+	test_assert_int_eql(aho_corasick_search(ac, gbuf, 1, &offset, &length), true);
+	test_assert_size_t_eql(offset, (size_t)1);
+	test_assert_size_t_eql(length, (size_t)3);
+	test_assert_int_eql(aho_corasick_search(ac, gbuf, 2, &offset, &length), true);
+	test_assert_size_t_eql(offset, (size_t)7);
+	test_assert_int_eql(aho_corasick_search(ac, gbuf, 12, &offset, &length), false);
+
+	test_assert_int_eql(aho_corasick_search_reverse(ac, gbuf, 100, &offset, &length), true);
+	test_assert_size_t_eql(offset, (size_t)11);
+	test_assert_size_t_eql(length, (size_t)1);
+	test_assert_int_eql(aho_corasick_search_reverse(ac, gbuf, 10, &offset, &length), true);
+	test_assert_size_t_eql(offset, (size_t)7);
+	test_assert_size_t_eql(length, (size_t)3);
+	// The match must end at or before start.
+	test_assert_int_eql(aho_corasick_search_reverse(ac, gbuf, 8, &offset, &length), true);
+	test_assert_size_t_eql(offset, (size_t)1);
+	test_assert_size_t_eql(length, (size_t)3);
+	test_assert_int_eql(aho_corasick_search_reverse(ac, gbuf, 2, &offset, &length), false);
+
+	gbf_free(&gbuf);
+	aho_corasick_free(&ac);
+}
+
+static void
+test_aho_corasick_search_gap(void) {
+	AhoCorasick *ac = make_ac("WARN|ERROR");
+	AhoCorasick *single = make_ac("ERROR");
+	GapBuffer *gbuf = gbf_new();
+	size_t offset = 0;
+	size_t length = 0;
+
+	gbf_insert(gbuf, "xx ERR", 0);
+	gbf_insert(gbuf, "OR WARN", 6);
+	gbf_insert(gbuf, "x", 5);
+	gbf_delete(gbuf, 5, 1);
+
+	// Matches across the gap.
+	test_assert_int_eql(aho_corasick_search(ac, gbuf, 0, &offset, &length), true);
+	test_assert_size_t_eql(offset, (size_t)3);
+	test_assert_size_t_eql(length, (size_t)5);
+	test_assert_int_eql(aho_corasick_search_reverse(ac, gbuf, 8, &offset, &length), true);
+	test_assert_size_t_eql(offset, (size_t)3);
+	test_assert_int_eql(aho_corasick_search(single, gbuf, 0, &offset, &length), true);
+	test_assert_size_t_eql(offset, (size_t)3);
+	test_assert_size_t_eql(length, (size_t)5);
+	test_assert_int_eql(aho_corasick_search_reverse(single, gbuf, 13, &offset, &length), true);
+	test_assert_size_t_eql(offset, (size_t)3);
+
+	gbf_free(&gbuf);
+	aho_corasick_free(&ac);
+	aho_corasick_free(&single);
+}
+
+static void
+test_aho_corasick_ranges(void) {
+	AhoCorasick *ac = make_ac("ab|b|bcdefg|z");
+	GapBuffer *gbuf = gbf_new();
+	size_t *ranges = NULL;
+	size_t size = 0;
+	size_t n;
+
+	gbf_insert(gbuf, "abcdefg zz ab b", 0);
+
+	n = aho_corasick_ranges(ac, gbuf, 0, 15, &ranges, &size);
+	test_assert_size_t_eql(n, (size_t)4);
+	test_assert_size_t_eql(ranges[0], (size_t)0);
+	test_assert_size_t_eql(ranges[1], (size_t)7);
+	test_assert_size_t_eql(ranges[2], (size_t)8);
+	test_assert_size_t_eql(ranges[3], (size_t)10);
+	test_assert_size_t_eql(ranges[4], (size_t)11);
+	test_assert_size_t_eql(ranges[5], (size_t)13);
+	test_assert_size_t_eql(ranges[6], (size_t)14);
+	test_assert_size_t_eql(ranges[7], (size_t)15);
+
+	// Matches are cut off at the borders.
+	n = aho_corasick_ranges(ac, gbuf, 3, 12, &ranges, &size);
+	test_assert_size_t_eql(n, (size_t)3);
+	test_assert_size_t_eql(ranges[0], (size_t)3);
+	test_assert_size_t_eql(ranges[1], (size_t)7);
+	test_assert_size_t_eql(ranges[4], (size_t)11);
+	test_assert_size_t_eql(ranges[5], (size_t)12);
+
+	free(ranges);
+	gbf_free(&gbuf);
+	aho_corasick_free(&ac);
+}
+
+static void
+test_aho_corasick_ranges_many(void) {
+	AhoCorasick *ac = make_ac("a|b");
+	GapBuffer *gbuf = gbf_new();
+	size_t *ranges = NULL;
+	size_t size = 0;
+	size_t n;
+	bool ok = true;
+
+	for (size_t i = 0; i < 1000; i++) {
+		gbf_insert(gbuf, "a ", 0);
+	}
+	n = aho_corasick_ranges(ac, gbuf, 0, 2000, &ranges, &size);
+	test_assert_size_t_eql(n, (size_t)1000);
+	for (size_t i = 0; i < n; i++) {
+		ok = ok && ranges[2 * i] == 2 * i && ranges[2 * i + 1] == 2 * i + 1;
+	}
+	test_assert_int_eql(ok, true);
+
+	free(ranges);
+	gbf_free(&gbuf);
+	aho_corasick_free(&ac);
+}
+
+int
+main(void) {
+	test_aho_corasick_scan();
+	test_aho_corasick_overlap();
+	test_aho_corasick_count_random();
+	test_aho_corasick_search();
+	test_aho_corasick_search_gap();
+	test_aho_corasick_ranges();
+	test_aho_corasick_ranges_many();
+
+	test_print_message();
+	return 0;
+}
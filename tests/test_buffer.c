@@ -4,6 +4,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 
 #include "test.h"
 #include "../src/input.h"
@@ -13,7 +17,12 @@
 #include "../src/chunk_list.h"
 #include "../src/menus.h"
 #include "../src/buffer.h"
+#include "../src/editor.h"
+#include "../src/pool.h"
+#include "../src/journal.h"
 
+bool start_load(Buffer *buf, int fd, size_t size, bool reserve);
+size_t gap_length(GapBuffer *gbuf);
 
 void
 test_buffer_new(void) {
@@ -135,9 +144,387 @@ test_buffer_free_2(void) {
 	test_assert_null(first);
 }
 
+void
+test_buffer_new_file(void) {
+	char filename[] = "/tmp/drte-test-XXXXXX";
+	int fd = mkstemp(filename);
+	Buffer *buf;
+	char *text;
+
+	test_assert_int_eql(write(fd, "lorem\nipsum\n", 12) == 12, true);
+	close(fd);
+
+	buf = buffer_new(NULL, strdup(filename));
+	test_assert_not_null(buf);
+	text = gbf_text(buf->gbuf);
+	test_assert_str_eql(text, "lorem\nipsum\n");
+	free(text);
+
+	buffer_free(&buf);
+	unlink(filename);
+}
+
+void
+test_buffer_new_file_async(void) {
+	char filename[] = "/tmp/drte-test-XXXXXX";
+	int fd = mkstemp(filename);
+	size_t size = 9 * 1024 * 1024;
+	char *data = malloc(size);
+	Buffer *buf;
+	char *text;
+
+	for (size_t i = 0; i < size; i++) {
+		data[i] = i % 80 == 79 ? '\n' : 'a' + i % 26;
+	}
+	test_assert_int_eql(write(fd, data, size) == (ssize_t)size, true);
+	close(fd);
+
+	buf = buffer_new(NULL, strdup(filename));
+	test_assert_not_null(buf);
+	test_assert_not_null(buf->loader);
+	while (buf->loader != NULL) {
+		buffer_update_load(NULL, buf);
+	}
+	test_assert_size_t_eql(gbf_text_length(buf->gbuf), size);
+	text = gbf_text(buf->gbuf);
+	test_assert_int_eql(memcmp(text, data, size), 0);
+	free(text);
+	buffer_free(&buf);
+
+	// Freeing the buffer stops the loader.
+	buf = buffer_new(NULL, strdup(filename));
+	test_assert_not_null(buf->loader);
+	buffer_free(&buf);
+	test_assert_null(buf);
+
+	free(data);
+	unlink(filename);
+}
+
+void
+test_buffer_load_failed(void) {
+	char filename[] = "/tmp/drte-test-XXXXXX";
+	int fd = mkstemp(filename);
+	struct stat st;
+	Buffer *buf;
+	Editor e;
+
+	test_assert_int_eql(write(fd, "lorem\n", 6) == 6, true);
+	close(fd);
+	memset(&e, 0, sizeof(e));
+	buf = buffer_new(NULL, strdup(filename));
+	test_assert_not_null(buf);
+	test_assert_size_t_eql(gbf_text_length(buf->gbuf), (size_t)6);
+
+	// Reading more of the file fails after the part, that was read. The
+	// partial text is dropped, so it cannot be saved over the file.
+	fd = open("/tmp", O_RDONLY);
+	test_assert_int_eql(start_load(buf, fd, 4096, true), true);
+	while (buf->loader != NULL) {
+		buffer_update_load(&e, buf);
+	}
+	test_assert_int_eql(buf->load_failed, true);
+	test_assert_size_t_eql(gbf_text_length(buf->gbuf), (size_t)0);
+	test_assert_int_eql(buf->has_changed, false);
+	test_assert_int_eql(buf->keep_history, false);
+	buffer_free(&buf);
+	test_assert_int_eql(stat(filename, &st), 0);
+	test_assert_int_eql(st.st_size == 6, true);
+
+	unlink(filename);
+}
+
+void
+test_buffer_load_steps(void) {
+	char filename[] = "/tmp/drte-test-XXXXXX";
+	int fd = mkstemp(filename);
+	size_t step = 1024 * 1024;
+	char *data = malloc(step);
+	bool kept = false;
+	Buffer *buf;
+
+	memset(data, 'a', step);
+	test_assert_int_eql(write(fd, data, step) == (ssize_t)step, true);
+	close(fd);
+	buf = buffer_new(NULL, NULL);
+
+	// Loads in steps, like a stream, do not resize the gap each time.
+	for (size_t i = 0; i < 4; i++) {
+		size_t gap = gap_length(buf->gbuf);
+
+		fd = open(filename, O_RDONLY);
+		test_assert_int_eql(start_load(buf, fd, step, false), true);
+		kept = kept || gap_length(buf->gbuf) == gap;
+		while (buf->loader != NULL) {
+			buffer_update_load(NULL, buf);
+		}
+	}
+	test_assert_size_t_eql(gbf_text_length(buf->gbuf), 4 * step);
+	test_assert_int_eql(kept, true);
+
+	free(data);
+	buffer_free(&buf);
+	unlink(filename);
+}
+
+void
+test_buffer_follow(void) {
+	char filename[] = "/tmp/drte-test-XXXXXX";
+	int fd = mkstemp(filename);
+	size_t offset = 0;
+	Buffer *buf;
+	char *text;
+
+	test_assert_int_eql(write(fd, "lorem\n", 6) == 6, true);
+	buf = buffer_new(NULL, strdup(filename));
+	test_assert_int_eql(buffer_start_follow(buf), true);
+	test_assert_int_eql(buf->follow, true);
+
+	// Only the appended bytes are added, the text stays unchanged.
+	test_assert_int_eql(write(fd, "ipsum\n", 6) == 6, true);
+	buffer_update_follow(NULL, buf);
+	text = gbf_text(buf->gbuf);
+	test_assert_str_eql(text, "lorem\nipsum\n");
+	free(text);
+	test_assert_size_t_eql(buf->file_size, (size_t)12);
+	test_assert_int_eql(gbf_first_change(buf->gbuf, &offset), false);
+
+	// Edits are kept.
+	gbf_insert(buf->gbuf, "dolor ", 0);
+	test_assert_int_eql(write(fd, "sit\n", 4) == 4, true);
+	buffer_update_follow(NULL, buf);
+	text = gbf_text(buf->gbuf);
+	test_assert_str_eql(text, "dolor lorem\nipsum\nsit\n");
+	free(text);
+	test_assert_int_eql(gbf_first_change(buf->gbuf, &offset), true);
+	test_assert_size_t_eql(offset, (size_t)0);
+
+	buffer_stop_follow(buf);
+	test_assert_int_eql(buf->follow, false);
+	close(fd);
+	buffer_free(&buf);
+	unlink(filename);
+}
+
+void
+test_buffer_follow_journal(void) {
+	char filename[] = "/tmp/drte-test-XXXXXX";
+	int fd = mkstemp(filename);
+	GapBuffer *gbuf = gbf_new();
+	size_t replayed = 0;
+	struct stat st;
+	Journal *j;
+	Buffer *buf;
+	Editor e;
+	char *text;
+
+	test_assert_int_eql(write(fd, "lorem\n", 6) == 6, true);
+	memset(&e, 0, sizeof(e));
+	e.journal_interval = 1;
+	buf = buffer_new(&e, strdup(filename));
+	test_assert_not_null(buf->journal);
+	test_assert_int_eql(buffer_start_follow(buf), true);
+
+	// The unsaved edit is kept in the journal, when the file grows.
+	gbf_insert(buf->gbuf, "dolor ", 0);
+	test_assert_int_eql(write(fd, "ipsum\n", 6) == 6, true);
+	buffer_update_follow(&e, buf);
+	test_assert_size_t_eql(buf->file_size, (size_t)12);
+	test_assert_int_eql(journal_flush(buf->journal), true);
+
+	// After a crash, the edit is replayed on the grown file.
+	test_assert_int_eql(stat(filename, &st), 0);
+	gbf_insert(gbuf, "lorem\nipsum\n", 0);
+	j = journal_open(filename, st.st_size, st.st_mtime, gbuf, &replayed);
+	test_assert_not_null(j);
+	test_assert_size_t_eql(replayed, (size_t)1);
+	text = gbf_text(gbuf);
+	test_assert_str_eql(text, "dolor lorem\nipsum\n");
+	free(text);
+	journal_free(&j, false);
+
+	buffer_stop_follow(buf);
+	close(fd);
+	buffer_free(&buf);
+	gbf_free(&gbuf);
+	unlink(filename);
+}
+
+void
+test_buffer_new_lazy(void) {
+	char filename[] = "/tmp/drte-test-XXXXXX";
+	int fd = mkstemp(filename);
+	Buffer *buf;
+	char *text;
+
+	test_assert_int_eql(write(fd, "lorem\n", 6) == 6, true);
+	close(fd);
+
+	// The file is not read, until the buffer is loaded.
+	buf = buffer_new_lazy(NULL, strdup(filename));
+	test_assert_not_null(buf);
+	test_assert_null(buf->gbuf);
+	test_assert_null(buf->isearch_buffer);
+	test_assert_int_eql(buffer_load(NULL, buf), true);
+	text = gbf_text(buf->gbuf);
+	test_assert_str_eql(text, "lorem\n");
+	free(text);
+	test_assert_not_null(buf->isearch_buffer);
+	test_assert_int_eql(buffer_load(NULL, buf), true);
+	buffer_free(&buf);
+
+	// A buffer, that was never loaded, can be freed.
+	buf = buffer_new_lazy(NULL, strdup(filename));
+	buffer_free(&buf);
+	test_assert_null(buf);
+
+	unlink(filename);
+}
+
+void
+test_buffer_update_preload(void) {
+	char filename[] = "/tmp/drte-test-XXXXXX";
+	int fd = mkstemp(filename);
+	Buffer *bufs[4];
+	Editor e;
+	char *text;
+
+	test_assert_int_eql(write(fd, "lorem\nipsum\n", 12) == 12, true);
+	close(fd);
+	memset(&e, 0, sizeof(e));
+	e.pool = pool_new(2);
+	test_assert_not_null(e.pool);
+	bufs[0] = buffer_new_lazy(&e, strdup(filename));
+	bufs[1] = buffer_new_lazy(&e, strdup(filename));
+	bufs[2] = buffer_new_lazy(&e, strdup("/nonexistent/drte-test"));
+	bufs[3] = buffer_new_lazy(&e, strdup(filename));
+	for (size_t i = 0; i < 4; i++) {
+		buffer_append(&e.current_buffer, bufs[i]);
+	}
+
+	// All files but the current one are read on the pool.
+	buffer_update_preload(&e);
+	test_assert_null(bufs[0]->preload);
+	test_assert_not_null(bufs[1]->preload);
+	test_assert_not_null(bufs[2]->preload);
+	test_assert_not_null(bufs[3]->preload);
+	// The result for a freed buffer is discarded.
+	buffer_free(&bufs[3]);
+	while (pool_pending(e.pool) > 0) {
+		usleep(1000);
+		buffer_update_preload(&e);
+	}
+
+	test_assert_null(bufs[0]->gbuf);
+	test_assert_not_null(bufs[1]->gbuf);
+	test_assert_null(bufs[1]->preload);
+	test_assert_size_t_eql(bufs[1]->file_size, (size_t)12);
+	text = gbf_text(bufs[1]->gbuf);
+	test_assert_str_eql(text, "lorem\nipsum\n");
+	free(text);
+	test_assert_int_eql(buffer_load(&e, bufs[1]), true);
+	// A file, that cannot be read, is left to buffer_load.
+	test_assert_null(bufs[2]->gbuf);
+	test_assert_int_eql(bufs[2]->preload_failed, true);
+	test_assert_size_t_eql(e.preloaded, (size_t)12);
+
+	buffer_stop_preloads(&e);
+	test_assert_null(e.pool);
+	while (e.current_buffer != NULL) {
+		buffer_free(&e.current_buffer);
+	}
+	unlink(filename);
+}
+
+// Reads the stream of buf until it ends.
+static void
+read_stream(Buffer *buf) {
+	while (buf->stream) {
+		buffer_update_load(NULL, buf);
+		usleep(1000);
+	}
+}
+
+void
+test_buffer_new_stream(void) {
+	size_t size = 3 * 1024 * 1024;
+	size_t limit = 1024 * 1024;
+	size_t offset = 0;
+	int fds[2];
+	pid_t pid;
+	Buffer *buf;
+	char *text;
+
+	test_assert_int_eql(pipe(fds), 0);
+	buf = buffer_new_stream(NULL, fds[0], 0);
+	test_assert_not_null(buf);
+	test_assert_int_eql(write(fds[1], "lorem\nipsum\n", 12) == 12, true);
+	close(fds[1]);
+	read_stream(buf);
+	test_assert_null(buf->loader);
+	text = gbf_text(buf->gbuf);
+	test_assert_str_eql(text, "lorem\nipsum\n");
+	free(text);
+	test_assert_int_eql(gbf_first_change(buf->gbuf, &offset), false);
+	buffer_free(&buf);
+
+	// More than the limit is written, only the last lines are kept.
+	test_assert_int_eql(pipe(fds), 0);
+	pid = fork();
+	if (pid == 0) {
+		char line[32];
+
+		close(fds[0]);
+		for (size_t i = 0; i < size / 16; i++) {
+			snprintf(line, sizeof(line), "%014zu\n", i);
+			if (write(fds[1], line, 15) != 15) {
+				_exit(1);
+			}
+		}
+		_exit(0);
+	}
+	close(fds[1]);
+	buf = buffer_new_stream(NULL, fds[0], limit);
+	read_stream(buf);
+	waitpid(pid, NULL, 0);
+	test_assert_int_eql(gbf_text_length(buf->gbuf) <= limit + limit / 4, true);
+	test_assert_int_eql(gbf_text_length(buf->gbuf) >= limit - 15, true);
+	test_assert_size_t_eql(gbf_text_length(buf->gbuf) % 15, (size_t)0);
+	text = gbf_text(buf->gbuf);
+	test_assert_int_eql(memcmp(text + gbf_text_length(buf->gbuf) - 15, "00000000196607\n", 15), 0);
+	free(text);
+	buffer_free(&buf);
+
+	// A stream can be stopped.
+	test_assert_int_eql(pipe(fds), 0);
+	buf = buffer_new_stream(NULL, fds[0], 0);
+	test_assert_int_eql(write(fds[1], "lorem\n", 6) == 6, true);
+	while (gbf_text_length(buf->gbuf) < 6) {
+		buffer_update_load(NULL, buf);
+		usleep(1000);
+	}
+	buffer_stop_stream(buf);
+	test_assert_int_eql(buf->stream, false);
+	test_assert_null(buf->loader);
+	text = gbf_text(buf->gbuf);
+	test_assert_str_eql(text, "lorem\n");
+	free(text);
+	close(fds[1]);
+	buffer_free(&buf);
+}
+
 int
 main(void) {
 	test_buffer_new();
+	test_buffer_new_file();
+	test_buffer_new_file_async();
+	test_buffer_load_failed();
+	test_buffer_new_lazy();
+	test_buffer_update_preload();
+	test_buffer_load_steps();
+	test_buffer_follow();
+	test_buffer_follow_journal();
+	test_buffer_new_stream();
 	test_buffer_append();
 	test_buffer_append_2();
 	test_buffer_append_3();
@@ -0,0 +1,63 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+#include "test.h"
+#include "../src/input.h"
+#include "../src/display.h"
+#include "../src/funcs.h"
+#include "../src/gapbuffer.h"
+#include "../src/chunk_list.h"
+#include "../src/menus.h"
+#include "../src/buffer.h"
+#include "../src/editor.h"
+
+void
+test_macro_play_lazy(void) {
+	char filename[] = "/tmp/drte-test-XXXXXX";
+	int fd = mkstemp(filename);
+	Buffer *buf;
+	Editor e;
+	char *text;
+
+	test_assert_int_eql(write(fd, "lorem\n", 6) == 6, true);
+	close(fd);
+	memset(&e, 0, sizeof(e));
+	e.macro_info.chunk_list = chunk_list_new(64);
+	buffer_append(&e.current_buffer, buffer_new(&e, NULL));
+	buffer_append(&e.current_buffer, buffer_new_lazy(&e, strdup(filename)));
+
+	// The buffer, that the macro switches to, is loaded before the insert.
+	macro_append(&e, &uf_next_buffer, "");
+	macro_append(&e, &uf_insert, "ipsum ");
+	macro_play(&e);
+	buf = e.current_buffer;
+	test_assert_str_eql(buf->filename, filename);
+	test_assert_not_null(buf->gbuf);
+	text = gbf_text(buf->gbuf);
+	test_assert_str_eql(text, "ipsum lorem\n");
+	free(text);
+
+	while (e.macro_info.first != NULL) {
+		MacroElement *m = e.macro_info.first;
+		e.macro_info.first = m->next;
+		free(m->text);
+		free(m);
+	}
+	chunk_list_free(&e.macro_info.chunk_list);
+	buffer_free(&e.current_buffer);
+	buffer_free(&e.current_buffer);
+	unlink(filename);
+}
+
+int
+main(void) {
+	test_macro_play_lazy();
+
+	test_print_message();
+	return 0;
+}
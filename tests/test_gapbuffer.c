@@ -1,3 +1,5 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -6,6 +8,9 @@
 #include "test.h"
 #include "../src/gapbuffer.h"
 
+size_t count_line_at(GapBuffer *gbuf, size_t offset);
+bool find_line_start(GapBuffer *gbuf, size_t line, size_t *offset);
+
 static void
 test_gbf_new(void) {
 	GapBuffer *gbuf = gbf_new();
@@ -83,6 +88,172 @@ test_gbf_insert_oor(void) {
 	gbf_free(&gbuf);
 }
 
+static void
+test_gbf_insert_growth(void) {
+	GapBuffer *gbuf = gbf_new();
+	size_t expected = 0;
+
+	for (size_t i = 0; i < 10000; i++) {
+		gbf_insert(gbuf, "abc", max_offset(gbuf));
+		expected += 3;
+	}
+	test_assert_size_t_eql((size_t)max_offset(gbuf), expected);
+	// The gap grows with the text, but never gets larger than the text.
+	test_assert_int_eql((size_t)gap_length(gbuf) < expected, true);
+	test_assert_int_eql(gbf_at(gbuf, expected - 1), 'c');
+
+	gbf_free(&gbuf);
+}
+
+static void
+test_gbf_reserve(void) {
+	GapBuffer *gbuf = gbf_new();
+	bool res;
+
+	gbf_insert(gbuf, "hello world", 0);
+	gbf_insert(gbuf, ">", 5);
+
+	res = gbf_reserve(gbuf, 1000);
+	test_assert_int_eql(res, true);
+	test_assert_int_eql(gap_length(gbuf) > 1000, true);
+
+	// The gap does not grow, while the reserved space is filled.
+	size_t glen = gap_length(gbuf);
+	for (size_t i = 0; i < 1000; i++) {
+		gbf_insert(gbuf, "x", 6);
+	}
+	test_assert_size_t_eql((size_t)gap_length(gbuf), glen - 1000);
+	test_assert_size_t_eql((size_t)max_offset(gbuf), (size_t)1012);
+
+	char *text = gbf_text(gbuf);
+	test_assert_int_eql(strncmp(text, "hello>x", 7), 0);
+	test_assert_str_eql(text + 1006, " world");
+
+	free(text);
+	gbf_free(&gbuf);
+}
+
+static void
+test_gbf_delete_shrink(void) {
+	GapBuffer *gbuf = gbf_new();
+	char *big = malloc(100001);
+
+	memset(big, 'a', 100000);
+	big[100000] = '\0';
+	big[0] = '<';
+	big[99999] = '>';
+
+	gbf_insert(gbuf, big, 0);
+	gbf_delete(gbuf, 1, 99998);
+
+	char *text = gbf_text(gbuf);
+	test_assert_str_eql(text, "<>");
+	test_assert_int_eql(gap_length(gbuf) < 4096, true);
+
+	gbf_insert(gbuf, "hello", 1);
+	free(text);
+	text = gbf_text(gbuf);
+	test_assert_str_eql(text, "<hello>");
+
+	free(text);
+	free(big);
+	gbf_free(&gbuf);
+}
+
+static void
+test_gbf_insert_n_binary(void) {
+	GapBuffer *gbuf = gbf_new();
+	char buffer[16];
+
+	gbf_insert_n(gbuf, "ab\0cd", 5, 0);
+	gbf_insert_n(gbuf, "\0\0", 2, 2);
+
+	test_assert_uint_eql(max_offset(gbuf), 7);
+	test_assert_size_t_eql(gbf_text_n(gbuf, 0, 16, buffer), (size_t)7);
+	test_assert_int_eql(memcmp(buffer, "ab\0\0\0cd", 7), 0);
+
+	char *text = gbf_text(gbuf);
+	test_assert_int_eql(memcmp(text, "ab\0\0\0cd", 8), 0);
+
+	free(text);
+	gbf_free(&gbuf);
+}
+
+static void
+test_gbf_text_n(void) {
+	GapBuffer *gbuf = gbf_new();
+	char buffer[16] = {0};
+
+	gbf_insert(gbuf, "world", 0);
+	gbf_insert(gbuf, "hello ", 0);
+
+	// The range spans the gap.
+	test_assert_size_t_eql(gbf_text_n(gbuf, 4, 4, buffer), (size_t)4);
+	test_assert_str_eql(buffer, "o wo");
+
+	memset(buffer, 0, sizeof(buffer));
+	test_assert_size_t_eql(gbf_text_n(gbuf, 8, 10, buffer), (size_t)3);
+	test_assert_str_eql(buffer, "rld");
+
+	test_assert_size_t_eql(gbf_text_n(gbuf, 11, 10, buffer), (size_t)0);
+
+	gbf_free(&gbuf);
+}
+
+static void
+test_gbf_chunk(void) {
+	GapBuffer *gbuf = gbf_new();
+	char *chunk;
+	size_t len;
+
+	gbf_insert(gbuf, "world", 0);
+	gbf_insert(gbuf, "hello ", 0);
+
+	len = gbf_chunk(gbuf, 0, &chunk);
+	test_assert_size_t_eql(len, (size_t)6);
+	test_assert_int_eql(strncmp(chunk, "hello ", len), 0);
+
+	len = gbf_chunk(gbuf, 2, &chunk);
+	test_assert_size_t_eql(len, (size_t)4);
+	test_assert_int_eql(strncmp(chunk, "llo ", len), 0);
+
+	len = gbf_chunk(gbuf, 6, &chunk);
+	test_assert_size_t_eql(len, (size_t)5);
+	test_assert_int_eql(strncmp(chunk, "world", len), 0);
+
+	len = gbf_chunk(gbuf, 11, &chunk);
+	test_assert_size_t_eql(len, (size_t)0);
+
+	gbf_free(&gbuf);
+}
+
+static void
+test_gbf_chunk_reverse(void) {
+	GapBuffer *gbuf = gbf_new();
+	char *chunk;
+	size_t len;
+
+	gbf_insert(gbuf, "world", 0);
+	gbf_insert(gbuf, "hello ", 0);
+
+	len = gbf_chunk_reverse(gbuf, 11, &chunk);
+	test_assert_size_t_eql(len, (size_t)5);
+	test_assert_int_eql(strncmp(chunk, "world", len), 0);
+
+	len = gbf_chunk_reverse(gbuf, 8, &chunk);
+	test_assert_size_t_eql(len, (size_t)2);
+	test_assert_int_eql(strncmp(chunk, "wo", len), 0);
+
+	len = gbf_chunk_reverse(gbuf, 6, &chunk);
+	test_assert_size_t_eql(len, (size_t)6);
+	test_assert_int_eql(strncmp(chunk, "hello ", len), 0);
+
+	len = gbf_chunk_reverse(gbuf, 0, &chunk);
+	test_assert_size_t_eql(len, (size_t)0);
+
+	gbf_free(&gbuf);
+}
+
 static void
 test_gbf_delete_start(void) {
 	GapBuffer * gbuf = gbf_new();
@@ -221,48 +392,6 @@ static char *lorem = "Lorem ipsum dolor sit amet, consectetur adipiscing elit,\n
 
 static char *foofoo = "hello foofoo world";
 
-static void
-test_make_table_1(void) {
-	char *pattern = "ipsum";
-	size_t len = 5;
-	size_t table[len];
-	size_t expected[5] = {0, 0, 0, 0, 0};
-
-	make_lps_table(pattern, len, table);
-
-	for (size_t i = 0; i < len; i++) {
-		test_assert_size_t_eql(table[i], expected[i]);
-	}
-}
-
-static void
-test_make_table_2(void) {
-	char *pattern = "foofoo";
-	size_t len = 6;
-	size_t table[len];
-	size_t expected[6] = {0, 0, 0, 1, 2, 3};
-
-	make_lps_table(pattern, len, table);
-
-	for (size_t i = 0; i < len; i++) {
-		test_assert_size_t_eql(table[i], expected[i]);
-	}
-}
-
-static void
-test_make_table_3(void) {
-	char *pattern = "aaaaabb";
-	size_t len = 7;
-	size_t table[len];
-	size_t expected[7] = {0, 1, 2, 3, 4, 0, 0};
-
-	make_lps_table(pattern, len, table);
-
-	for (size_t i = 0; i < len; i++) {
-		test_assert_size_t_eql(table[i], expected[i]);
-	}
-}
-
 static void
 test_search_start(void) {
 	GapBuffer *gbuf = gbf_new();
@@ -363,45 +492,107 @@ test_search_no_match(void) {
 }
 
 static void
-test_make_table_reverse_1(void) {
-	char *pattern = "ipsum";
-	size_t len = 5;
-	size_t table[len];
-	size_t expected[5] = {4, 4, 4, 4, 4};
+test_search_binary(void) {
+	GapBuffer *gbuf = gbf_new();
+	bool res;
+	size_t off = 0;
 
-	make_lps_table_reverse(pattern, len, table);
+	gbf_insert_n(gbuf, "foo\0bar\0", 8, 0);
 
-	for (size_t i = 0; i < len; i++) {
-		test_assert_size_t_eql(table[i], expected[i]);
-	}
+	res = gbf_search(gbuf, "\0bar", 4, 0, &off);
+	test_assert_int_eql(res, true);
+	test_assert_size_t_eql(off, (size_t)3);
+
+	// The byte after the text is not part of the text.
+	res = gbf_search(gbuf, "r\0\0", 3, 0, &off);
+	test_assert_int_eql(res, false);
+
+	res = gbf_search_reverse(gbuf, "o\0", 2, 100, &off);
+	test_assert_int_eql(res, true);
+	test_assert_size_t_eql(off, (size_t)2);
+
+	res = gbf_search_reverse(gbuf, "\0", 1, 100, &off);
+	test_assert_int_eql(res, true);
+	test_assert_size_t_eql(off, (size_t)7);
+
+	gbf_free(&gbuf);
 }
 
 static void
-test_make_table_reverse_2(void) {
-	char *pattern = "oofoof";
-	size_t len = 6;
-	size_t table[len];
-	size_t expected[6] = {2, 3, 4, 5, 5, 5};
+test_search_gap(void) {
+	GapBuffer *gbuf = gbf_new();
+	bool res;
+	size_t off = 0;
 
-	make_lps_table_reverse(pattern, len, table);
+	// Split the text, so the match spans the gap.
+	gbf_insert(gbuf, "ipsum dolor", 0);
+	gbf_insert(gbuf, "lorem ", 0);
 
-	for (size_t i = 0; i < len; i++) {
-		test_assert_size_t_eql(table[i], expected[i]);
-	}
+	res = gbf_search(gbuf, "em ip", 5, 0, &off);
+	test_assert_int_eql(res, true);
+	test_assert_size_t_eql(off, (size_t)3);
+
+	res = gbf_search_reverse(gbuf, "em ip", 5, 100, &off);
+	test_assert_int_eql(res, true);
+	test_assert_size_t_eql(off, (size_t)3);
+
+	gbf_free(&gbuf);
 }
 
 static void
-test_make_table_reverse_3(void) {
-	char *pattern = "bbaaaaaa";
-	size_t len = 7;
-	size_t table[len];
-	size_t expected[7] = {6, 6, 2, 3, 4, 5, 6};
+test_search_long_pattern(void) {
+	GapBuffer *gbuf = gbf_new();
+	size_t plen = 1 << 20;
+	char *pattern = malloc(plen);
+	size_t off = 0;
 
-	make_lps_table_reverse(pattern, len, table);
+	// The pattern is much larger than a stack frame.
+	memset(pattern, 'a', plen);
+	pattern[plen - 1] = 'b';
+	gbf_insert_n(gbuf, pattern, plen, 0);
+	gbf_insert(gbuf, "aaa", 0);
+	gbf_insert(gbuf, "x", 2);
 
-	for (size_t i = 0; i < len; i++) {
-		test_assert_size_t_eql(table[i], expected[i]);
-	}
+	test_assert_int_eql(gbf_search(gbuf, pattern, plen, 0, &off), true);
+	test_assert_size_t_eql(off, (size_t)4);
+	test_assert_int_eql(gbf_search_reverse(gbuf, pattern, plen, plen + 3, &off), true);
+	test_assert_size_t_eql(off, (size_t)4);
+	test_assert_int_eql(gbf_search_reverse(gbuf, pattern, plen, plen + 2, &off), false);
+
+	free(pattern);
+	gbf_free(&gbuf);
+}
+
+static void
+test_search_pieces(void) {
+	GapBuffer *gbuf = gbf_new_piece_table();
+	size_t off = 0;
+
+	// Every byte is a piece, so every match spans several pieces.
+	gbf_insert(gbuf, "o", 0);
+	gbf_insert(gbuf, "r", 0);
+	gbf_insert(gbuf, "o", 0);
+	gbf_insert(gbuf, "o", 0);
+	gbf_insert(gbuf, "f", 0);
+	gbf_insert(gbuf, "o", 0);
+	gbf_insert(gbuf, "o", 0);
+	gbf_insert(gbuf, "f", 0);
+
+	test_assert_int_eql(gbf_search(gbuf, "foo", 3, 0, &off), true);
+	test_assert_size_t_eql(off, (size_t)0);
+	test_assert_int_eql(gbf_search(gbuf, "foo", 3, 1, &off), true);
+	test_assert_size_t_eql(off, (size_t)3);
+	test_assert_int_eql(gbf_search(gbuf, "oor", 3, 0, &off), true);
+	test_assert_size_t_eql(off, (size_t)4);
+	test_assert_int_eql(gbf_search_reverse(gbuf, "foo", 3, 7, &off), true);
+	test_assert_size_t_eql(off, (size_t)3);
+	test_assert_int_eql(gbf_search_reverse(gbuf, "foo", 3, 4, &off), true);
+	test_assert_size_t_eql(off, (size_t)0);
+	test_assert_int_eql(gbf_search_reverse(gbuf, "oor", 3, 6, &off), true);
+	test_assert_size_t_eql(off, (size_t)4);
+	test_assert_int_eql(gbf_search_reverse(gbuf, "oor", 3, 5, &off), false);
+
+	gbf_free(&gbuf);
 }
 
 static void
@@ -504,6 +695,238 @@ test_search_no_match_reverse(void) {
 	gbf_free(&gbuf);
 }
 
+static void
+test_gbf_lines(void) {
+	GapBuffer *gbuf = gbf_new();
+	size_t off = 0;
+
+	gbf_insert(gbuf, "lorem\nipsum\ndolor", 0);
+	test_assert_size_t_eql(gbf_line_at(gbuf, 0), (size_t)1);
+	test_assert_size_t_eql(gbf_line_at(gbuf, 6), (size_t)2);
+	test_assert_size_t_eql(gbf_line_at(gbuf, 100), (size_t)3);
+	test_assert_int_eql(gbf_line_start(gbuf, 3, &off), true);
+	test_assert_size_t_eql(off, (size_t)12);
+	test_assert_int_eql(gbf_line_start(gbuf, 4, &off), false);
+	test_assert_int_eql(gbf_line_start(gbuf, 0, &off), false);
+
+	// The index is updated by inserts and deletes.
+	gbf_insert(gbuf, "\n\n", 0);
+	test_assert_size_t_eql(gbf_line_at(gbuf, 8), (size_t)4);
+	gbf_delete(gbuf, 0, 8);
+	test_assert_size_t_eql(gbf_line_at(gbuf, 0), (size_t)1);
+	test_assert_int_eql(gbf_line_start(gbuf, 2, &off), true);
+	test_assert_size_t_eql(off, (size_t)6);
+
+	// Text is indexed, when it is needed.
+	gbf_insert(gbuf, "\nsit amet", gbf_text_length(gbuf));
+	test_assert_int_eql(gbf_line_start(gbuf, 3, &off), true);
+	test_assert_size_t_eql(off, (size_t)12);
+
+	gbf_clear(gbuf);
+	test_assert_size_t_eql(gbf_line_at(gbuf, 0), (size_t)1);
+	test_assert_int_eql(gbf_line_start(gbuf, 2, &off), false);
+
+	gbf_free(&gbuf);
+}
+
+static void
+test_gbf_lines_without_index(void) {
+	GapBuffer *gbuf = gbf_new();
+	size_t off = 0;
+
+	// Without memory for the index, the lines are counted like by it.
+	gbf_insert(gbuf, "lorem\nipsum\ndolor\n", 0);
+	test_assert_size_t_eql(count_line_at(gbuf, 0), (size_t)1);
+	test_assert_size_t_eql(count_line_at(gbuf, 5), (size_t)1);
+	test_assert_size_t_eql(count_line_at(gbuf, 6), (size_t)2);
+	test_assert_size_t_eql(count_line_at(gbuf, 100), gbf_line_at(gbuf, 100));
+	test_assert_int_eql(find_line_start(gbuf, 1, &off), true);
+	test_assert_size_t_eql(off, (size_t)0);
+	test_assert_int_eql(find_line_start(gbuf, 3, &off), true);
+	test_assert_size_t_eql(off, (size_t)12);
+	test_assert_int_eql(find_line_start(gbuf, 4, &off), gbf_line_start(gbuf, 4, &off));
+	test_assert_int_eql(find_line_start(gbuf, 5, &off), false);
+
+	gbf_free(&gbuf);
+}
+
+static void
+test_gbf_piece_table(void) {
+	GapBuffer *gbuf = gbf_new_piece_table();
+	char *text;
+	size_t off = 0;
+
+	test_assert_not_null(gbuf);
+	gbf_insert(gbuf, "lorem dolor", 0);
+	gbf_insert(gbuf, "ipsum\n", 6);
+	gbf_delete(gbuf, 0, 1);
+	gbf_insert(gbuf, "L", 0);
+	text = gbf_text(gbuf);
+	test_assert_str_eql(text, "Lorem ipsum\ndolor");
+	free(text);
+
+	test_assert_size_t_eql(gbf_text_length(gbuf), (size_t)17);
+	test_assert_int_eql(gbf_at(gbuf, 6), 'i');
+	test_assert_int_eql(gbf_at(gbuf, 17), '\0');
+
+	// The match straddles two pieces.
+	test_assert_int_eql(gbf_search(gbuf, "em ip", 5, 0, &off), true);
+	test_assert_size_t_eql(off, (size_t)3);
+	test_assert_int_eql(gbf_search_reverse(gbuf, "m\nd", 3, 16, &off), true);
+	test_assert_size_t_eql(off, (size_t)10);
+
+	test_assert_size_t_eql(gbf_line_at(gbuf, 13), (size_t)2);
+	test_assert_int_eql(gbf_line_start(gbuf, 2, &off), true);
+	test_assert_size_t_eql(off, (size_t)12);
+
+	gbf_clear(gbuf);
+	test_assert_size_t_eql(gbf_text_length(gbuf), (size_t)0);
+
+	gbf_free(&gbuf);
+}
+
+// Reads "b\nc" from a file into "a\nd" and checks text and lines.
+static void
+check_gbf_read(GapBuffer *gbuf) {
+	FILE *file = tmpfile();
+	size_t bytes = 0;
+	size_t off = 0;
+	char *text;
+
+	fputs("b\nc", file);
+	rewind(file);
+
+	gbf_insert(gbuf, "a\nd", 0);
+	test_assert_size_t_eql(gbf_line_at(gbuf, 3), (size_t)2);
+
+	test_assert_int_eql(gbf_read(gbuf, fileno(file), 2, 2, &bytes), true);
+	test_assert_size_t_eql(bytes, (size_t)2);
+	test_assert_int_eql(gbf_read(gbuf, fileno(file), 2, 4, &bytes), true);
+	test_assert_size_t_eql(bytes, (size_t)1);
+	test_assert_int_eql(gbf_read(gbuf, fileno(file), 2, 5, &bytes), true);
+	test_assert_size_t_eql(bytes, (size_t)0);
+
+	text = gbf_text(gbuf);
+	test_assert_str_eql(text, "a\nb\ncd");
+	free(text);
+	test_assert_size_t_eql(gbf_line_at(gbuf, 5), (size_t)3);
+	test_assert_int_eql(gbf_line_start(gbuf, 3, &off), true);
+	test_assert_size_t_eql(off, (size_t)4);
+
+	fclose(file);
+	gbf_free(&gbuf);
+}
+
+static void
+test_gbf_read(void) {
+	GapBuffer *gbuf = gbf_new();
+	size_t bytes = 1;
+
+	check_gbf_read(gbf_new());
+	check_gbf_read(gbf_new_piece_table());
+
+	test_assert_int_eql(gbf_read(gbuf, -1, 2, 0, &bytes), false);
+	test_assert_size_t_eql(gbf_text_length(gbuf), (size_t)0);
+	gbf_free(&gbuf);
+}
+
+static void
+check_gbf_write(GapBuffer *gbuf) {
+	char *mem;
+	char *text;
+	size_t off = 0;
+
+	gbf_insert(gbuf, "a\nd", 0);
+	test_assert_size_t_eql(gbf_line_at(gbuf, 3), (size_t)2);
+
+	mem = gbf_write_begin(gbuf, 2, 4);
+	test_assert_not_null(mem);
+	memcpy(mem, "b\nc\n", 4);
+	test_assert_int_eql(gbf_write_commit(gbuf, 2, 1), true);
+	text = gbf_text(gbuf);
+	test_assert_str_eql(text, "a\nbd");
+	free(text);
+	test_assert_int_eql(gbf_write_commit(gbuf, 3, 3), true);
+
+	text = gbf_text(gbuf);
+	test_assert_str_eql(text, "a\nb\nc\nd");
+	free(text);
+	test_assert_size_t_eql(gbf_line_at(gbuf, 7), (size_t)4);
+	test_assert_int_eql(gbf_line_start(gbuf, 3, &off), true);
+	test_assert_size_t_eql(off, (size_t)4);
+
+	gbf_free(&gbuf);
+}
+
+static void
+test_gbf_write(void) {
+	check_gbf_write(gbf_new());
+	check_gbf_write(gbf_new_piece_table());
+}
+
+static void
+check_gbf_first_change(GapBuffer *gbuf) {
+	size_t offset = 0;
+
+	test_assert_int_eql(gbf_first_change(gbuf, &offset), false);
+	gbf_insert(gbuf, "lorem ipsum", 0);
+	test_assert_int_eql(gbf_first_change(gbuf, &offset), true);
+	test_assert_size_t_eql(offset, (size_t)0);
+
+	gbf_mark_saved(gbuf);
+	test_assert_int_eql(gbf_first_change(gbuf, &offset), false);
+	gbf_insert(gbuf, "x", 8);
+	gbf_delete(gbuf, 10, 1);
+	test_assert_int_eql(gbf_first_change(gbuf, &offset), true);
+	test_assert_size_t_eql(offset, (size_t)8);
+	gbf_delete(gbuf, 3, 1);
+	test_assert_int_eql(gbf_first_change(gbuf, &offset), true);
+	test_assert_size_t_eql(offset, (size_t)3);
+
+	// Deleting nothing is no change.
+	gbf_mark_saved(gbuf);
+	gbf_delete(gbuf, 100, 1);
+	gbf_insert(gbuf, "", 2);
+	test_assert_int_eql(gbf_first_change(gbuf, &offset), false);
+
+	gbf_free(&gbuf);
+}
+
+static void
+test_gbf_first_change(void) {
+	check_gbf_first_change(gbf_new());
+	check_gbf_first_change(gbf_new_piece_table());
+}
+
+static void
+check_gbf_snapshot(GapBuffer *gbuf) {
+	GapBuffer *copy;
+	char *text;
+
+	gbf_insert(gbuf, "lorem ipsum", 0);
+	gbf_insert(gbuf, " dolor", 5);
+	copy = gbf_snapshot(gbuf);
+	test_assert_not_null(copy);
+
+	gbf_delete(gbuf, 0, 6);
+	gbf_insert(gbuf, "sit ", 0);
+	text = gbf_text(copy);
+	test_assert_str_eql(text, "lorem dolor ipsum");
+	free(text);
+	text = gbf_text(gbuf);
+	test_assert_str_eql(text, "sit dolor ipsum");
+	free(text);
+
+	gbf_free(&copy);
+	gbf_free(&gbuf);
+}
+
+static void
+test_gbf_snapshot(void) {
+	check_gbf_snapshot(gbf_new());
+	check_gbf_snapshot(gbf_new_piece_table());
+}
+
 int
 main(void) {
 	test_gbf_new();
@@ -512,18 +935,28 @@ main(void) {
 	test_gbf_insert_before();
 	test_gbf_insert_after();
 	test_gbf_insert_oor();
+	test_gbf_insert_n_binary();
+	test_gbf_text_n();
+	test_gbf_chunk();
+	test_gbf_chunk_reverse();
+	test_gbf_insert_growth();
+	test_gbf_reserve();
 	test_gbf_delete_start();
 	test_gbf_delete_mid();
 	test_gbf_delete_end();
 	test_gbf_delete_oor();
 	test_gbf_delete_too_much();
+	test_gbf_delete_shrink();
 	test_gbf_clear();
 	test_gbf_at();
 	test_gbf_get_line();
-
-	test_make_table_1();
-	test_make_table_2();
-	test_make_table_3();
+	test_gbf_lines();
+	test_gbf_lines_without_index();
+	test_gbf_piece_table();
+	test_gbf_read();
+	test_gbf_write();
+	test_gbf_first_change();
+	test_gbf_snapshot();
 
 	test_search_start();
 	test_search_mid();
@@ -532,10 +965,10 @@ main(void) {
 	test_search_start_end();
 	test_search_foofoo();
 	test_search_no_match();
-
-	test_make_table_reverse_1();
-	test_make_table_reverse_2();
-	test_make_table_reverse_3();
+	test_search_binary();
+	test_search_gap();
+	test_search_long_pattern();
+	test_search_pieces();
 
 	test_search_start_reverse();
 	test_search_mid_reverse();
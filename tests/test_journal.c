@@ -0,0 +1,252 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "test.h"
+#include "../src/gapbuffer.h"
+#include "../src/journal.h"
+
+#define FILENAME "/tmp/drte-test-journal"
+
+// Checks, that the text of gbuf is s.
+static void
+check_text(GapBuffer *gbuf, char *s) {
+	char *text = gbf_text(gbuf);
+
+	test_assert_str_eql(text, s);
+	free(text);
+}
+
+// Returns the size of the journal of FILENAME.
+static size_t
+journal_size(void) {
+	struct stat st;
+
+	if (stat(FILENAME JOURNAL_SUFFIX, &st) != 0) {
+		return 0;
+	}
+	return st.st_size;
+}
+
+// Opens the journal for a file with the text "lorem\n" and records some edits.
+static void
+write_journal(void) {
+	GapBuffer *gbuf = gbf_new();
+	size_t replayed = 1;
+	Journal *j;
+
+	gbf_insert(gbuf, "lorem\n", 0);
+	j = journal_open(FILENAME, 6, 100, gbuf, &replayed);
+	test_assert_not_null(j);
+	test_assert_size_t_eql(replayed, (size_t)0);
+	gbf_set_journal(gbuf, j);
+
+	gbf_insert(gbuf, "ipsum\n", 6);
+	gbf_delete(gbuf, 0, 2);
+	gbf_insert(gbuf, "LO", 0);
+	check_text(gbuf, "LOrem\nipsum\n");
+	test_assert_int_eql(journal_is_pending(j), true);
+	test_assert_int_eql(journal_flush_due(j, 1000), false);
+	test_assert_int_eql(journal_flush(j), true);
+	test_assert_int_eql(journal_is_pending(j), false);
+
+	// The journal is kept, as if drte had crashed.
+	journal_free(&j, false);
+	test_assert_null(j);
+	gbf_free(&gbuf);
+}
+
+static void
+test_journal_replay(void) {
+	GapBuffer *gbuf = gbf_new();
+	size_t replayed = 0;
+	Journal *j;
+
+	write_journal();
+	gbf_insert(gbuf, "lorem\n", 0);
+	j = journal_open(FILENAME, 6, 100, gbuf, &replayed);
+	test_assert_not_null(j);
+	test_assert_size_t_eql(replayed, (size_t)3);
+	check_text(gbuf, "LOrem\nipsum\n");
+
+	// New edits are appended.
+	gbf_set_journal(gbuf, j);
+	gbf_insert(gbuf, "dolor\n", 12);
+	journal_free(&j, false);
+	gbf_free(&gbuf);
+
+	gbuf = gbf_new();
+	gbf_insert(gbuf, "lorem\n", 0);
+	j = journal_open(FILENAME, 6, 100, gbuf, &replayed);
+	test_assert_size_t_eql(replayed, (size_t)4);
+	check_text(gbuf, "LOrem\nipsum\ndolor\n");
+
+	// Closing the buffer removes the journal.
+	journal_free(&j, true);
+	test_assert_int_eql(access(FILENAME JOURNAL_SUFFIX, F_OK), -1);
+	gbf_free(&gbuf);
+}
+
+static void
+test_journal_truncated(void) {
+	GapBuffer *gbuf = gbf_new();
+	size_t replayed = 0;
+	size_t size;
+	Journal *j;
+
+	write_journal();
+	// The last record ("LO" at 0) was cut off in the middle.
+	size = journal_size();
+	test_assert_int_eql(truncate(FILENAME JOURNAL_SUFFIX, size - 1), 0);
+
+	gbf_insert(gbuf, "lorem\n", 0);
+	j = journal_open(FILENAME, 6, 100, gbuf, &replayed);
+	test_assert_not_null(j);
+	test_assert_size_t_eql(replayed, (size_t)2);
+	check_text(gbuf, "rem\nipsum\n");
+
+	// The incomplete record is removed.
+	test_assert_size_t_eql(journal_size(), size - 5);
+	journal_free(&j, true);
+	gbf_free(&gbuf);
+}
+
+static void
+test_journal_mismatch(void) {
+	GapBuffer *gbuf = gbf_new();
+	size_t replayed = 1;
+	Journal *j;
+
+	// The file was changed, since the journal was written.
+	write_journal();
+	gbf_insert(gbuf, "lorem\n", 0);
+	j = journal_open(FILENAME, 6, 101, gbuf, &replayed);
+	test_assert_not_null(j);
+	test_assert_size_t_eql(replayed, (size_t)0);
+	check_text(gbuf, "lorem\n");
+	journal_free(&j, false);
+
+	// A discarded journal is not replayed.
+	write_journal();
+	j = journal_open(FILENAME, 6, 100, gbuf, NULL);
+	test_assert_not_null(j);
+	check_text(gbuf, "lorem\n");
+	journal_free(&j, true);
+	gbf_free(&gbuf);
+
+	// The journal cannot be written.
+	gbuf = gbf_new();
+	j = journal_open("/nonexistent/drte-test", 0, -1, gbuf, &replayed);
+	test_assert_null(j);
+	gbf_free(&gbuf);
+}
+
+static void
+test_journal_rebase(void) {
+	GapBuffer *gbuf = gbf_new();
+	size_t replayed = 0;
+	Journal *j;
+
+	gbf_insert(gbuf, "lorem\n", 0);
+	j = journal_open(FILENAME, 6, 100, gbuf, &replayed);
+	gbf_set_journal(gbuf, j);
+	gbf_insert(gbuf, "ipsum\n", 6);
+
+	// The text is saved, while it is edited.
+	journal_mark(j);
+	test_assert_int_eql(journal_is_pending(j), false);
+	gbf_insert(gbuf, "dolor\n", 12);
+	test_assert_int_eql(journal_rebase(j, 12, 200), true);
+	journal_free(&j, false);
+	gbf_free(&gbuf);
+
+	// Only the edit after the save is applied to the saved file.
+	gbuf = gbf_new();
+	gbf_insert(gbuf, "lorem\nipsum\n", 0);
+	j = journal_open(FILENAME, 12, 200, gbuf, &replayed);
+	test_assert_size_t_eql(replayed, (size_t)1);
+	check_text(gbuf, "lorem\nipsum\ndolor\n");
+	journal_free(&j, true);
+	gbf_free(&gbuf);
+}
+
+static void
+test_journal_repair(void) {
+	GapBuffer *gbuf = gbf_new();
+	GapBuffer *snapshot;
+	size_t replayed = 0;
+	Journal *j;
+
+	gbf_insert(gbuf, "lorem\n", 0);
+	j = journal_open(FILENAME, 6, 100, gbuf, &replayed);
+	gbf_set_journal(gbuf, j);
+	gbf_insert(gbuf, "ipsum\n", 6);
+
+	// The save fails after the first 8 bytes of the file were written.
+	journal_mark(j);
+	snapshot = gbf_snapshot(gbuf);
+	gbf_insert(gbuf, "dolor\n", 12);
+	test_assert_int_eql(journal_repair(j, 8, 200, snapshot, 6), true);
+	journal_free(&j, false);
+	gbf_free(&snapshot);
+	gbf_free(&gbuf);
+
+	// The whole text is recovered from the half-written file.
+	gbuf = gbf_new();
+	gbf_insert(gbuf, "lorem\nip", 0);
+	j = journal_open(FILENAME, 8, 200, gbuf, &replayed);
+	test_assert_size_t_eql(replayed, (size_t)3);
+	check_text(gbuf, "lorem\nipsum\ndolor\n");
+	journal_free(&j, true);
+	gbf_free(&gbuf);
+}
+
+static void
+test_journal_large(void) {
+	GapBuffer *gbuf = gbf_new();
+	size_t size = 3 * 1024 * 1024;
+	char *data = malloc(size + 1);
+	size_t replayed = 0;
+	Journal *j;
+
+	for (size_t i = 0; i < size; i++) {
+		data[i] = 'a' + i % 26;
+	}
+	data[size] = '\0';
+
+	// Large inserts are written at once.
+	j = journal_open(FILENAME, 0, -1, gbuf, &replayed);
+	gbf_set_journal(gbuf, j);
+	gbf_insert(gbuf, data, 0);
+	test_assert_int_eql(journal_is_pending(j), false);
+	test_assert_int_eql(journal_size() > size, true);
+	gbf_clear(gbuf);
+	journal_free(&j, false);
+	gbf_free(&gbuf);
+
+	gbuf = gbf_new();
+	j = journal_open(FILENAME, 0, -1, gbuf, &replayed);
+	test_assert_size_t_eql(replayed, (size_t)2);
+	test_assert_size_t_eql(gbf_text_length(gbuf), (size_t)0);
+	journal_free(&j, true);
+	gbf_free(&gbuf);
+	free(data);
+}
+
+int
+main(void) {
+	test_journal_replay();
+	test_journal_truncated();
+	test_journal_mismatch();
+	test_journal_rebase();
+	test_journal_repair();
+	test_journal_large();
+
+	test_print_message();
+	return 0;
+}
@@ -0,0 +1,168 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+#include "../src/line_index.h"
+
+// Checks every offset and every line of the index against text.
+static bool
+index_matches(LineIndex *li, char *text, size_t len) {
+	size_t line = 0;
+	size_t start = 0;
+
+	if (line_index_length(li) != len) {
+		return false;
+	}
+	for (size_t i = 0; i <= len; i++) {
+		if (line_index_line(li, i) != line) {
+			return false;
+		}
+		if (i < len && text[i] == '\n') {
+			if (line_index_offset(li, line) != start) {
+				return false;
+			}
+			line++;
+			start = i + 1;
+		}
+	}
+	return line_index_offset(li, line) == start && line_index_lines(li) == line + 1;
+}
+
+static void
+test_line_index_new(void) {
+	LineIndex *li = line_index_new();
+
+	test_assert_not_null(li);
+	test_assert_size_t_eql(line_index_length(li), (size_t)0);
+	test_assert_size_t_eql(line_index_lines(li), (size_t)1);
+	test_assert_size_t_eql(line_index_line(li, 0), (size_t)0);
+	test_assert_size_t_eql(line_index_offset(li, 0), (size_t)0);
+
+	line_index_free(&li);
+	test_assert_null(li);
+}
+
+static void
+test_line_index_insert(void) {
+	LineIndex *li = line_index_new();
+	char *text = "lorem\nipsum\n\ndolor";
+
+	line_index_insert(li, 0, text, strlen(text));
+	test_assert_size_t_eql(line_index_lines(li), (size_t)4);
+	test_assert_size_t_eql(line_index_line(li, 5), (size_t)0);
+	test_assert_size_t_eql(line_index_line(li, 6), (size_t)1);
+	test_assert_size_t_eql(line_index_line(li, 12), (size_t)2);
+	test_assert_size_t_eql(line_index_line(li, 13), (size_t)3);
+	test_assert_size_t_eql(line_index_line(li, 100), (size_t)3);
+	test_assert_size_t_eql(line_index_offset(li, 1), (size_t)6);
+	test_assert_size_t_eql(line_index_offset(li, 3), (size_t)13);
+	test_assert_size_t_eql(line_index_offset(li, 100), (size_t)13);
+
+	// Split "ipsum" into two lines.
+	line_index_insert(li, 8, "\n", 1);
+	test_assert_size_t_eql(line_index_lines(li), (size_t)5);
+	test_assert_size_t_eql(line_index_offset(li, 2), (size_t)9);
+	test_assert_size_t_eql(line_index_line(li, 8), (size_t)1);
+	test_assert_size_t_eql(line_index_line(li, 9), (size_t)2);
+
+	line_index_free(&li);
+}
+
+static void
+test_line_index_delete(void) {
+	LineIndex *li = line_index_new();
+	char *text = "lorem\nipsum\n\ndolor";
+
+	line_index_insert(li, 0, text, strlen(text));
+
+	// Join "lorem" and "ipsum".
+	line_index_delete(li, 5, 1);
+	test_assert_size_t_eql(line_index_lines(li), (size_t)3);
+	test_assert_size_t_eql(line_index_offset(li, 1), (size_t)11);
+
+	// Delete within a line.
+	line_index_delete(li, 0, 5);
+	test_assert_size_t_eql(line_index_lines(li), (size_t)3);
+	test_assert_size_t_eql(line_index_offset(li, 1), (size_t)6);
+
+	line_index_delete(li, 0, line_index_length(li));
+	test_assert_size_t_eql(line_index_lines(li), (size_t)1);
+	test_assert_size_t_eql(line_index_length(li), (size_t)0);
+
+	line_index_free(&li);
+}
+
+static void
+test_line_index_many_lines(void) {
+	LineIndex *li = line_index_new();
+	size_t len = 20000;
+	char *text = malloc(len);
+
+	for (size_t i = 0; i < len; i++) {
+		text[i] = i % 7 == 6 ? '\n' : 'a';
+	}
+	line_index_insert(li, 0, text, len);
+	test_assert_int_eql(index_matches(li, text, len), true);
+
+	// Remove lines spanning several leaves.
+	memmove(text + 100, text + 15000, len - 15000);
+	line_index_delete(li, 100, 14900);
+	len -= 14900;
+	test_assert_int_eql(index_matches(li, text, len), true);
+
+	free(text);
+	line_index_free(&li);
+}
+
+static void
+test_line_index_random(void) {
+	LineIndex *li = line_index_new();
+	size_t cap = 1 << 16;
+	char *text = malloc(cap);
+	char insert[2048];
+	size_t len = 0;
+	bool ok = true;
+
+	srand(42);
+	for (int round = 0; round < 400 && ok; round++) {
+		size_t offset = len == 0 ? 0 : (size_t)rand() % (len + 1);
+
+		if (rand() % 3 != 0 && len + sizeof(insert) < cap) {
+			size_t n = (size_t)rand() % sizeof(insert);
+			int density = rand() % 20 + 1;
+
+			for (size_t i = 0; i < n; i++) {
+				insert[i] = rand() % density == 0 ? '\n' : 'x';
+			}
+			memmove(text + offset + n, text + offset, len - offset);
+			memcpy(text + offset, insert, n);
+			len += n;
+			ok = line_index_insert(li, offset, insert, n);
+		} else {
+			size_t n = (size_t)rand() % (len - offset + 1);
+
+			memmove(text + offset, text + offset + n, len - offset - n);
+			len -= n;
+			line_index_delete(li, offset, n);
+		}
+		ok = ok && index_matches(li, text, len);
+	}
+	test_assert_int_eql(ok, true);
+
+	free(text);
+	line_index_free(&li);
+}
+
+int
+main(void) {
+	test_line_index_new();
+	test_line_index_insert();
+	test_line_index_delete();
+	test_line_index_many_lines();
+	test_line_index_random();
+
+	test_print_message();
+	return 0;
+}
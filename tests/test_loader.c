@@ -0,0 +1,105 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "test.h"
+#include "../src/loader.h"
+
+// Polls l, until the worker has finished.
+static LoaderState
+wait_for(Loader *l, size_t *bytes) {
+	LoaderState state;
+
+	while ((state = loader_poll(l, bytes)) == LOADER_RUNNING) {
+		usleep(1000);
+	}
+	return state;
+}
+
+static void
+test_loader_file(void) {
+	size_t size = 10 * 1024 * 1024 + 3;
+	char *data = malloc(size);
+	char *text = malloc(size);
+	FILE *file = tmpfile();
+	size_t bytes = 0;
+	Loader *l;
+
+	for (size_t i = 0; i < size; i++) {
+		data[i] = rand();
+	}
+	test_assert_size_t_eql(fwrite(data, 1, size, file), size);
+	fflush(file);
+	rewind(file);
+
+	l = loader_new(dup(fileno(file)), text, size);
+	test_assert_not_null(l);
+	test_assert_int_eql(wait_for(l, &bytes), LOADER_DONE);
+	test_assert_size_t_eql(bytes, size);
+	test_assert_int_eql(memcmp(text, data, size), 0);
+	loader_free(&l);
+	test_assert_null(l);
+
+	// The file is shorter than expected.
+	rewind(file);
+	l = loader_new(dup(fileno(file)), text, size + 100);
+	test_assert_int_eql(wait_for(l, &bytes), LOADER_DONE);
+	test_assert_size_t_eql(bytes, size);
+	loader_free(&l);
+
+	fclose(file);
+	free(data);
+	free(text);
+}
+
+static void
+test_loader_pipe(void) {
+	char text[16];
+	size_t bytes = 0;
+	int fds[2];
+	Loader *l;
+
+	test_assert_int_eql(pipe(fds), 0);
+	l = loader_new(fds[0], text, sizeof(text));
+	test_assert_not_null(l);
+
+	test_assert_int_eql(write(fds[1], "abc", 3) == 3, true);
+	while (loader_poll(l, &bytes) == LOADER_RUNNING && bytes < 3) {
+		usleep(1000);
+	}
+	test_assert_size_t_eql(bytes, (size_t)3);
+	test_assert_int_eql(memcmp(text, "abc", 3), 0);
+
+	// The worker is waiting for more input, but can be stopped.
+	test_assert_int_eql(loader_poll(l, &bytes), LOADER_RUNNING);
+	loader_free(&l);
+	test_assert_null(l);
+	close(fds[1]);
+}
+
+static void
+test_loader_error(void) {
+	char text[16];
+	size_t bytes = 1;
+	Loader *l = loader_new(open("/", O_RDONLY), text, sizeof(text));
+
+	test_assert_not_null(l);
+	test_assert_int_eql(wait_for(l, &bytes), LOADER_FAILED);
+	test_assert_size_t_eql(bytes, (size_t)0);
+	loader_free(&l);
+}
+
+int
+main(void) {
+	test_loader_file();
+	test_loader_pipe();
+	test_loader_error();
+
+	test_print_message();
+	return 0;
+}
@@ -0,0 +1,264 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+#include "../src/piece_table.h"
+
+// Copies the text of a PieceTable into a new string.
+static char *
+pt_text(PieceTable *pt) {
+	size_t len = piece_table_length(pt);
+	char *text = malloc(len + 1);
+	char *chunk;
+	size_t n;
+
+	for (size_t off = 0; (n = piece_table_chunk(pt, off, &chunk)) > 0; off += n) {
+		memcpy(text + off, chunk, n);
+	}
+	text[len] = '\0';
+	return text;
+}
+
+static void
+test_piece_table_insert(void) {
+	PieceTable *pt = piece_table_new();
+	char *text;
+
+	test_assert_not_null(pt);
+	test_assert_size_t_eql(piece_table_length(pt), (size_t)0);
+
+	piece_table_insert(pt, "world", 5, 0);
+	piece_table_insert(pt, "hello ", 6, 0);
+	piece_table_insert(pt, "!", 1, 11);
+	piece_table_insert(pt, ",", 1, 5);
+	text = pt_text(pt);
+	test_assert_str_eql(text, "hello, world!");
+	test_assert_size_t_eql(piece_table_length(pt), (size_t)13);
+	free(text);
+
+	piece_table_free(&pt);
+	test_assert_null(pt);
+}
+
+static void
+test_piece_table_typing(void) {
+	PieceTable *pt = piece_table_new();
+	char *chunk;
+	char *text;
+
+	piece_table_insert(pt, "lorem", 5, 0);
+	piece_table_insert(pt, " ", 1, 5);
+	piece_table_insert(pt, "ipsum", 5, 6);
+
+	// Consecutive inserts extend the same piece.
+	test_assert_size_t_eql(piece_table_chunk(pt, 0, &chunk), (size_t)11);
+	text = pt_text(pt);
+	test_assert_str_eql(text, "lorem ipsum");
+	free(text);
+
+	piece_table_free(&pt);
+}
+
+static void
+test_piece_table_delete(void) {
+	PieceTable *pt = piece_table_new();
+	char *text;
+
+	piece_table_insert(pt, "lorem ipsum", 11, 0);
+	piece_table_insert(pt, "dolor ", 6, 6);
+
+	// Within a piece.
+	piece_table_delete(pt, 1, 2);
+	text = pt_text(pt);
+	test_assert_str_eql(text, "lem dolor ipsum");
+	free(text);
+
+	// Across pieces.
+	piece_table_delete(pt, 2, 9);
+	text = pt_text(pt);
+	test_assert_str_eql(text, "lepsum");
+	free(text);
+
+	piece_table_delete(pt, 0, 6);
+	test_assert_size_t_eql(piece_table_length(pt), (size_t)0);
+
+	piece_table_free(&pt);
+}
+
+static void
+test_piece_table_chunk_reverse(void) {
+	PieceTable *pt = piece_table_new();
+	char *chunk;
+	size_t len;
+
+	piece_table_insert(pt, "ipsum", 5, 0);
+	piece_table_insert(pt, "lorem ", 6, 0);
+
+	len = piece_table_chunk_reverse(pt, 8, &chunk);
+	test_assert_size_t_eql(len, (size_t)2);
+	test_assert_int_eql(strncmp(chunk, "ip", len), 0);
+	len = piece_table_chunk_reverse(pt, 6, &chunk);
+	test_assert_size_t_eql(len, (size_t)6);
+	test_assert_int_eql(strncmp(chunk, "lorem ", len), 0);
+	len = piece_table_chunk_reverse(pt, 0, &chunk);
+	test_assert_size_t_eql(len, (size_t)0);
+
+	piece_table_free(&pt);
+}
+
+static void
+test_piece_table_random(void) {
+	PieceTable *pt = piece_table_new();
+	size_t cap = 1 << 16;
+	char *text = malloc(cap + 1);
+	char insert[256];
+	size_t len = 0;
+	bool ok = true;
+
+	srand(7);
+	for (int round = 0; round < 2000 && ok; round++) {
+		size_t offset = len == 0 ? 0 : (size_t)rand() % (len + 1);
+
+		if (rand() % 2 == 0 && len + sizeof(insert) < cap) {
+			size_t n = (size_t)rand() % sizeof(insert);
+
+			for (size_t i = 0; i < n; i++) {
+				insert[i] = 'a' + rand() % 26;
+			}
+			memmove(text + offset + n, text + offset, len - offset);
+			memcpy(text + offset, insert, n);
+			len += n;
+			ok = piece_table_insert(pt, insert, n, offset);
+		} else {
+			size_t n = (size_t)rand() % (len - offset + 1);
+
+			if (n > 64) {
+				n = 64;
+			}
+			memmove(text + offset, text + offset + n, len - offset - n);
+			len -= n;
+			ok = piece_table_delete(pt, offset, n);
+		}
+		text[len] = '\0';
+
+		char *got = pt_text(pt);
+		ok = ok && piece_table_length(pt) == len && strcmp(got, text) == 0;
+		free(got);
+	}
+	test_assert_int_eql(ok, true);
+
+	piece_table_clear(pt);
+	test_assert_size_t_eql(piece_table_length(pt), (size_t)0);
+
+	free(text);
+	piece_table_free(&pt);
+}
+
+static void
+test_piece_table_map_file(void) {
+	PieceTable *pt = piece_table_new();
+	FILE *file = tmpfile();
+	char *text;
+
+	fputs("lorem ipsum", file);
+	fflush(file);
+
+	test_assert_int_eql(piece_table_map_file(pt, fileno(file), 11), true);
+	test_assert_int_eql(piece_table_is_mapped(pt), true);
+	test_assert_size_t_eql(piece_table_length(pt), (size_t)11);
+
+	// Only empty tables can map a file.
+	test_assert_int_eql(piece_table_map_file(pt, fileno(file), 11), false);
+	fclose(file);
+
+	piece_table_delete(pt, 5, 1);
+	piece_table_insert(pt, ", ", 2, 5);
+	text = pt_text(pt);
+	test_assert_str_eql(text, "lorem, ipsum");
+	free(text);
+
+	piece_table_clear(pt);
+	test_assert_int_eql(piece_table_is_mapped(pt), false);
+
+	piece_table_free(&pt);
+}
+
+static void
+test_piece_table_read(void) {
+	PieceTable *pt = piece_table_new();
+	FILE *file = tmpfile();
+	size_t bytes = 0;
+	char *read = NULL;
+	char *chunk;
+	char *text;
+
+	fputs("lorem ipsum", file);
+	rewind(file);
+
+	piece_table_insert(pt, "dolor", 5, 0);
+	test_assert_int_eql(piece_table_read(pt, fileno(file), 6, 0, &bytes, &read), true);
+	test_assert_size_t_eql(bytes, (size_t)6);
+	test_assert_int_eql(strncmp(read, "lorem ", 6), 0);
+	test_assert_int_eql(piece_table_read(pt, fileno(file), 5, 6, &bytes, &read), true);
+	test_assert_size_t_eql(bytes, (size_t)5);
+
+	// Consecutive reads extend the same piece.
+	test_assert_size_t_eql(piece_table_chunk(pt, 0, &chunk), (size_t)11);
+	text = pt_text(pt);
+	test_assert_str_eql(text, "lorem ipsumdolor");
+	free(text);
+
+	test_assert_int_eql(piece_table_read(pt, fileno(file), 5, 0, &bytes, &read), true);
+	test_assert_size_t_eql(bytes, (size_t)0);
+	test_assert_size_t_eql(piece_table_length(pt), (size_t)16);
+
+	fclose(file);
+	piece_table_free(&pt);
+}
+
+static void
+test_piece_table_snapshot(void) {
+	PieceTable *pt = piece_table_new();
+	PieceTable *copy;
+	char *text;
+
+	piece_table_insert(pt, "lorem ipsum", 11, 0);
+	piece_table_insert(pt, " dolor", 6, 5);
+	copy = piece_table_snapshot(pt);
+	test_assert_not_null(copy);
+
+	// Edits of the original do not change the copy.
+	piece_table_delete(pt, 0, 6);
+	piece_table_insert(pt, "sit ", 4, 0);
+	text = pt_text(copy);
+	test_assert_str_eql(text, "lorem dolor ipsum");
+	free(text);
+	text = pt_text(pt);
+	test_assert_str_eql(text, "sit dolor ipsum");
+	free(text);
+
+	piece_table_free(&copy);
+	text = pt_text(pt);
+	test_assert_str_eql(text, "sit dolor ipsum");
+	free(text);
+	piece_table_free(&pt);
+}
+
+int
+main(void) {
+	test_piece_table_insert();
+	test_piece_table_typing();
+	test_piece_table_delete();
+	test_piece_table_chunk_reverse();
+	test_piece_table_random();
+	test_piece_table_map_file();
+	test_piece_table_read();
+	test_piece_table_snapshot();
+
+	test_print_message();
+	return 0;
+}
@@ -0,0 +1,104 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "test.h"
+#include "../src/pool.h"
+
+#define N_JOBS 100
+
+// Squares the number.
+static void
+square(void *arg) {
+	size_t *n = arg;
+
+	*n = *n * *n;
+}
+
+// Waits, until the number is 0.
+static void
+wait_for_zero(void *arg) {
+	volatile size_t *n = arg;
+
+	while (*n != 0) {
+		usleep(1000);
+	}
+}
+
+static size_t discarded;
+
+static void
+count_discarded(void *arg) {
+	(void)arg;
+	discarded++;
+}
+
+static void
+test_pool_jobs(void) {
+	size_t numbers[N_JOBS];
+	bool seen[N_JOBS] = {false};
+	size_t taken = 0;
+	bool all = true;
+	Pool *p = pool_new(4);
+
+	test_assert_not_null(p);
+	test_assert_size_t_eql(pool_threads(p), (size_t)4);
+	test_assert_null(pool_take(p));
+	for (size_t i = 0; i < N_JOBS; i++) {
+		numbers[i] = i;
+		test_assert_int_eql(pool_add(p, square, &numbers[i]), true);
+	}
+
+	// Every job is handed back once.
+	while (taken < N_JOBS) {
+		size_t *n = pool_take(p);
+
+		if (n == NULL) {
+			usleep(1000);
+			continue;
+		}
+		seen[n - numbers] = true;
+		taken++;
+	}
+	test_assert_size_t_eql(pool_pending(p), (size_t)0);
+	for (size_t i = 0; i < N_JOBS; i++) {
+		all = all && seen[i] && numbers[i] == i * i;
+	}
+	test_assert_int_eql(all, true);
+	test_assert_null(pool_take(p));
+	pool_free(&p, NULL);
+	test_assert_null(p);
+}
+
+static void
+test_pool_discard(void) {
+	size_t block = 1;
+	size_t numbers[3] = {2, 3, 4};
+	Pool *p = pool_new(1);
+
+	// The only thread is busy, so the other jobs are still queued.
+	pool_add(p, wait_for_zero, &block);
+	for (size_t i = 0; i < 3; i++) {
+		pool_add(p, square, &numbers[i]);
+	}
+	test_assert_size_t_eql(pool_pending(p), (size_t)4);
+	test_assert_null(pool_take(p));
+
+	discarded = 0;
+	block = 0;
+	pool_free(&p, count_discarded);
+	test_assert_null(p);
+	test_assert_size_t_eql(discarded, (size_t)4);
+}
+
+int
+main(void) {
+	test_pool_jobs();
+	test_pool_discard();
+
+	test_print_message();
+	return 0;
+}
@@ -0,0 +1,204 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "test.h"
+#include "../src/input.h"
+#include "../src/display.h"
+#include "../src/funcs.h"
+#include "../src/gapbuffer.h"
+#include "../src/chunk_list.h"
+#include "../src/menus.h"
+#include "../src/buffer.h"
+#include "../src/save.h"
+
+// Reads a whole file into a new string.
+static char *
+read_file(char *filename, size_t *size) {
+	FILE *file = fopen(filename, "r");
+	char *text;
+
+	fseek(file, 0, SEEK_END);
+	*size = ftell(file);
+	rewind(file);
+	text = malloc(*size + 1);
+	*size = fread(text, 1, *size, file);
+	text[*size] = '\0';
+	fclose(file);
+	return text;
+}
+
+static void
+test_save(void) {
+	char filename[] = "/tmp/drte-test-XXXXXX";
+	int fd = mkstemp(filename);
+	size_t offset = 0;
+	size_t size = 0;
+	Buffer *buf;
+	char *text;
+
+	test_assert_int_eql(write(fd, "lorem\n", 6) == 6, true);
+	close(fd);
+	buf = buffer_new(NULL, strdup(filename));
+	gbf_insert(buf->gbuf, "ipsum\n", 6);
+
+	buf->save = save_start(buf);
+	test_assert_not_null(buf->save);
+	test_assert_int_eql(gbf_first_change(buf->gbuf, &offset), false);
+
+	// Edits during the save are not written.
+	gbf_insert(buf->gbuf, "dolor\n", 0);
+	test_assert_int_eql(save_finish(&buf->save, buf), true);
+	test_assert_null(buf->save);
+	text = read_file(filename, &size);
+	test_assert_str_eql(text, "lorem\nipsum\n");
+	free(text);
+	test_assert_size_t_eql(buf->file_size, (size_t)12);
+	test_assert_int_eql(gbf_first_change(buf->gbuf, &offset), true);
+	test_assert_size_t_eql(offset, (size_t)0);
+
+	buffer_free(&buf);
+	unlink(filename);
+}
+
+static void
+test_save_new(void) {
+	char filename[] = "/tmp/drte-test-XXXXXX";
+	mode_t mask = umask(0);
+	struct stat st;
+	Buffer *buf;
+
+	umask(mask);
+	close(mkstemp(filename));
+	unlink(filename);
+	buf = buffer_new(NULL, strdup(filename));
+	gbf_insert(buf->gbuf, "lorem\n", 0);
+
+	// A new file gets the mode, that fopen would give it.
+	buf->save = save_start(buf);
+	test_assert_int_eql(save_finish(&buf->save, buf), true);
+	test_assert_int_eql(stat(filename, &st), 0);
+	test_assert_int_eql(st.st_mode & 0777, 0666 & ~mask);
+
+	buffer_free(&buf);
+	unlink(filename);
+}
+
+static void
+test_save_error(void) {
+	Buffer *buf = buffer_new(NULL, strdup("/nonexistent/drte-test"));
+
+	gbf_insert(buf->gbuf, "lorem\n", 0);
+	buf->save = save_start(buf);
+	test_assert_not_null(buf->save);
+	test_assert_int_eql(save_finish(&buf->save, buf), false);
+	test_assert_int_eql(buf->has_changed, true);
+	test_assert_int_eql(buf->file_mtime == -1, true);
+
+	buffer_free(&buf);
+}
+
+static void
+test_save_rewrite(void) {
+	char filename[] = "/tmp/drte-test-XXXXXX";
+	int fd = mkstemp(filename);
+	size_t size = 33 * 1024 * 1024;
+	char *data = malloc(size);
+	size_t read_size = 0;
+	struct stat before;
+	struct stat after;
+	Buffer *buf;
+	char *text;
+	char *saved;
+
+	for (size_t i = 0; i < size; i++) {
+		data[i] = i % 64 == 63 ? '\n' : 'a' + i % 26;
+	}
+	test_assert_int_eql(write(fd, data, size) == (ssize_t)size, true);
+	close(fd);
+	stat(filename, &before);
+
+	// A file this large is mapped, its tail is rewritten in place.
+	buf = buffer_new(NULL, strdup(filename));
+	gbf_delete(buf->gbuf, size - 100, 10);
+	gbf_insert(buf->gbuf, "lorem", size - 1000);
+	buf->save = save_start(buf);
+	test_assert_int_eql(save_finish(&buf->save, buf), true);
+	stat(filename, &after);
+	test_assert_int_eql(before.st_ino == after.st_ino, true);
+
+	text = gbf_text(buf->gbuf);
+	saved = read_file(filename, &read_size);
+	test_assert_size_t_eql(read_size, size - 5);
+	test_assert_int_eql(memcmp(text, saved, read_size), 0);
+	test_assert_int_eql(memcmp(text, data, size - 1000), 0);
+	free(text);
+	free(saved);
+
+	free(data);
+	buffer_free(&buf);
+	unlink(filename);
+}
+
+static void
+test_save_rewrite_changed(void) {
+	char filename[] = "/tmp/drte-test-XXXXXX";
+	int fd = mkstemp(filename);
+	size_t size = 33 * 1024 * 1024;
+	char *data = malloc(size);
+	size_t read_size = 0;
+	struct timespec times[2];
+	struct stat before;
+	struct stat after;
+	Buffer *buf;
+	char *text;
+	char *saved;
+
+	memset(data, 'a', size);
+	test_assert_int_eql(write(fd, data, size) == (ssize_t)size, true);
+	buf = buffer_new(NULL, strdup(filename));
+	stat(filename, &before);
+
+	// The file is changed within the same second and keeps its size.
+	test_assert_int_eql(pwrite(fd, "lorem", 5, 0) == 5, true);
+	times[0].tv_nsec = UTIME_OMIT;
+	times[1].tv_sec = buf->file_mtime;
+	times[1].tv_nsec = (buf->file_mtime_nsec + 1) % 1000000000;
+	test_assert_int_eql(futimens(fd, times), 0);
+	close(fd);
+
+	// It is written completely, not from the first change on.
+	gbf_insert(buf->gbuf, "ipsum", size - 1000);
+	buf->save = save_start(buf);
+	test_assert_int_eql(save_finish(&buf->save, buf), true);
+	stat(filename, &after);
+	test_assert_int_eql(before.st_ino != after.st_ino, true);
+	text = gbf_text(buf->gbuf);
+	saved = read_file(filename, &read_size);
+	test_assert_size_t_eql(read_size, size + 5);
+	test_assert_int_eql(memcmp(text, saved, read_size), 0);
+	free(text);
+	free(saved);
+
+	free(data);
+	buffer_free(&buf);
+	unlink(filename);
+}
+
+int
+main(void) {
+	test_save();
+	test_save_new();
+	test_save_error();
+	test_save_rewrite();
+	test_save_rewrite_changed();
+
+	test_print_message();
+	return 0;
+}
@@ -0,0 +1,202 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+#include "../src/scan.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__) && defined(__GNUC__)
+// The SSE2 versions are only called by the library, if AVX2 is not supported.
+char *byte_sse2(char *s, size_t len, char c);
+char *byte_reverse_sse2(char *s, size_t len, char c);
+size_t count_sse2(char *s, size_t len, char c);
+char *nth_sse2(char *s, size_t len, char c, size_t *n);
+char *string_sse2(char *s, size_t len, char *p, size_t plen);
+char *string_reverse_sse2(char *s, size_t len, char *p, size_t plen);
+#define TEST_SSE2
+#endif
+
+static char *
+naive_byte(char *s, size_t len, char c) {
+	for (size_t i = 0; i < len; i++) {
+		if (s[i] == c) {
+			return s + i;
+		}
+	}
+	return NULL;
+}
+
+static char *
+naive_byte_reverse(char *s, size_t len, char c) {
+	while (len-- > 0) {
+		if (s[len] == c) {
+			return s + len;
+		}
+	}
+	return NULL;
+}
+
+static size_t
+naive_count(char *s, size_t len, char c) {
+	size_t count = 0;
+
+	for (size_t i = 0; i < len; i++) {
+		count += s[i] == c;
+	}
+	return count;
+}
+
+static void
+test_scan_simple(void) {
+	char *text = "lorem\nipsum\ndolor";
+	size_t len = strlen(text);
+	size_t n = 2;
+
+	test_assert_ptr_eql(scan_byte(text, len, '\n'), text + 5);
+	test_assert_ptr_eql(scan_byte_reverse(text, len, '\n'), text + 11);
+	test_assert_size_t_eql(scan_count(text, len, '\n'), (size_t)2);
+	test_assert_ptr_eql(scan_nth(text, len, '\n', &n), text + 11);
+
+	n = 3;
+	test_assert_null(scan_nth(text, len, '\n', &n));
+	test_assert_size_t_eql(n, (size_t)1);
+	test_assert_null(scan_byte(text, len, 'x'));
+	test_assert_null(scan_byte_reverse(text, 0, 'l'));
+	test_assert_size_t_eql(scan_count(text, 0, 'l'), (size_t)0);
+}
+
+static void
+test_scan_random(void) {
+	size_t size = 20000;
+	char *buffer = malloc(size);
+	bool ok = true;
+
+	srand(3);
+	for (int round = 0; round < 500 && ok; round++) {
+		size_t start = rand() % 64;
+		size_t len = rand() % (size - start);
+		int density = rand() % 300 + 1;
+		char *s = buffer + start;
+
+		for (size_t i = 0; i < size; i++) {
+			buffer[i] = rand() % density == 0 ? '\n' : 'a';
+		}
+		size_t count = naive_count(s, len, '\n');
+		size_t n = count > 0 ? (size_t)rand() % count + 1 : 1;
+		size_t m = n;
+		size_t left = n;
+		char *nth = s;
+
+		while ((nth = naive_byte(nth, len - (nth - s), '\n')) != NULL && --left > 0) {
+			nth++;
+		}
+		ok = ok && scan_byte(s, len, '\n') == naive_byte(s, len, '\n');
+		ok = ok && scan_byte_reverse(s, len, '\n') == naive_byte_reverse(s, len, '\n');
+		ok = ok && scan_count(s, len, '\n') == count;
+		ok = ok && scan_nth(s, len, '\n', &m) == nth;
+#ifdef TEST_SSE2
+		m = n;
+		ok = ok && byte_sse2(s, len, '\n') == naive_byte(s, len, '\n');
+		ok = ok && byte_reverse_sse2(s, len, '\n') == naive_byte_reverse(s, len, '\n');
+		ok = ok && count_sse2(s, len, '\n') == count;
+		ok = ok && nth_sse2(s, len, '\n', &m) == nth;
+#endif
+	}
+	test_assert_int_eql(ok, true);
+
+	free(buffer);
+}
+
+static void
+test_scan_large_count(void) {
+	// More than 255 blocks of matches.
+	size_t len = 100000 + 7;
+	char *s = malloc(len);
+
+	memset(s, '\n', len);
+	test_assert_size_t_eql(scan_count(s, len, '\n'), len);
+#ifdef TEST_SSE2
+	test_assert_size_t_eql(count_sse2(s, len, '\n'), len);
+#endif
+	free(s);
+}
+
+static char *
+naive_string(char *s, size_t len, char *p, size_t plen, bool reverse) {
+	char *found = NULL;
+
+	for (size_t i = 0; i + plen <= len; i++) {
+		if (memcmp(s + i, p, plen) == 0) {
+			found = s + i;
+			if (!reverse) {
+				break;
+			}
+		}
+	}
+	return found;
+}
+
+static void
+test_scan_string(void) {
+	char *text = "foofoobar";
+
+	test_assert_ptr_eql(scan_string(text, 9, "foo", 3), text);
+	test_assert_ptr_eql(scan_string_reverse(text, 9, "foo", 3), text + 3);
+	test_assert_ptr_eql(scan_string(text, 9, "bar", 3), text + 6);
+	test_assert_ptr_eql(scan_string(text, 9, "r", 1), text + 8);
+	test_assert_null(scan_string(text, 9, "baz", 3));
+	test_assert_null(scan_string(text, 2, "foo", 3));
+	test_assert_null(scan_string(text, 9, "", 0));
+}
+
+static void
+test_scan_string_random(void) {
+	size_t size = 5000;
+	char *buffer = malloc(size);
+	char pattern[40];
+	bool ok = true;
+
+	srand(5);
+	for (int round = 0; round < 2000 && ok; round++) {
+		size_t len = rand() % size;
+		size_t plen = rand() % sizeof(pattern) + 1;
+		int letters = rand() % 3 + 2;
+
+		for (size_t i = 0; i < len; i++) {
+			buffer[i] = 'a' + rand() % letters;
+		}
+		for (size_t i = 0; i < plen; i++) {
+			pattern[i] = 'a' + rand() % letters;
+		}
+		plen = plen % 6 + 1;
+
+		ok = ok && scan_string(buffer, len, pattern, plen) ==
+			naive_string(buffer, len, pattern, plen, false);
+		ok = ok && scan_string_reverse(buffer, len, pattern, plen) ==
+			naive_string(buffer, len, pattern, plen, true);
+#ifdef TEST_SSE2
+		if (plen > 1 && plen <= len) {
+			ok = ok && string_sse2(buffer, len, pattern, plen) ==
+				naive_string(buffer, len, pattern, plen, false);
+			ok = ok && string_reverse_sse2(buffer, len, pattern, plen) ==
+				naive_string(buffer, len, pattern, plen, true);
+		}
+#endif
+	}
+	test_assert_int_eql(ok, true);
+
+	free(buffer);
+}
+
+int
+main(void) {
+	test_scan_simple();
+	test_scan_random();
+	test_scan_large_count();
+	test_scan_string();
+	test_scan_string_random();
+
+	test_print_message();
+	return 0;
+}
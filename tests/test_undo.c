@@ -0,0 +1,223 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "test.h"
+#include "../src/gapbuffer.h"
+#include "../src/undo.h"
+
+#define FILENAME "/tmp/drte-test-undo"
+
+// Checks, that the text of gbuf is s.
+static void
+check_text(GapBuffer *gbuf, char *s) {
+	char *text = gbf_text(gbuf);
+
+	test_assert_str_eql(text, s);
+	free(text);
+}
+
+// Types s at offset one character at a time.
+static void
+type(Undo *u, GapBuffer *gbuf, char *s, size_t offset) {
+	for (size_t i = 0; s[i] != '\0'; i++) {
+		undo_insert(u, offset + i, s + i, 1);
+		gbf_insert_n(gbuf, s + i, 1, offset + i);
+	}
+}
+
+// Deletes len bytes before offset with backspace.
+static void
+backspace(Undo *u, GapBuffer *gbuf, size_t offset, size_t len) {
+	for (size_t i = 1; i <= len; i++) {
+		undo_delete(u, gbuf, offset - i, 1);
+		gbf_delete(gbuf, offset - i, 1);
+	}
+}
+
+static void
+test_undo_merge(void) {
+	GapBuffer *gbuf = gbf_new();
+	Undo *u = undo_new(1024 * 1024);
+	size_t offset = 0;
+
+	type(u, gbuf, "lorem", 0);
+	undo_seal(u);
+	type(u, gbuf, " ipsum", 5);
+	backspace(u, gbuf, 11, 3);
+	check_text(gbuf, "lorem ip");
+
+	// Typed and deleted characters are undone at once.
+	test_assert_int_eql(undo_undo(u, gbuf, &offset), true);
+	check_text(gbuf, "lorem ipsum");
+	test_assert_size_t_eql(offset, (size_t)11);
+	test_assert_int_eql(undo_undo(u, gbuf, &offset), true);
+	check_text(gbuf, "lorem");
+	test_assert_size_t_eql(offset, (size_t)5);
+	test_assert_int_eql(undo_undo(u, gbuf, &offset), true);
+	check_text(gbuf, "");
+	test_assert_int_eql(undo_undo(u, gbuf, &offset), false);
+
+	test_assert_int_eql(undo_redo(u, gbuf, &offset), true);
+	test_assert_int_eql(undo_redo(u, gbuf, &offset), true);
+	check_text(gbuf, "lorem ipsum");
+	test_assert_size_t_eql(offset, (size_t)11);
+
+	// A new edit drops the edits, that can be redone.
+	type(u, gbuf, "!", 11);
+	test_assert_int_eql(undo_redo(u, gbuf, &offset), false);
+	test_assert_int_eql(undo_undo(u, gbuf, &offset), true);
+	check_text(gbuf, "lorem ipsum");
+
+	// The delete key deletes forward.
+	undo_seal(u);
+	for (size_t i = 0; i < 6; i++) {
+		undo_delete(u, gbuf, 5, 1);
+		gbf_delete(gbuf, 5, 1);
+	}
+	check_text(gbuf, "lorem");
+	test_assert_int_eql(undo_undo(u, gbuf, &offset), true);
+	check_text(gbuf, "lorem ipsum");
+
+	undo_free(&u);
+	test_assert_null(u);
+	gbf_free(&gbuf);
+}
+
+static void
+test_undo_large(void) {
+	size_t size = 8 * 1024 * 1024;
+	char *data = malloc(size + 1);
+	GapBuffer *gbuf = gbf_new();
+	Undo *u = undo_new(32 * 1024 * 1024);
+	size_t offset = 0;
+	char *text;
+
+	for (size_t i = 0; i < size; i++) {
+		data[i] = 'a' + i % 26;
+	}
+	data[size] = '\0';
+	gbf_insert(gbuf, data, 0);
+
+	// A cut of the whole text is a single record.
+	type(u, gbuf, "xy", size);
+	undo_delete(u, gbuf, 0, size + 2);
+	gbf_delete(gbuf, 0, size + 2);
+	test_assert_int_eql(undo_undo(u, gbuf, &offset), true);
+	test_assert_size_t_eql(offset, size + 2);
+	test_assert_size_t_eql(gbf_text_length(gbuf), size + 2);
+	text = gbf_text(gbuf);
+	test_assert_int_eql(memcmp(text, data, size), 0);
+	free(text);
+	test_assert_int_eql(undo_undo(u, gbuf, &offset), true);
+	test_assert_size_t_eql(gbf_text_length(gbuf), size);
+
+	undo_free(&u);
+	gbf_free(&gbuf);
+	free(data);
+}
+
+static void
+test_undo_limit(void) {
+	size_t size = 100 * 1024;
+	char *data = malloc(size);
+	GapBuffer *gbuf = gbf_new();
+	Undo *u = undo_new(1024 * 1024);
+	size_t offset = 0;
+	size_t undone = 0;
+
+	memset(data, 'a', size);
+	// The oldest records are dropped.
+	for (size_t i = 0; i < 20; i++) {
+		undo_insert(u, i * size, data, size);
+		gbf_insert_n(gbuf, data, size, i * size);
+	}
+	while (undo_undo(u, gbuf, &offset)) {
+		undone++;
+	}
+	test_assert_int_eql(undone > 0 && undone < 20, true);
+	test_assert_size_t_eql(gbf_text_length(gbuf), (20 - undone) * size);
+
+	// An edit larger than the limit cannot be undone, nor can the ones before it.
+	gbf_clear(gbuf);
+	undo_clear(u);
+	type(u, gbuf, "lorem", 0);
+	data = realloc(data, 2 * 1024 * 1024);
+	memset(data, 'a', 2 * 1024 * 1024);
+	undo_insert(u, 5, data, 2 * 1024 * 1024);
+	gbf_insert_n(gbuf, data, 2 * 1024 * 1024, 5);
+	test_assert_int_eql(undo_undo(u, gbuf, &offset), false);
+
+	undo_free(&u);
+	gbf_free(&gbuf);
+	free(data);
+}
+
+static void
+test_undo_history(void) {
+	GapBuffer *gbuf = gbf_new();
+	Undo *u = undo_new(1024 * 1024);
+	size_t offset = 0;
+
+	// The file "lorem" was saved as "lorem ipsum!", then edited again.
+	gbf_insert(gbuf, "lorem", 0);
+	type(u, gbuf, " ipsum", 5);
+	undo_seal(u);
+	type(u, gbuf, "!", 11);
+	undo_mark(u);
+	type(u, gbuf, "?", 12);
+	undo_saved(u);
+	test_assert_int_eql(undo_write_history(u, FILENAME, 12, 100), true);
+	undo_free(&u);
+
+	// Only the edits up to the save are kept.
+	gbf_clear(gbuf);
+	gbf_insert(gbuf, "lorem ipsum!", 0);
+	u = undo_new(1024 * 1024);
+	test_assert_int_eql(undo_open_history(u, FILENAME, 12, 100), true);
+	test_assert_int_eql(undo_undo(u, gbuf, &offset), true);
+	check_text(gbuf, "lorem ipsum");
+	test_assert_int_eql(undo_undo(u, gbuf, &offset), true);
+	check_text(gbuf, "lorem");
+	test_assert_size_t_eql(offset, (size_t)5);
+	test_assert_int_eql(undo_undo(u, gbuf, &offset), false);
+	test_assert_int_eql(undo_redo(u, gbuf, &offset), true);
+	check_text(gbuf, "lorem ipsum");
+
+	// New edits follow the ones from the file.
+	type(u, gbuf, ".", 11);
+	test_assert_int_eql(undo_redo(u, gbuf, &offset), false);
+	undo_mark(u);
+	undo_saved(u);
+	test_assert_int_eql(undo_write_history(u, FILENAME, 12, 200), true);
+	undo_free(&u);
+
+	u = undo_new(1024 * 1024);
+	test_assert_int_eql(undo_open_history(u, FILENAME, 12, 200), true);
+	test_assert_int_eql(undo_undo(u, gbuf, &offset), true);
+	test_assert_int_eql(undo_undo(u, gbuf, &offset), true);
+	check_text(gbuf, "lorem");
+	undo_free(&u);
+
+	// The file changed, since the history was written.
+	u = undo_new(1024 * 1024);
+	test_assert_int_eql(undo_open_history(u, FILENAME, 12, 201), false);
+	test_assert_int_eql(undo_undo(u, gbuf, &offset), false);
+	undo_free(&u);
+
+	unlink(FILENAME UNDO_SUFFIX);
+	gbf_free(&gbuf);
+}
+
+int
+main(void) {
+	test_undo_merge();
+	test_undo_large();
+	test_undo_limit();
+	test_undo_history();
+
+	test_print_message();
+	return 0;
+}